@@ -0,0 +1,184 @@
+/**
+ * bitmap.c -- compressed bitmaps of 32-bit values
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * Values are split in blocks by their high 16 bits, as roaring bitmaps
+ * do. A block holds up to BITMAP_ARRAY_MAX values in a sorted array of
+ * their low 16 bits, growing by doubling, and turns into a fixed 8 KiB
+ * bitset past that. Small integer keys, e.g., visitor keys, thus take
+ * 2 bytes each while sparse, and down to a bit each as they get dense.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+#include "xmalloc.h"
+
+/* Find the position of the given high bits in the sorted blocks.
+ *
+ * If not found, the position it goes to is returned, negated, minus 1.
+ * On success, the position of the block is returned. */
+static int
+find_block (const GBitmap * bm, uint16_t high)
+{
+  int lo = 0, hi = (int) bm->len - 1, mid;
+
+  while (lo <= hi) {
+    mid = lo + (hi - lo) / 2;
+    if (bm->blocks[mid].high < high)
+      lo = mid + 1;
+    else if (bm->blocks[mid].high > high)
+      hi = mid - 1;
+    else
+      return mid;
+  }
+
+  return -lo - 1;
+}
+
+/* Insert an empty array block at the given position. */
+static GBitmapBlock *
+insert_block (GBitmap * bm, int pos, uint16_t high)
+{
+  GBitmapBlock *block;
+
+  bm->blocks = xrealloc (bm->blocks, (bm->len + 1) * sizeof (GBitmapBlock));
+  memmove (bm->blocks + pos + 1, bm->blocks + pos,
+           (bm->len - pos) * sizeof (GBitmapBlock));
+  bm->len++;
+
+  block = &bm->blocks[pos];
+  block->high = high;
+  block->cap = 4;
+  block->card = 0;
+  block->array = xmalloc (block->cap * sizeof (uint16_t));
+
+  return block;
+}
+
+/* Turn a full array block into a bitset. */
+static void
+array_to_bits (GBitmapBlock * block)
+{
+  uint64_t *bits = xcalloc (BITMAP_WORDS, sizeof (uint64_t));
+  uint32_t i;
+
+  for (i = 0; i < block->card; i++)
+    bits[block->array[i] >> 6] |= (uint64_t) 1 << (block->array[i] & 63);
+  free (block->array);
+  block->bits = bits;
+  block->cap = 0;
+}
+
+/* Set a value of an array block.
+ *
+ * If already set, 0 is returned.
+ * On success, 1 is returned. */
+static int
+array_add (GBitmapBlock * block, uint16_t low)
+{
+  int lo = 0, hi = (int) block->card - 1, mid;
+
+  while (lo <= hi) {
+    mid = lo + (hi - lo) / 2;
+    if (block->array[mid] < low)
+      lo = mid + 1;
+    else if (block->array[mid] > low)
+      hi = mid - 1;
+    else
+      return 0;
+  }
+
+  if (block->card == block->cap) {
+    block->cap *= 2;
+    block->array = xrealloc (block->array, block->cap * sizeof (uint16_t));
+  }
+  memmove (block->array + lo + 1, block->array + lo,
+           (block->card - lo) * sizeof (uint16_t));
+  block->array[lo] = low;
+  block->card++;
+
+  return 1;
+}
+
+/* Set a value of a bitset block.
+ *
+ * If already set, 0 is returned.
+ * On success, 1 is returned. */
+static int
+bits_add (GBitmapBlock * block, uint16_t low)
+{
+  uint64_t mask = (uint64_t) 1 << (low & 63);
+
+  if (block->bits[low >> 6] & mask)
+    return 0;
+  block->bits[low >> 6] |= mask;
+  block->card++;
+
+  return 1;
+}
+
+/* Set the given value, i.e., test and set.
+ *
+ * If already set, 0 is returned.
+ * On success, 1 is returned. */
+int
+bitmap_add (GBitmap * bm, uint32_t value)
+{
+  GBitmapBlock *block;
+  uint16_t high = value >> 16, low = value & 0xFFFF;
+  int pos, ret;
+
+  if ((pos = find_block (bm, high)) < 0)
+    block = insert_block (bm, -pos - 1, high);
+  else
+    block = &bm->blocks[pos];
+
+  if (block->cap != 0 && block->card == BITMAP_ARRAY_MAX)
+    array_to_bits (block);
+
+  ret = block->cap != 0 ? array_add (block, low) : bits_add (block, low);
+  bm->card += ret;
+
+  return ret;
+}
+
+/* Free the blocks of a bitmap, leaving it empty. */
+void
+bitmap_free (GBitmap * bm)
+{
+  uint32_t i;
+
+  for (i = 0; i < bm->len; i++) {
+    if (bm->blocks[i].cap != 0)
+      free (bm->blocks[i].array);
+    else
+      free (bm->blocks[i].bits);
+  }
+  free (bm->blocks);
+  memset (bm, 0, sizeof (*bm));
+}
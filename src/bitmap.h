@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifndef BITMAP_H_INCLUDED
+#define BITMAP_H_INCLUDED
+
+#include <stdint.h>
+
+/* values of a block kept as a sorted array, more make it a bitset */
+#define BITMAP_ARRAY_MAX 4096
+/* 64-bit words of a bitset block, one bit per low 16 bits value */
+#define BITMAP_WORDS     1024
+
+/* The values of a bitmap sharing their high 16 bits. Sparse blocks are
+ * a sorted array of the low 16 bits, dense ones a bitset. */
+typedef struct GBitmapBlock_
+{
+  uint16_t high;
+  uint16_t cap;                 /* array capacity, 0 if a bitset */
+  uint32_t card;
+  union
+  {
+    uint16_t *array;
+    uint64_t *bits;
+  };
+} GBitmapBlock;
+
+/* A compressed bitmap of 32-bit values, its blocks sorted by their high
+ * bits. A zeroed bitmap is empty. */
+typedef struct GBitmap_
+{
+  GBitmapBlock *blocks;
+  uint32_t len;
+  uint32_t card;
+} GBitmap;
+
+int bitmap_add (GBitmap * bm, uint32_t value);
+void bitmap_free (GBitmap * bm);
+
+#endif
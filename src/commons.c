@@ -126,10 +126,13 @@ get_module_enum (const char *str)
     {"REFERRERS", REFERRERS},
     {"REFERRING_SITES", REFERRING_SITES},
     {"KEYPHRASES", KEYPHRASES},
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     {"GEO_LOCATION", GEO_LOCATION},
 #endif
     {"STATUS_CODES", STATUS_CODES},
+    {"CUSTOM_1", CUSTOM_1},
+    {"CUSTOM_2", CUSTOM_2},
+    {"CUSTOM_3", CUSTOM_3},
   };
 
   return str2enum (enum_modules, ARRAY_SIZE (enum_modules), str);
@@ -399,6 +402,10 @@ init_modules (void)
     module_list[module] = -1;
 
   for (i = 0, module = 0; module < TOTAL_MODULES; ++module) {
+    /* user-defined panel slots are only used if defined */
+    if (IS_CUSTOM_MODULE (module) &&
+        (int) (module - CUSTOM_1) >= conf.custom_panel_idx)
+      continue;
     if (!ignore_panel (module)) {
       module_list[i++] = module;
     }
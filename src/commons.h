@@ -47,12 +47,15 @@ struct tm *now_tm;
 #define LOG_INVALID(x, ...) do { invalid_fprintf x; } while (0)
 
 /* total number of modules */
-#ifdef HAVE_LIBGEOIP
-#define TOTAL_MODULES    14
+#ifdef HAVE_GEOLOCATION
+#define TOTAL_MODULES    17
 #else
-#define TOTAL_MODULES    13
+#define TOTAL_MODULES    16
 #endif
 
+/* number of user-defined panels, see --custom-panel */
+#define MAX_CUSTOM_PANELS 3
+
 /* maximum number of items within a panel */
 #define MAX_CHOICES      366
 
@@ -89,12 +92,22 @@ typedef enum MODULES
   REFERRERS,
   REFERRING_SITES,
   KEYPHRASES,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   GEO_LOCATION,
 #endif
   STATUS_CODES,
+  CUSTOM_1,
+  CUSTOM_2,
+  CUSTOM_3,
 } GModule;
 
+/* Determine if a module is a user-defined panel */
+#define IS_CUSTOM_MODULE(module) ((module) >= CUSTOM_1)
+
+/* Determine if a module keeps the slowest requests of its keys */
+#define IS_SLOWEST_MODULE(module) \
+  ((module) == REQUESTS || (module) == REQUESTS_STATIC || (module) == NOT_FOUND)
+
 /* Metrics within GHolder or GDashData */
 typedef struct GMetrics
 {
@@ -24,6 +24,7 @@
 #define _FILE_OFFSET_BITS 64
 
 #include <ctype.h>
+#include <errno.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +42,9 @@
 #include "gkhash.h"
 #endif
 
+#include "error.h"
+#include "settings.h"
+#include "ship.h"
 #include "ui.h"
 #include "util.h"
 
@@ -67,10 +71,13 @@ static GPanel paneling[] = {
   {REFERRERS, print_csv_data},
   {REFERRING_SITES, print_csv_data},
   {KEYPHRASES, print_csv_data},
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION, print_csv_data},
 #endif
   {STATUS_CODES, print_csv_data},
+  {CUSTOM_1, print_csv_data},
+  {CUSTOM_2, print_csv_data},
+  {CUSTOM_3, print_csv_data},
 };
 
 /* Get a panel from the GPanel structure given a module.
@@ -240,7 +247,7 @@ print_csv_summary (FILE * fp, GLog * logger)
 
   /* visitors */
   fmt = "\"%d\",,\"%s\",,,,,,,,\"%d\",\"%s\"\r\n";
-  total = ht_get_size_uniqmap (VISITORS);
+  total = ht_get_size_uniqmap (VISITORS) + aggr_visitors ();
   fprintf (fp, fmt, i++, GENER_ID, total, OVERALL_VISITORS);
 
   /* files */
@@ -285,13 +292,16 @@ print_csv_summary (FILE * fp, GLog * logger)
 
 /* Entry point to generate a a csv report writing it to the fp */
 void
-output_csv (GLog * logger, GHolder * holder)
+output_csv (GLog * logger, GHolder * holder, const char *filename)
 {
   GModule module;
   FILE *fp = stdout;
   const GPanel *panel = NULL;
   size_t idx = 0;
 
+  if (filename != NULL && (fp = fopen (filename, "w")) == NULL)
+    FATAL ("Unable to open report file %s. %s", filename, strerror (errno));
+
   if (!conf.no_csv_summary)
     print_csv_summary (fp, logger);
 
@@ -0,0 +1,371 @@
+/**
+ * custom.c -- user-defined panels from extraction rules
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * A user-defined panel is given as NAME,FIELD,RULE,ARG, e.g.,
+ *
+ *   API versions,path,segment,2     /api/v2/items       -> v2
+ *   Tenants,query,param,tenant      ?tenant=acme&x=1    -> acme
+ *   Sessions,extra,regex,sid=(\w+)  %C field            -> the group
+ *
+ * Rules are compiled once. Regular expressions use PCRE2, with its JIT
+ * if the platform supports it, when built with --with-pcre2, and POSIX
+ * extended regular expressions otherwise.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "custom.h"
+
+#include "error.h"
+#include "settings.h"
+#include "ui.h"
+#include "util.h"
+#include "xmalloc.h"
+
+static GCustomPanel custom_panels[MAX_CUSTOM_PANELS];
+static int custom_panels_len = 0;
+
+static const GEnum custom_fields[] = {
+  {"host", CUSTOM_HOST},
+  {"vhost", CUSTOM_VHOST},
+  {"path", CUSTOM_PATH},
+  {"query", CUSTOM_QUERY},
+  {"referer", CUSTOM_REFERER},
+  {"agent", CUSTOM_AGENT},
+  {"status", CUSTOM_STATUS},
+  {"extra", CUSTOM_EXTRA},
+};
+
+static const GEnum custom_rules[] = {
+  {"prefix", CUSTOM_PREFIX},
+  {"segment", CUSTOM_SEGMENT},
+  {"param", CUSTOM_PARAM},
+  {"regex", CUSTOM_REGEX},
+};
+
+/* Compile the regular expression of a panel.
+ *
+ * On error, FATAL is triggered. */
+static void
+compile_regex (GCustomPanel * panel)
+{
+#ifdef HAVE_LIBPCRE2_8
+  PCRE2_SIZE off;
+  int err;
+  char msg[CUSTOM_KEY_LEN];
+
+  panel->re = pcre2_compile ((PCRE2_SPTR) panel->arg, PCRE2_ZERO_TERMINATED,
+                             0, &err, &off, NULL);
+  if (panel->re == NULL) {
+    pcre2_get_error_message (err, (PCRE2_UCHAR *) msg, sizeof (msg));
+    FATAL ("Invalid --custom-panel regex '%s': %s", panel->arg, msg);
+  }
+  /* the JIT is optional, matching falls back to the interpreter */
+  pcre2_jit_compile (panel->re, PCRE2_JIT_COMPLETE);
+  panel->match = pcre2_match_data_create_from_pattern (panel->re, NULL);
+#else
+  char msg[CUSTOM_KEY_LEN];
+  int err;
+
+  if ((err = regcomp (&panel->re, panel->arg, REG_EXTENDED)) != 0) {
+    regerror (err, &panel->re, msg, sizeof (msg));
+    FATAL ("Invalid --custom-panel regex '%s': %s", panel->arg, msg);
+  }
+#endif
+}
+
+/* Parse and compile a NAME,FIELD,RULE,ARG definition. The argument is
+ * the rest of the definition, so a pattern may contain commas.
+ *
+ * On error, FATAL is triggered. */
+static void
+parse_custom_panel (GCustomPanel * panel, const char *def)
+{
+  char name[CUSTOM_KEY_LEN], field[CUSTOM_KEY_LEN], rule[CUSTOM_KEY_LEN];
+  int len = 0, ival;
+  char *end = NULL;
+
+  if (sscanf (def, "%255[^,],%255[^,],%255[^,],%n", name, field, rule,
+              &len) != 3 || len == 0 || def[len] == '\0')
+    FATAL ("Invalid --custom-panel, expected NAME,FIELD,RULE,ARG: %s", def);
+
+  if ((ival = str2enum (custom_fields, ARRAY_SIZE (custom_fields), field)) < 0)
+    FATAL ("Invalid --custom-panel field: %s", field);
+  panel->field = ival;
+  if ((ival = str2enum (custom_rules, ARRAY_SIZE (custom_rules), rule)) < 0)
+    FATAL ("Invalid --custom-panel rule: %s", rule);
+  panel->rule = ival;
+
+  panel->name = xstrdup (name);
+  panel->arg = xstrdup (def + len);
+
+  switch (panel->rule) {
+  case CUSTOM_PREFIX:
+  case CUSTOM_SEGMENT:
+    panel->num = strtoul (panel->arg, &end, 10);
+    if (*end != '\0' || panel->num == 0)
+      FATAL ("--custom-panel %s expects a positive number.", rule);
+    break;
+  case CUSTOM_REGEX:
+    compile_regex (panel);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Ensure the name of a panel can key it in a JSON report, i.e., it is
+ * not taken by a built-in panel or an earlier user-defined panel.
+ *
+ * On error, FATAL is triggered. */
+static void
+check_custom_name (int idx)
+{
+  const char *name = custom_panels[idx].name;
+  int i;
+
+  if (!strcmp (name, GENER_ID))
+    FATAL ("--custom-panel name is taken: %s", name);
+  for (i = 0; i < CUSTOM_1; i++)
+    if (!strcmp (name, module_to_id (i)))
+      FATAL ("--custom-panel name is taken: %s", name);
+  for (i = 0; i < idx; i++)
+    if (!strcmp (name, custom_panels[i].name))
+      FATAL ("--custom-panel name is taken: %s", name);
+}
+
+/* Compile all user-defined panels, i.e., --custom-panel.
+ *
+ * On error, FATAL is triggered. */
+void
+init_custom_panels (void)
+{
+  int i;
+
+  for (i = 0; i < conf.custom_panel_idx; i++) {
+    parse_custom_panel (&custom_panels[i], conf.custom_panels[i]);
+    check_custom_name (i);
+  }
+  custom_panels_len = conf.custom_panel_idx;
+}
+
+/* Free all user-defined panels */
+void
+free_custom_panels (void)
+{
+  GCustomPanel *panel;
+  int i;
+
+  for (i = 0; i < custom_panels_len; i++) {
+    panel = &custom_panels[i];
+    if (panel->rule == CUSTOM_REGEX) {
+#ifdef HAVE_LIBPCRE2_8
+      pcre2_match_data_free (panel->match);
+      pcre2_code_free (panel->re);
+#else
+      regfree (&panel->re);
+#endif
+    }
+    free (panel->name);
+    free (panel->arg);
+  }
+  custom_panels_len = 0;
+}
+
+/* Get the name of a user-defined panel.
+ *
+ * If not defined, NULL is returned.
+ * On success, the panel name is returned. */
+const char *
+custom_panel_name (GModule module)
+{
+  int idx = module - CUSTOM_1;
+
+  if (!IS_CUSTOM_MODULE (module) || idx >= custom_panels_len)
+    return NULL;
+  return custom_panels[idx].name;
+}
+
+/* Get the value of the field a rule extracts from.
+ *
+ * If not available, NULL is returned.
+ * On success, the field value is returned. */
+static const char *
+custom_field (const GCustomPanel * panel, const GLogItem * glog)
+{
+  const char *qmark = NULL;
+
+  switch (panel->field) {
+  case CUSTOM_HOST:
+    return glog->host;
+  case CUSTOM_VHOST:
+    return glog->vhost;
+  case CUSTOM_PATH:
+    return glog->req;
+  case CUSTOM_QUERY:
+    if (glog->qstr)
+      return glog->qstr;
+    if (glog->req && (qmark = strchr (glog->req, '?')) != NULL)
+      return qmark + 1;
+    return NULL;
+  case CUSTOM_REFERER:
+    return glog->ref;
+  case CUSTOM_AGENT:
+    return glog->agent;
+  case CUSTOM_STATUS:
+    return glog->status;
+  case CUSTOM_EXTRA:
+    return glog->extra;
+  }
+
+  return NULL;
+}
+
+/* Copy a substring as a key.
+ *
+ * If empty, NULL is returned.
+ * On success, the malloc'd key is returned. */
+static char *
+dup_key (const char *str, size_t len)
+{
+  char *key;
+
+  if (len == 0)
+    return NULL;
+  if (len >= CUSTOM_KEY_LEN)
+    len = CUSTOM_KEY_LEN - 1;
+
+  key = xmalloc (len + 1);
+  memcpy (key, str, len);
+  key[len] = '\0';
+
+  return key;
+}
+
+/* Extract the Nth (1-based) segment of a path, e.g., 2 within
+ * /api/v2/items is v2. The query string is not part of the path. */
+static char *
+extract_segment (const char *str, size_t num)
+{
+  size_t len;
+
+  while (*str && *str != '?') {
+    str += strspn (str, "/");
+    len = strcspn (str, "/?");
+    if (--num == 0)
+      return dup_key (str, len);
+    str += len;
+  }
+
+  return NULL;
+}
+
+/* Extract the value of a query string parameter. The field may be a
+ * full request, in which case only its query string is searched. */
+static char *
+extract_param (const char *str, const char *name)
+{
+  const char *qmark = strchr (str, '?');
+  size_t nlen = strlen (name);
+
+  if (qmark != NULL)
+    str = qmark + 1;
+
+  while (*str) {
+    if (!strncmp (str, name, nlen) && str[nlen] == '=') {
+      str += nlen + 1;
+      return dup_key (str, strcspn (str, "&#"));
+    }
+    str += strcspn (str, "&");
+    str += *str == '&';
+  }
+
+  return NULL;
+}
+
+/* Extract the first capture group of a regex match, or the whole match
+ * if the pattern has no group. */
+static char *
+extract_regex (GCustomPanel * panel, const char *str)
+{
+#ifdef HAVE_LIBPCRE2_8
+  PCRE2_SIZE *ovector;
+  int rc;
+
+  rc = pcre2_match (panel->re, (PCRE2_SPTR) str, PCRE2_ZERO_TERMINATED, 0, 0,
+                    panel->match, NULL);
+  if (rc <= 0)
+    return NULL;
+
+  ovector = pcre2_get_ovector_pointer (panel->match);
+  if (rc > 1 && ovector[2] != PCRE2_UNSET)
+    return dup_key (str + ovector[2], ovector[3] - ovector[2]);
+  return dup_key (str + ovector[0], ovector[1] - ovector[0]);
+#else
+  regmatch_t match[2];
+
+  if (regexec (&panel->re, str, 2, match, 0) != 0)
+    return NULL;
+
+  if (panel->re.re_nsub > 0 && match[1].rm_so != -1)
+    return dup_key (str + match[1].rm_so, match[1].rm_eo - match[1].rm_so);
+  return dup_key (str + match[0].rm_so, match[0].rm_eo - match[0].rm_so);
+#endif
+}
+
+/* Extract the key of the given user-defined panel from a log item.
+ *
+ * If nothing is extracted, NULL is returned.
+ * On success, the malloc'd key is returned. */
+char *
+custom_panel_key (int idx, const GLogItem * glog)
+{
+  GCustomPanel *panel = NULL;
+  const char *str;
+  size_t len;
+
+  if (idx >= custom_panels_len)
+    return NULL;
+  panel = &custom_panels[idx];
+  if ((str = custom_field (panel, glog)) == NULL || *str == '\0')
+    return NULL;
+
+  switch (panel->rule) {
+  case CUSTOM_PREFIX:
+    len = strlen (str);
+    return dup_key (str, len < panel->num ? len : panel->num);
+  case CUSTOM_SEGMENT:
+    return extract_segment (str, panel->num);
+  case CUSTOM_PARAM:
+    return extract_param (str, panel->arg);
+  case CUSTOM_REGEX:
+    return extract_regex (panel, str);
+  }
+
+  return NULL;
+}
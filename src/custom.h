@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifndef CUSTOM_H_INCLUDED
+#define CUSTOM_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef HAVE_LIBPCRE2_8
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#else
+#include <regex.h>
+#endif
+
+#include "commons.h"
+#include "parser.h"
+
+/* Max length of an extracted key */
+#define CUSTOM_KEY_LEN 256
+
+/* Fields a rule extracts from */
+typedef enum GCustomField_
+{
+  CUSTOM_HOST,
+  CUSTOM_VHOST,
+  CUSTOM_PATH,
+  CUSTOM_QUERY,
+  CUSTOM_REFERER,
+  CUSTOM_AGENT,
+  CUSTOM_STATUS,
+  CUSTOM_EXTRA,
+} GCustomField;
+
+/* Extraction rules */
+typedef enum GCustomRule_
+{
+  CUSTOM_PREFIX,
+  CUSTOM_SEGMENT,
+  CUSTOM_PARAM,
+  CUSTOM_REGEX,
+} GCustomRule;
+
+/* A user-defined panel */
+typedef struct GCustomPanel_
+{
+  char *name;
+  GCustomField field;
+  GCustomRule rule;
+  char *arg;                    /* parameter name or pattern */
+  size_t num;                   /* prefix length or segment number */
+
+#ifdef HAVE_LIBPCRE2_8
+  pcre2_code *re;
+  pcre2_match_data *match;
+#else
+  regex_t re;
+#endif
+} GCustomPanel;
+
+char *custom_panel_key (int idx, const GLogItem * glog);
+const char *custom_panel_name (GModule module);
+void free_custom_panels (void);
+void init_custom_panels (void);
+
+#endif
@@ -23,9 +23,11 @@
 #include <config.h>
 #endif
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <string.h>
 #if defined(__GLIBC__)
 #include <execinfo.h>
 #endif
@@ -39,6 +41,20 @@ static FILE *log_file;
 static GLog *log_data;
 static FILE *log_invalid;
 
+/* Invalid requests are formatted into one buffer while a background
+ * thread writes the other one out. */
+static struct
+{
+  char *buf[2];
+  size_t len[2];
+  int cur;                      /* buffer being filled */
+  int busy;                     /* the other buffer is being written */
+  int stop;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} inv;
+
 /* Open a debug file whose name is specified in the given path. */
 void
 dbg_log_open (const char *path)
@@ -58,24 +74,107 @@ dbg_log_close (void)
     fclose (log_file);
 }
 
+/* Write out the full buffers handed over by invalid_fprintf(). */
+static void *
+invalid_writer (GO_UNUSED void *arg)
+{
+  int idx;
+
+  pthread_mutex_lock (&inv.mutex);
+  while (1) {
+    while (!inv.busy && !inv.stop)
+      pthread_cond_wait (&inv.cond, &inv.mutex);
+    if (!inv.busy)
+      break;
+
+    idx = !inv.cur;
+    pthread_mutex_unlock (&inv.mutex);
+    fwrite (inv.buf[idx], 1, inv.len[idx], log_invalid);
+    fflush (log_invalid);
+    pthread_mutex_lock (&inv.mutex);
+
+    inv.len[idx] = 0;
+    inv.busy = 0;
+    pthread_cond_broadcast (&inv.cond);
+  }
+  pthread_mutex_unlock (&inv.mutex);
+
+  return NULL;
+}
+
+/* Hand the buffer being filled over to the writer and start filling the
+ * other one, once the writer is done with it. */
+static void
+invalid_swap (void)
+{
+  pthread_mutex_lock (&inv.mutex);
+  while (inv.busy)
+    pthread_cond_wait (&inv.cond, &inv.mutex);
+  inv.cur = !inv.cur;
+  inv.busy = 1;
+  pthread_cond_broadcast (&inv.cond);
+  pthread_mutex_unlock (&inv.mutex);
+}
+
 /* Open the invalid requests log file whose name is specified in the
  * given path. */
 void
 invalid_log_open (const char *path)
 {
+  static int registered = 0;
+
+  if (log_invalid != NULL)
+    invalid_log_close ();
+
+  /* write out what is buffered on a FATAL() too */
+  if (!registered && atexit (invalid_log_close) == 0)
+    registered = 1;
+
   if (path != NULL) {
     log_invalid = fopen (path, "w");
     if (log_invalid == NULL)
       return;
   }
+
+  inv.buf[0] = malloc (INVALID_BUF_LEN);
+  inv.buf[1] = malloc (INVALID_BUF_LEN);
+  inv.len[0] = inv.len[1] = 0;
+  inv.cur = inv.busy = inv.stop = 0;
+  pthread_mutex_init (&inv.mutex, NULL);
+  pthread_cond_init (&inv.cond, NULL);
+  if (inv.buf[0] == NULL || inv.buf[1] == NULL ||
+      pthread_create (&inv.thread, NULL, invalid_writer, NULL) != 0) {
+    free (inv.buf[0]);
+    free (inv.buf[1]);
+    inv.buf[0] = inv.buf[1] = NULL;
+  }
 }
 
-/* Close the invalid requests log file. */
+/* Write out what is left, stop the writer and close the invalid
+ * requests log file. */
 void
 invalid_log_close (void)
 {
-  if (log_invalid != NULL)
-    fclose (log_invalid);
+  if (log_invalid == NULL)
+    return;
+
+  if (inv.buf[0] != NULL) {
+    pthread_mutex_lock (&inv.mutex);
+    inv.stop = 1;
+    pthread_cond_broadcast (&inv.cond);
+    pthread_mutex_unlock (&inv.mutex);
+    pthread_join (inv.thread, NULL);
+
+    fwrite (inv.buf[inv.cur], 1, inv.len[inv.cur], log_invalid);
+    free (inv.buf[0]);
+    free (inv.buf[1]);
+    inv.buf[0] = inv.buf[1] = NULL;
+    pthread_mutex_destroy (&inv.mutex);
+    pthread_cond_destroy (&inv.cond);
+  }
+
+  fclose (log_invalid);
+  log_invalid = NULL;
 }
 
 /* Set current overall parsed log data. */
@@ -154,19 +253,49 @@ dbg_fprintf (const char *fmt, ...)
   va_end (args);
 }
 
-/* Write formatted invalid requests log data to the logfile. */
+/* Write formatted invalid requests log data to the logfile. The data
+ * is buffered and written by a background thread. */
 void
 invalid_fprintf (const char *fmt, ...)
 {
   va_list args;
+  size_t left;
+  int n;
 
   if (!log_invalid)
     return;
 
+  /* no writer, write it synchronously */
+  if (inv.buf[0] == NULL) {
+    va_start (args, fmt);
+    vfprintf (log_invalid, fmt, args);
+    fflush (log_invalid);
+    va_end (args);
+    return;
+  }
+
+  left = INVALID_BUF_LEN - inv.len[inv.cur];
   va_start (args, fmt);
-  vfprintf (log_invalid, fmt, args);
-  fflush (log_invalid);
+  n = vsnprintf (inv.buf[inv.cur] + inv.len[inv.cur], left, fmt, args);
   va_end (args);
+  if (n < 0)
+    return;
+  if ((size_t) n < left) {
+    inv.len[inv.cur] += n;
+    return;
+  }
+
+  /* buffer full, hand it over and retry on the empty one */
+  invalid_swap ();
+  va_start (args, fmt);
+  n = vsnprintf (inv.buf[inv.cur], INVALID_BUF_LEN, fmt, args);
+  va_end (args);
+  if (n < 0)
+    return;
+  /* longer than a whole buffer, keep what fits */
+  if ((size_t) n >= INVALID_BUF_LEN)
+    n = INVALID_BUF_LEN - 1;
+  inv.len[inv.cur] = n;
 }
 
 #pragma GCC diagnostic warning "-Wformat-nonliteral"
@@ -38,6 +38,8 @@
 #include <settings.h>
 
 #define TRACE_SIZE 128
+/* Size of each of the invalid requests log buffers */
+#define INVALID_BUF_LEN (1 << 20)
 
 #define FATAL(fmt, ...) do {                                                  \
   (void) endwin ();                                                           \
@@ -0,0 +1,577 @@
+/**
+ * filter.c -- compiled pre-ingestion filter expressions
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * A filter expression is made of comparisons joined by 'and', 'or',
+ * 'not' and parentheses, e.g.,
+ *
+ *   vhost=api.example.com and status>=500
+ *   method=POST and path^=/checkout
+ *
+ * It is compiled once into a flat list of instructions. A test sets a
+ * single result register, 'and'/'or' become forward jumps on it, thus
+ * evaluation short-circuits and needs no stack.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "filter.h"
+
+#include "error.h"
+#include "settings.h"
+#include "util.h"
+#include "xmalloc.h"
+
+typedef enum GFilterToken_
+{
+  TK_END,
+  TK_LPAREN,
+  TK_RPAREN,
+  TK_AND,
+  TK_OR,
+  TK_NOT,
+  TK_CMP,
+  TK_WORD,
+} GFilterToken;
+
+/* Compiler state */
+typedef struct GFilterParser_
+{
+  const char *pos;
+  GFilterToken tok;
+  GFilterCmp cmp;
+  char word[FILTER_TOKEN_LEN];
+
+  GFilter *filter;
+  unsigned int fields;          /* bitmask of tested fields */
+} GFilterParser;
+
+/* A field, whether it is numeric, and the log format specifiers that
+ * provide it */
+typedef struct GFilterFieldDef_
+{
+  const char *name;
+  GFilterField field;
+  int is_num;
+  const char *specs;
+} GFilterFieldDef;
+
+static const GFilterFieldDef fields[] = {
+  {"host", FLT_HOST, 0, "h"},
+  {"vhost", FLT_VHOST, 0, "v"},
+  {"method", FLT_METHOD, 0, "mr"},
+  {"protocol", FLT_PROTOCOL, 0, "Hr"},
+  {"path", FLT_PATH, 0, "Ur"},
+  {"status", FLT_STATUS, 0, "s"},
+  {"size", FLT_SIZE, 1, "b"},
+  {"ts", FLT_TS, 1, "TDL"},
+  {"referer", FLT_REFERER, 0, "R"},
+  {"agent", FLT_AGENT, 0, "u"},
+  {"date", FLT_DATE, 0, "dx"},
+  {"time", FLT_TIME, 0, "tx"},
+};
+
+static void parse_or (GFilterParser * parser);
+
+/* Abort compiling on a syntax error */
+static void
+filter_error (GFilterParser * parser, const char *msg)
+{
+  FATAL ("Invalid --filter, %s near: %s", msg, parser->pos);
+}
+
+/* Read the next token. Once an operator is read, a value is expected,
+ * it runs until a space or a closing parenthesis unless quoted. */
+static void
+next_token (GFilterParser * parser, int value)
+{
+  const char *p = parser->pos;
+  size_t len = 0;
+
+  while (isspace ((unsigned char) *p))
+    p++;
+
+  parser->word[0] = '\0';
+  if (*p == '\0') {
+    parser->tok = TK_END;
+  } else if (*p == '"') {
+    for (p++; *p && *p != '"'; p++) {
+      if (*p == '\\' && p[1])
+        p++;
+      if (len + 1 >= FILTER_TOKEN_LEN)
+        filter_error (parser, "value too long");
+      parser->word[len++] = *p;
+    }
+    if (*p != '"')
+      filter_error (parser, "unterminated string");
+    p++;
+    parser->word[len] = '\0';
+    parser->tok = TK_WORD;
+  } else if (value) {
+    while (*p && !isspace ((unsigned char) *p) && *p != ')') {
+      if (len + 1 >= FILTER_TOKEN_LEN)
+        filter_error (parser, "value too long");
+      parser->word[len++] = *p++;
+    }
+    parser->word[len] = '\0';
+    parser->tok = TK_WORD;
+  } else if (*p == '(' || *p == ')') {
+    parser->tok = *p++ == '(' ? TK_LPAREN : TK_RPAREN;
+  } else if (!strncmp (p, "&&", 2) || !strncmp (p, "||", 2)) {
+    parser->tok = *p == '&' ? TK_AND : TK_OR;
+    p += 2;
+  } else if (!strncmp (p, "!=", 2) || !strncmp (p, "<=", 2) ||
+             !strncmp (p, ">=", 2) || !strncmp (p, "^=", 2) ||
+             !strncmp (p, "*=", 2) || !strncmp (p, "==", 2)) {
+    parser->tok = TK_CMP;
+    switch (*p) {
+    case '!':
+      parser->cmp = FLT_NE;
+      break;
+    case '<':
+      parser->cmp = FLT_LE;
+      break;
+    case '>':
+      parser->cmp = FLT_GE;
+      break;
+    case '^':
+      parser->cmp = FLT_PREFIX;
+      break;
+    case '*':
+      parser->cmp = FLT_CONTAINS;
+      break;
+    default:
+      parser->cmp = FLT_EQ;
+      break;
+    }
+    p += 2;
+  } else if (*p == '=' || *p == '<' || *p == '>') {
+    parser->tok = TK_CMP;
+    parser->cmp = *p == '=' ? FLT_EQ : *p == '<' ? FLT_LT : FLT_GT;
+    p++;
+  } else if (*p == '!') {
+    parser->tok = TK_NOT;
+    p++;
+  } else {
+    while (isalnum ((unsigned char) *p) || *p == '_') {
+      if (len + 1 >= FILTER_TOKEN_LEN)
+        filter_error (parser, "name too long");
+      parser->word[len++] = *p++;
+    }
+    if (len == 0)
+      filter_error (parser, "unexpected character");
+    parser->word[len] = '\0';
+
+    if (!strcasecmp (parser->word, "and"))
+      parser->tok = TK_AND;
+    else if (!strcasecmp (parser->word, "or"))
+      parser->tok = TK_OR;
+    else if (!strcasecmp (parser->word, "not"))
+      parser->tok = TK_NOT;
+    else
+      parser->tok = TK_WORD;
+  }
+
+  parser->pos = p;
+}
+
+/* Append an instruction.
+ *
+ * On success, the index of the new instruction is returned. */
+static int
+emit (GFilterParser * parser, GFilterOpcode opcode, int field, int cmp,
+      int arg)
+{
+  GFilter *filter = parser->filter;
+  GFilterInsn *insn;
+
+  filter->code =
+    xrealloc (filter->code, (filter->ncode + 1) * sizeof (GFilterInsn));
+  insn = &filter->code[filter->ncode];
+  insn->opcode = opcode;
+  insn->field = field;
+  insn->cmp = cmp;
+  insn->arg = arg;
+
+  return filter->ncode++;
+}
+
+/* Append an operand.
+ *
+ * On success, the index of the new operand is returned. */
+static int
+add_operand (GFilterParser * parser, const char *value)
+{
+  GFilter *filter = parser->filter;
+  GFilterOperand *op;
+  char *end = NULL;
+
+  filter->operands = xrealloc (filter->operands,
+                               (filter->noperands + 1) *
+                               sizeof (GFilterOperand));
+  op = &filter->operands[filter->noperands];
+  op->str = xstrdup (value);
+  op->num = strtoull (value, &end, 10);
+  op->is_num = *value != '\0' && *end == '\0' && isdigit ((unsigned char) *value);
+
+  return filter->noperands++;
+}
+
+/* Find a field given its name.
+ *
+ * If not found, NULL is returned.
+ * On success, the field definition is returned. */
+static const GFilterFieldDef *
+find_field (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < ARRAY_SIZE (fields); i++) {
+    if (!strcasecmp (fields[i].name, name))
+      return &fields[i];
+  }
+  return NULL;
+}
+
+/* comparison := FIELD CMP VALUE */
+static void
+parse_test (GFilterParser * parser)
+{
+  const GFilterFieldDef *def;
+  GFilterCmp cmp;
+  int operand;
+
+  if (parser->tok != TK_WORD || (def = find_field (parser->word)) == NULL)
+    filter_error (parser, "unknown field");
+
+  next_token (parser, 0);
+  if (parser->tok != TK_CMP)
+    filter_error (parser, "expected a comparison");
+  cmp = parser->cmp;
+
+  next_token (parser, 1);
+  if (parser->tok != TK_WORD)
+    filter_error (parser, "expected a value");
+  operand = add_operand (parser, parser->word);
+
+  if (def->is_num && (cmp == FLT_PREFIX || cmp == FLT_CONTAINS ||
+                      !parser->filter->operands[operand].is_num))
+    filter_error (parser, "numeric field expects a number");
+
+  parser->fields |= 1U << def->field;
+  emit (parser, FLT_OP_TEST, def->field, cmp, operand);
+  next_token (parser, 0);
+}
+
+/* primary := '(' expr ')' | comparison */
+static void
+parse_primary (GFilterParser * parser)
+{
+  if (parser->tok != TK_LPAREN) {
+    parse_test (parser);
+    return;
+  }
+
+  next_token (parser, 0);
+  parse_or (parser);
+  if (parser->tok != TK_RPAREN)
+    filter_error (parser, "expected ')'");
+  next_token (parser, 0);
+}
+
+/* unary := 'not' unary | primary */
+static void
+parse_not (GFilterParser * parser)
+{
+  if (parser->tok != TK_NOT) {
+    parse_primary (parser);
+    return;
+  }
+
+  next_token (parser, 0);
+  parse_not (parser);
+  emit (parser, FLT_OP_NOT, 0, 0, 0);
+}
+
+/* Parse a chain of operands joined by the given boolean operator. Each
+ * operand but the last jumps past the chain once its result decides
+ * the whole chain, i.e., false for 'and', true for 'or'. */
+static void
+parse_chain (GFilterParser * parser, GFilterToken tok,
+             void (*operand) (GFilterParser *))
+{
+  GFilterOpcode jump = tok == TK_AND ? FLT_OP_JF : FLT_OP_JT;
+  int *jumps = NULL, njumps = 0, i;
+
+  operand (parser);
+  while (parser->tok == tok) {
+    jumps = xrealloc (jumps, (njumps + 1) * sizeof (int));
+    jumps[njumps++] = emit (parser, jump, 0, 0, 0);
+
+    next_token (parser, 0);
+    operand (parser);
+  }
+
+  for (i = 0; i < njumps; i++)
+    parser->filter->code[jumps[i]].arg = parser->filter->ncode;
+  free (jumps);
+}
+
+/* conjunction := unary ('and' unary)* */
+static void
+parse_and (GFilterParser * parser)
+{
+  parse_chain (parser, TK_AND, parse_not);
+}
+
+/* expr := conjunction ('or' conjunction)* */
+static void
+parse_or (GFilterParser * parser)
+{
+  parse_chain (parser, TK_OR, parse_and);
+}
+
+/* Determine if the given specifier provides the given field. A request
+ * line only provides its method and protocol if they are kept. */
+static int
+spec_provides (const GFilterFieldDef * def, char spec)
+{
+  if (strchr (def->specs, spec) == NULL)
+    return 0;
+  if (spec == 'r' && def->field == FLT_METHOD)
+    return conf.append_method;
+  if (spec == 'r' && def->field == FLT_PROTOCOL)
+    return conf.append_protocol;
+  return 1;
+}
+
+/* Find the specifier within the log format after which all the tested
+ * fields are parsed.
+ *
+ * On error, i.e., a field is not in the log format, FATAL is triggered.
+ * On success, a pointer within the log format is returned. */
+static const char *
+find_ready_spec (GFilterParser * parser, const char *log_format)
+{
+  const char *ready = NULL, *p, *first;
+  size_t i;
+
+  for (i = 0; i < ARRAY_SIZE (fields); i++) {
+    if (!(parser->fields & (1U << fields[i].field)))
+      continue;
+
+    first = NULL;
+    for (p = log_format; *p && first == NULL; p++) {
+      if (p[0] == '%' && p[1] && spec_provides (&fields[i], p[1]))
+        first = p + 1;
+    }
+    if (first == NULL)
+      FATAL ("--filter field '%s' is not in the log format.", fields[i].name);
+    if (ready == NULL || first > ready)
+      ready = first;
+  }
+
+  return ready;
+}
+
+/* Compile a filter expression against the given log format.
+ *
+ * On error, FATAL is triggered.
+ * On success, the new filter is returned. */
+GFilter *
+filter_compile (const char *expr, const char *log_format)
+{
+  GFilterParser parser;
+
+  memset (&parser, 0, sizeof (parser));
+  parser.pos = expr;
+  parser.filter = xcalloc (1, sizeof (GFilter));
+
+  next_token (&parser, 0);
+  parse_or (&parser);
+  if (parser.tok != TK_END)
+    filter_error (&parser, "unexpected token");
+
+  parser.filter->ready = find_ready_spec (&parser, log_format);
+
+  return parser.filter;
+}
+
+/* Get the string value of a field, an absent field is empty. */
+static const char *
+field_str (const GLogItem * glog, GFilterField field)
+{
+  const char *str = NULL;
+
+  switch (field) {
+  case FLT_HOST:
+    str = glog->host;
+    break;
+  case FLT_VHOST:
+    str = glog->vhost;
+    break;
+  case FLT_METHOD:
+    str = glog->method;
+    break;
+  case FLT_PROTOCOL:
+    str = glog->protocol;
+    break;
+  case FLT_PATH:
+    str = glog->req;
+    break;
+  case FLT_STATUS:
+    str = glog->status;
+    break;
+  case FLT_REFERER:
+    str = glog->ref;
+    break;
+  case FLT_AGENT:
+    str = glog->agent;
+    break;
+  case FLT_DATE:
+    str = glog->date;
+    break;
+  case FLT_TIME:
+    str = glog->time;
+    break;
+  default:
+    break;
+  }
+
+  return str ? str : "";
+}
+
+/* Compare two values given an ordering comparison */
+static int
+cmp_order (GFilterCmp cmp, int diff)
+{
+  switch (cmp) {
+  case FLT_EQ:
+    return diff == 0;
+  case FLT_NE:
+    return diff != 0;
+  case FLT_LT:
+    return diff < 0;
+  case FLT_LE:
+    return diff <= 0;
+  case FLT_GT:
+    return diff > 0;
+  case FLT_GE:
+    return diff >= 0;
+  default:
+    return 0;
+  }
+}
+
+/* Run a single comparison.
+ *
+ * If it holds, 1 is returned, else 0 is returned. */
+static int
+run_test (const GFilter * filter, const GFilterInsn * insn,
+          const GLogItem * glog)
+{
+  const GFilterOperand *op = &filter->operands[insn->arg];
+  const char *str;
+  uint64_t num;
+
+  if (insn->field == FLT_SIZE || insn->field == FLT_TS) {
+    num = insn->field == FLT_SIZE ? glog->resp_size : glog->serve_time;
+    return cmp_order (insn->cmp, (num > op->num) - (num < op->num));
+  }
+
+  str = field_str (glog, insn->field);
+  switch (insn->cmp) {
+  case FLT_PREFIX:
+    return strncmp (str, op->str, strlen (op->str)) == 0;
+  case FLT_CONTAINS:
+    return strstr (str, op->str) != NULL;
+  case FLT_EQ:
+  case FLT_NE:
+    return cmp_order (insn->cmp, strcmp (str, op->str));
+  default:
+    break;
+  }
+
+  /* order numerically against a number, e.g., status>=500 */
+  if (op->is_num) {
+    num = strtoull (str, NULL, 10);
+    return cmp_order (insn->cmp, (num > op->num) - (num < op->num));
+  }
+  return cmp_order (insn->cmp, strcmp (str, op->str));
+}
+
+/* Evaluate a compiled filter against a parsed log item.
+ *
+ * If the item is kept, 1 is returned, else 0 is returned. */
+int
+filter_match (const GFilter * filter, const GLogItem * glog)
+{
+  const GFilterInsn *insn;
+  int pc = 0, res = 0;
+
+  while (pc < filter->ncode) {
+    insn = &filter->code[pc];
+    switch (insn->opcode) {
+    case FLT_OP_TEST:
+      res = run_test (filter, insn, glog);
+      pc++;
+      break;
+    case FLT_OP_NOT:
+      res = !res;
+      pc++;
+      break;
+    case FLT_OP_JF:
+      pc = res ? pc + 1 : insn->arg;
+      break;
+    case FLT_OP_JT:
+      pc = res ? insn->arg : pc + 1;
+      break;
+    default:
+      pc++;
+      break;
+    }
+  }
+
+  return res;
+}
+
+/* Free a compiled filter */
+void
+filter_free (GFilter * filter)
+{
+  int i;
+
+  if (filter == NULL)
+    return;
+
+  for (i = 0; i < filter->noperands; i++)
+    free (filter->operands[i].str);
+  free (filter->operands);
+  free (filter->code);
+  free (filter);
+}
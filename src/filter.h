@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#ifndef FILTER_H_INCLUDED
+#define FILTER_H_INCLUDED
+
+#include <stdint.h>
+
+#include "parser.h"
+
+#define FILTER_TOKEN_LEN 256
+
+/* Fields a filter can test */
+typedef enum GFilterField_
+{
+  FLT_HOST,
+  FLT_VHOST,
+  FLT_METHOD,
+  FLT_PROTOCOL,
+  FLT_PATH,
+  FLT_STATUS,
+  FLT_SIZE,
+  FLT_TS,
+  FLT_REFERER,
+  FLT_AGENT,
+  FLT_DATE,
+  FLT_TIME,
+} GFilterField;
+
+/* Comparison operators */
+typedef enum GFilterCmp_
+{
+  FLT_EQ,
+  FLT_NE,
+  FLT_LT,
+  FLT_LE,
+  FLT_GT,
+  FLT_GE,
+  FLT_PREFIX,
+  FLT_CONTAINS,
+} GFilterCmp;
+
+/* Instructions. A test sets the result register, jumps branch on it */
+typedef enum GFilterOpcode_
+{
+  FLT_OP_TEST,
+  FLT_OP_NOT,
+  FLT_OP_JF,
+  FLT_OP_JT,
+} GFilterOpcode;
+
+typedef struct GFilterInsn_
+{
+  unsigned char opcode;
+  unsigned char field;
+  unsigned char cmp;
+  int arg;                      /* operand index or jump target */
+} GFilterInsn;
+
+/* An operand, both as given and as a number if numeric */
+typedef struct GFilterOperand_
+{
+  char *str;
+  uint64_t num;
+  int is_num;
+} GFilterOperand;
+
+/* A compiled filter expression */
+typedef struct GFilter_
+{
+  GFilterInsn *code;
+  int ncode;
+  GFilterOperand *operands;
+  int noperands;
+
+  /* log format specifier after which all tested fields are parsed */
+  const char *ready;
+} GFilter;
+
+GFilter *filter_compile (const char *expr, const char *log_format);
+int filter_match (const GFilter * filter, const GLogItem * glog);
+void filter_free (GFilter * filter);
+
+#endif
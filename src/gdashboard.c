@@ -778,7 +778,8 @@ render_description (WINDOW * win, GDashModule * data, int *y)
   getmaxyx (win, h, w);
   (void) h;
 
-  draw_header (win, data->desc, " %s", (*y), 0, w, color_panel_desc);
+  draw_header (win, data->loading ? LOADING_LBL : data->desc, " %s", (*y), 0,
+               w, color_panel_desc);
 
   data->pos_y = (*y);
   (*y)++;
@@ -907,7 +908,16 @@ render_cols (WINDOW * win, GDashModule * data, int *y)
   const GOutput *output = output_lookup (module);
   int x = get_xpos ();
 
-  if (data->idx_data == 0 || conf.no_column_names)
+  if (conf.no_column_names)
+    return;
+
+  /* data is still being built */
+  if (data->loading) {
+    lprint_col (win, *y, &x, strlen (LOADING_LBL), "%s", LOADING_LBL);
+    return;
+  }
+
+  if (data->idx_data == 0)
     return;
 
   if (output->hits)
@@ -83,6 +83,7 @@ typedef struct GDashModule_
   int holder_size; /* hash table size  */
   int ht_size;     /* hash table size  */
   int idx_data;    /* idx data         */
+  int loading;     /* data being built */
   int max_hits;
   int method_len;
   int perc_len;
@@ -45,12 +45,6 @@
 
 #include "gdns.h"
 
-#ifdef HAVE_LIBTOKYOCABINET
-#include "tcabdb.h"
-#else
-#include "gkhash.h"
-#endif
-
 #include "error.h"
 #include "goaccess.h"
 #include "util.h"
@@ -59,6 +53,11 @@
 GDnsThread gdns_thread;
 static GDnsQueue *gdns_queue;
 
+/* Resolved hostnames. Lookups publish under the queue mutex, thus one
+ * at a time, by prepending immutable nodes to a bucket, so readers
+ * never lock. */
+static GDnsHost *gdns_hosts[HOST_BUCKETS];
+
 /* Initialize the queue. */
 void
 gqueue_init (GDnsQueue * q, int capacity)
@@ -199,57 +198,131 @@ reverse_ip (char *str)
   return NULL;
 }
 
-/* Producer - Resolve an IP address and add it to the queue. */
-void
-dns_resolver (char *addr)
+/* Find the published node of the given IP address.
+ *
+ * If not found, NULL is returned.
+ * On success, the node is returned. */
+static GDnsHost *
+find_hostname (const char *ip)
 {
-  pthread_mutex_lock (&gdns_thread.mutex);
-  /* queue is not full and the IP address is not in the queue */
-  if (!gqueue_full (gdns_queue) && !gqueue_find (gdns_queue, addr)) {
-    /* add the IP to the queue */
-    gqueue_enqueue (gdns_queue, addr);
-    pthread_cond_broadcast (&gdns_thread.not_empty);
+  GDnsHost *node = NULL;
+  uint64_t bucket = str_hash64 (ip) % HOST_BUCKETS;
+
+  node = __atomic_load_n (&gdns_hosts[bucket], __ATOMIC_ACQUIRE);
+  for (; node != NULL; node = node->next) {
+    if (strcmp (node->ip, ip) == 0)
+      return node;
   }
-  pthread_mutex_unlock (&gdns_thread.mutex);
+
+  return NULL;
 }
 
-/* Consumer - Once an IP has been resolved, add it to dwithe hostnames
- * hash structure. */
+/* Get the resolved hostname of the given IP address. It does not
+ * block, thus it can be called while a lookup publishes.
+ *
+ * If not resolved yet, NULL is returned.
+ * On success, a malloc'd hostname is returned. */
+char *
+gdns_get_hostname (const char *ip)
+{
+  GDnsHost *node = NULL;
+
+  if ((node = find_hostname (ip)) == NULL)
+    return NULL;
+  return xstrdup (node->host);
+}
+
+/* Publish a resolved hostname. The node is fully built before it is
+ * made reachable, so a reader sees either the old or the new bucket
+ * head. The queue mutex must be held. */
 static void
-dns_worker (void GO_UNUSED (*ptr_data))
+publish_hostname (const char *ip, const char *host)
+{
+  GDnsHost *node = NULL;
+  uint64_t bucket = str_hash64 (ip) % HOST_BUCKETS;
+
+  if (find_hostname (ip) != NULL)
+    return;
+
+  node = xmalloc (sizeof (GDnsHost));
+  node->ip = xstrdup (ip);
+  node->host = xstrdup (host);
+  node->next = __atomic_load_n (&gdns_hosts[bucket], __ATOMIC_RELAXED);
+
+  __atomic_store_n (&gdns_hosts[bucket], node, __ATOMIC_RELEASE);
+}
+
+/* Free all published hostnames. Lookups must be inactive and no reader
+ * may be running. */
+void
+gdns_free_hostnames (void)
+{
+  GDnsHost *node = NULL, *next = NULL;
+  int i;
+
+  for (i = 0; i < HOST_BUCKETS; i++) {
+    for (node = gdns_hosts[i]; node != NULL; node = next) {
+      next = node->next;
+      free (node->ip);
+      free (node->host);
+      free (node);
+    }
+    gdns_hosts[i] = NULL;
+  }
+}
+
+/* Consumer - Resolve the IP at the head of the queue and publish its
+ * hostname. Lookups block, thus they run on a thread of their own
+ * rather than on the worker pool, where a task waited for could be
+ * queued behind them. The mutex only guards the queue and the thread's
+ * lifetime, readers of the hostnames never take it. */
+static void *
+dns_worker (GO_UNUSED void *arg)
 {
-  char *ip = NULL, *host = NULL;
+  char ip[H_SIZE], *host = NULL;
 
   while (1) {
     pthread_mutex_lock (&gdns_thread.mutex);
     /* wait until an item has been added to the queue */
-    while (gqueue_empty (gdns_queue))
+    while (active_gdns && gqueue_empty (gdns_queue))
       pthread_cond_wait (&gdns_thread.not_empty, &gdns_thread.mutex);
+    if (!active_gdns)
+      break;
 
-    ip = gqueue_dequeue (gdns_queue);
-
+    /* the queue slot may be reused while resolving */
+    strcpy (ip, gqueue_dequeue (gdns_queue));
     pthread_mutex_unlock (&gdns_thread.mutex);
+
     host = reverse_ip (ip);
-    pthread_mutex_lock (&gdns_thread.mutex);
 
-    if (!active_gdns) {
-      if (host)
-        free (host);
-      break;
-    }
+    pthread_mutex_lock (&gdns_thread.mutex);
+    /* publish the corresponding IP -> hostname map, still under the
+     * queue mutex so that house keeping cannot free it meanwhile */
+    if (active_gdns && host != NULL)
+      publish_hostname (ip, host);
+    pthread_mutex_unlock (&gdns_thread.mutex);
+    free (host);
+  }
+  pthread_mutex_unlock (&gdns_thread.mutex);
 
-    /* insert the corresponding IP -> hostname map */
-    if (host != NULL && active_gdns) {
-      ht_insert_hostname (ip, host);
-      free (host);
-    }
+  return NULL;
+}
 
-    pthread_cond_signal (&gdns_thread.not_full);
-    pthread_mutex_unlock (&gdns_thread.mutex);
+/* Producer - Add an IP address to the queue to be resolved. */
+void
+dns_resolver (char *addr)
+{
+  pthread_mutex_lock (&gdns_thread.mutex);
+  /* queue is not full and the IP address is not in the queue */
+  if (!gqueue_full (gdns_queue) && !gqueue_find (gdns_queue, addr)) {
+    /* add the IP to the queue */
+    gqueue_enqueue (gdns_queue, addr);
+    pthread_cond_signal (&gdns_thread.not_empty);
   }
+  pthread_mutex_unlock (&gdns_thread.mutex);
 }
 
-/* Initialize queue and dns thread */
+/* Initialize the queue of the lookups */
 void
 gdns_init (void)
 {
@@ -259,9 +332,6 @@ gdns_init (void)
   if (pthread_cond_init (&(gdns_thread.not_empty), NULL))
     FATAL ("Failed init thread condition");
 
-  if (pthread_cond_init (&(gdns_thread.not_full), NULL))
-    FATAL ("Failed init thread condition");
-
   if (pthread_mutex_init (&(gdns_thread.mutex), NULL))
     FATAL ("Failed init thread mutex");
 }
@@ -273,15 +343,19 @@ gdns_free_queue (void)
   gqueue_destroy (gdns_queue);
 }
 
-/* Create a DNS thread and make it active */
+/* Make the lookups active and start the thread running them.
+ *
+ * On error, FATAL is triggered. */
 void
-gdns_thread_create (void)
+gdns_activate (void)
 {
   int thread;
 
+  pthread_mutex_lock (&gdns_thread.mutex);
   active_gdns = 1;
-  thread =
-    pthread_create (&(gdns_thread.thread), NULL, (void *) &dns_worker, NULL);
+  pthread_mutex_unlock (&gdns_thread.mutex);
+
+  thread = pthread_create (&(gdns_thread.thread), NULL, dns_worker, NULL);
   if (thread)
     FATAL ("Return code from pthread_create(): %d", thread);
   pthread_detach (gdns_thread.thread);
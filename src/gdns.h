@@ -23,11 +23,13 @@
 
 #define H_SIZE     1025
 #define QUEUE_SIZE 400
+/* Buckets of the published hostnames table */
+#define HOST_BUCKETS 4096
 
+/* The lookups run on a thread of their own */
 typedef struct GDnsThread_
 {
   pthread_cond_t not_empty;
-  pthread_cond_t not_full;
   pthread_mutex_t mutex;
   pthread_t thread;
 } GDnsThread;
@@ -41,9 +43,19 @@ typedef struct GDnsQueue_
   char buffer[QUEUE_SIZE][H_SIZE];
 } GDnsQueue;
 
+/* A resolved hostname. Once published a node is never modified, thus
+ * it can be read without locking. */
+typedef struct GDnsHost_
+{
+  char *ip;
+  char *host;
+  struct GDnsHost_ *next;
+} GDnsHost;
+
 extern GDnsThread gdns_thread;
 
 char *gqueue_dequeue (GDnsQueue * q);
+char *gdns_get_hostname (const char *ip);
 char *reverse_ip (char *str);
 int gqueue_empty (GDnsQueue * q);
 int gqueue_enqueue (GDnsQueue * q, char *item);
@@ -51,10 +63,11 @@ int gqueue_find (GDnsQueue * q, const char *item);
 int gqueue_full (GDnsQueue * q);
 int gqueue_size (GDnsQueue * q);
 void dns_resolver (char *addr);
+void gdns_activate (void);
+void gdns_free_hostnames (void);
 void gdns_free_queue (void);
 void gdns_init (void);
 void gdns_queue_free (void);
-void gdns_thread_create (void);
 void gqueue_destroy (GDnsQueue * q);
 void gqueue_init (GDnsQueue * q, int capacity);
 
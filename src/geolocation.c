@@ -28,12 +28,19 @@
 #include <GeoIPCity.h>
 #endif
 
+#include <string.h>
+
 #include "geolocation.h"
 
 #include "error.h"
 #include "util.h"
 
+#ifdef HAVE_LIBGEOIP
 GeoIP *geo_location_data;
+#endif
+#ifdef HAVE_GEOTABLE
+GGeoTable *geo_table;
+#endif
 
 /* Get continent name concatenated with code.
  *
@@ -60,6 +67,7 @@ get_continent_name_and_code (const char *continentid)
     return "-- Location Unknown";
 }
 
+#ifdef HAVE_LIBGEOIP
 /* Open the given GeoLocation database and set its charset.
  *
  * On error, it aborts.
@@ -78,6 +86,7 @@ geoip_open_db (const char *db)
 
   return geoip;
 }
+#endif
 
 /* Compose a string with the country name and code and store it in the
  * given buffer. */
@@ -90,6 +99,7 @@ geoip_set_country (const char *country, const char *code, char *loc)
     sprintf (loc, "%s", "Country Unknown");
 }
 
+#ifdef HAVE_LIBGEOIP
 /* Compose a string with the city name and state/region and store it
  * in the given buffer. */
 static void
@@ -98,6 +108,7 @@ geoip_set_city (const char *city, const char *region, char *loc)
   sprintf (loc, "%s, %s", city ? city : "N/A City",
            region ? region : "N/A Region");
 }
+#endif
 
 /* Compose a string with the continent name and store it in the given
  * buffer. */
@@ -110,6 +121,58 @@ geoip_set_continent (const char *continent, char *loc)
     sprintf (loc, "%s", "Continent Unknown");
 }
 
+/* Determine if a geolocation database has been loaded.
+ *
+ * If not loaded, 0 is returned.
+ * If loaded, 1 is returned. */
+int
+is_geoip_resource (void)
+{
+#ifdef HAVE_LIBGEOIP
+  return geo_location_data != NULL;
+#else
+  return geo_table != NULL;
+#endif
+}
+
+/* Free the loaded geolocation database, if any. */
+void
+geoip_free (void)
+{
+#ifdef HAVE_LIBGEOIP
+  if (geo_location_data != NULL)
+    GeoIP_delete (geo_location_data);
+#else
+  geotable_close (geo_table);
+#endif
+}
+
+#ifdef HAVE_GEOTABLE
+/* Set country data from the built-in IP range table into the given
+ * `location` buffer. */
+void
+geoip_get_country (const char *ip, char *location, GTypeIP type_ip)
+{
+  const GGeoTableLoc *loc = geotable_lookup (geo_table, ip, type_ip);
+
+  if (loc != NULL)
+    geoip_set_country (loc->country, loc->code, location);
+  else
+    geoip_set_country (NULL, NULL, location);
+}
+
+/* Set continent data from the built-in IP range table into the given
+ * `location` buffer. */
+void
+geoip_get_continent (const char *ip, char *location, GTypeIP type_ip)
+{
+  const GGeoTableLoc *loc = geotable_lookup (geo_table, ip, type_ip);
+
+  geoip_set_continent (loc != NULL ? loc->continent : NULL, location);
+}
+#endif
+
+#ifdef HAVE_LIBGEOIP
 /* Get detailed information found in the GeoIP Database about the
  * given IPv4 or IPv6.
  *
@@ -344,6 +407,8 @@ geoip_get_city (const char *ip, char *location, GTypeIP type_ip)
   }
 }
 
+#endif
+
 /* Entry point to set GeoIP location into the corresponding buffers,
  * (continent, country, city).
  *
@@ -354,7 +419,7 @@ set_geolocation (char *host, char *continent, char *country, char *city)
 {
   int type_ip = 0;
 
-  if (geo_location_data == NULL)
+  if (!is_geoip_resource ())
     return 1;
 
   if (invalid_ipaddr (host, &type_ip))
@@ -362,8 +427,12 @@ set_geolocation (char *host, char *continent, char *country, char *city)
 
   geoip_get_country (host, country, type_ip);
   geoip_get_continent (host, continent, type_ip);
+#ifdef HAVE_LIBGEOIP
   if (conf.geoip_database)
     geoip_get_city (host, city, type_ip);
+#else
+  (void) city;
+#endif
 
   return 0;
 }
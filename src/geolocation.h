@@ -29,6 +29,10 @@
 #include <GeoIP.h>
 #endif
 
+#ifdef HAVE_GEOTABLE
+#include "geotable.h"
+#endif
+
 #include "commons.h"
 
 #define CITY_LEN       28
@@ -42,12 +46,21 @@ typedef struct GLocation_
   int hits;
 } GLocation;
 
+#ifdef HAVE_LIBGEOIP
 extern GeoIP *geo_location_data;
 
 GeoIP *geoip_open_db (const char *db);
 void geoip_get_city (const char *ip, char *location, GTypeIP type_ip);
+#endif
+
+#ifdef HAVE_GEOTABLE
+extern GGeoTable *geo_table;
+#endif
+
+int is_geoip_resource (void);
+int set_geolocation (char *host, char *continent, char *country, char *city);
+void geoip_free (void);
 void geoip_get_continent (const char *ip, char *location, GTypeIP type_ip);
 void geoip_get_country (const char *ip, char *location, GTypeIP type_ip);
-int set_geolocation (char *host, char *continent, char *country, char *city);
 
 #endif
@@ -0,0 +1,477 @@
+/**
+ * geotable.c -- built-in IP range to country/continent table
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "geotable.h"
+
+#include "error.h"
+#include "util.h"
+#include "xmalloc.h"
+
+/* Offsets of each section within the table file */
+typedef struct GGeoTableLayout_
+{
+  size_t start4, end4, loc4;
+  size_t start6, end6, loc6;
+  size_t locs;
+  size_t size;
+} GGeoTableLayout;
+
+/* IP ranges as read from the CSV file, along with their line number */
+typedef struct GGeoRange4_
+{
+  uint32_t start;
+  uint32_t end;
+  uint32_t loc;
+  uint32_t line;
+} GGeoRange4;
+
+typedef struct GGeoRange6_
+{
+  GIPv6Key start;
+  GIPv6Key end;
+  uint32_t loc;
+  uint32_t line;
+} GGeoRange6;
+
+/* Round the given size up to a multiple of 8. */
+static size_t
+align8 (size_t n)
+{
+  return (n + 7) & ~(size_t) 7;
+}
+
+/* Compute the offset of each section given the table header. */
+static void
+geotable_layout (const GGeoTableHdr * hdr, GGeoTableLayout * l)
+{
+  l->start4 = align8 (sizeof (GGeoTableHdr));
+  l->end4 = l->start4 + (size_t) hdr->n4 * sizeof (uint32_t);
+  l->loc4 = l->end4 + (size_t) hdr->n4 * sizeof (uint32_t);
+  l->start6 = align8 (l->loc4 + (size_t) hdr->n4 * sizeof (uint32_t));
+  l->end6 = l->start6 + (size_t) hdr->n6 * sizeof (GIPv6Key);
+  l->loc6 = l->end6 + (size_t) hdr->n6 * sizeof (GIPv6Key);
+  l->locs = align8 (l->loc6 + (size_t) hdr->n6 * sizeof (uint32_t));
+  l->size = l->locs + (size_t) hdr->nlocs * sizeof (GGeoTableLoc);
+}
+
+/* Convert an IPv4 string into a host order integer.
+ *
+ * On error, 1 is returned.
+ * On success, the key is set and 0 is returned. */
+static int
+parse_ip4 (const char *str, uint32_t * ip)
+{
+  struct in_addr addr;
+
+  if (inet_pton (AF_INET, str, &addr) != 1)
+    return 1;
+  *ip = ntohl (addr.s_addr);
+
+  return 0;
+}
+
+/* Convert an IPv6 string into a binary key.
+ *
+ * On error, 1 is returned.
+ * On success, the key is set and 0 is returned. */
+static int
+parse_ip6 (const char *str, GIPv6Key * key)
+{
+  struct in6_addr addr;
+  int i;
+
+  if (inet_pton (AF_INET6, str, &addr) != 1)
+    return 1;
+
+  key->hi = key->lo = 0;
+  for (i = 0; i < 8; i++) {
+    key->hi = (key->hi << 8) | addr.s6_addr[i];
+    key->lo = (key->lo << 8) | addr.s6_addr[i + 8];
+  }
+
+  return 0;
+}
+
+/* Determine if IPv6 key a is less than or equal to key b, without
+ * branching. */
+static int
+ip6_le (const GIPv6Key * a, const GIPv6Key * b)
+{
+  return (a->hi < b->hi) | ((a->hi == b->hi) & (a->lo <= b->lo));
+}
+
+/* Branch-free binary search. Find the last range starting at or before
+ * the given IPv4. The loop count only depends on n.
+ *
+ * The index of the candidate range is returned. */
+static uint32_t
+search4 (const uint32_t * starts, uint32_t n, uint32_t ip)
+{
+  const uint32_t *base = starts;
+  uint32_t half;
+
+  while (n > 1) {
+    half = n / 2;
+    base = (base[half] <= ip) ? base + half : base;
+    n -= half;
+  }
+
+  return base - starts;
+}
+
+/* Branch-free binary search. Find the last range starting at or before
+ * the given IPv6.
+ *
+ * The index of the candidate range is returned. */
+static uint32_t
+search6 (const GIPv6Key * starts, uint32_t n, const GIPv6Key * ip)
+{
+  const GIPv6Key *base = starts;
+  uint32_t half;
+
+  while (n > 1) {
+    half = n / 2;
+    base = ip6_le (&base[half], ip) ? base + half : base;
+    n -= half;
+  }
+
+  return base - starts;
+}
+
+/* Get the location at the given index.
+ *
+ * On error, NULL is returned.
+ * On success, the location is returned. */
+static const GGeoTableLoc *
+loc_at (const GGeoTable * table, uint32_t idx)
+{
+  return idx < table->nlocs ? &table->locs[idx] : NULL;
+}
+
+/* Find the location of the given IPv4 or IPv6. No memory is allocated
+ * per lookup.
+ *
+ * If not found, NULL is returned.
+ * On success, the location is returned. */
+const GGeoTableLoc *
+geotable_lookup (const GGeoTable * table, const char *ip, GTypeIP type_ip)
+{
+  GIPv6Key ip6;
+  uint32_t idx, ip4;
+
+  if (table == NULL)
+    return NULL;
+
+  if (TYPE_IPV4 == type_ip) {
+    if (table->n4 == 0 || parse_ip4 (ip, &ip4))
+      return NULL;
+    idx = search4 (table->start4, table->n4, ip4);
+    if (table->start4[idx] > ip4 || table->end4[idx] < ip4)
+      return NULL;
+    return loc_at (table, table->loc4[idx]);
+  }
+
+  if (TYPE_IPV6 == type_ip) {
+    if (table->n6 == 0 || parse_ip6 (ip, &ip6))
+      return NULL;
+    idx = search6 (table->start6, table->n6, &ip6);
+    if (!ip6_le (&table->start6[idx], &ip6) ||
+        !ip6_le (&ip6, &table->end6[idx]))
+      return NULL;
+    return loc_at (table, table->loc6[idx]);
+  }
+
+  return NULL;
+}
+
+/* Map the given table file into memory.
+ *
+ * On error, it aborts.
+ * On success, a new table is returned. */
+GGeoTable *
+geotable_open (const char *path)
+{
+  GGeoTable *table = NULL;
+  GGeoTableHdr hdr;
+  GGeoTableLayout l;
+  struct stat st;
+  char *map = NULL;
+  int fd;
+
+  if ((fd = open (path, O_RDONLY)) == -1)
+    FATAL ("Unable to open geo table: %s. %s", path, strerror (errno));
+
+  if (fstat (fd, &st) == -1 || (size_t) st.st_size < sizeof (GGeoTableHdr))
+    FATAL ("Invalid geo table: %s", path);
+
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    FATAL ("Unable to map geo table: %s. %s", path, strerror (errno));
+
+  memcpy (&hdr, map, sizeof (hdr));
+  if (memcmp (hdr.magic, GEOTABLE_MAGIC, sizeof (hdr.magic)) != 0 ||
+      hdr.bom != GEOTABLE_BOM)
+    FATAL ("Invalid geo table or built on another architecture: %s", path);
+
+  geotable_layout (&hdr, &l);
+  if (l.size != (size_t) st.st_size)
+    FATAL ("Truncated geo table: %s", path);
+
+  table = xcalloc (1, sizeof (GGeoTable));
+  table->map = map;
+  table->size = l.size;
+
+  table->n4 = hdr.n4;
+  table->start4 = (const uint32_t *) (map + l.start4);
+  table->end4 = (const uint32_t *) (map + l.end4);
+  table->loc4 = (const uint32_t *) (map + l.loc4);
+
+  table->n6 = hdr.n6;
+  table->start6 = (const GIPv6Key *) (map + l.start6);
+  table->end6 = (const GIPv6Key *) (map + l.end6);
+  table->loc6 = (const uint32_t *) (map + l.loc6);
+
+  table->nlocs = hdr.nlocs;
+  table->locs = (const GGeoTableLoc *) (map + l.locs);
+
+  LOG_DEBUG (("Opened geo table: %s (%u IPv4, %u IPv6 ranges)\n", path,
+              hdr.n4, hdr.n6));
+
+  return table;
+}
+
+/* Unmap and free the given table. */
+void
+geotable_close (GGeoTable * table)
+{
+  if (table == NULL)
+    return;
+
+  munmap (table->map, table->size);
+  free (table);
+}
+
+/* Split a CSV line into at most n fields, in place. Fields may be
+ * enclosed in double quotes, e.g., "Korea, Republic of".
+ *
+ * The number of fields found is returned. */
+static int
+split_csv (char *line, char **fields, int n)
+{
+  char *p = line, *w = NULL;
+  int i = 0;
+
+  while (i < n && *p != '\0') {
+    if (*p != '"') {
+      fields[i++] = p;
+      p += strcspn (p, ",");
+      if (*p == ',')
+        *p++ = '\0';
+      continue;
+    }
+
+    /* quoted field, "" is an escaped quote */
+    fields[i++] = w = ++p;
+    while (*p != '\0' && (*p != '"' || p[1] == '"')) {
+      if (*p == '"')
+        p++;
+      *w++ = *p++;
+    }
+    if (*p == '"')
+      p++;
+    p += strcspn (p, ",");
+    if (*p == ',')
+      p++;
+    *w = '\0';
+  }
+
+  return i;
+}
+
+/* Find or append a location given its country code.
+ *
+ * The index of the location is returned. */
+static uint32_t
+add_location (GGeoTableLoc ** locs, uint32_t * nlocs, char **fields)
+{
+  GGeoTableLoc *loc;
+  uint32_t i;
+
+  for (i = 0; i < *nlocs; i++) {
+    if (strcmp ((*locs)[i].code, fields[2]) == 0)
+      return i;
+  }
+
+  *locs = xrealloc (*locs, (*nlocs + 1) * sizeof (GGeoTableLoc));
+  loc = &(*locs)[*nlocs];
+  memset (loc, 0, sizeof (GGeoTableLoc));
+  snprintf (loc->code, sizeof (loc->code), "%s", fields[2]);
+  snprintf (loc->country, sizeof (loc->country), "%s", fields[3]);
+  snprintf (loc->continent, sizeof (loc->continent), "%s", fields[4]);
+
+  return (*nlocs)++;
+}
+
+static int
+cmp_range4 (const void *a, const void *b)
+{
+  const GGeoRange4 *ia = a, *ib = b;
+  return (ia->start > ib->start) - (ia->start < ib->start);
+}
+
+static int
+cmp_range6 (const void *a, const void *b)
+{
+  const GGeoRange6 *ia = a, *ib = b;
+  if (ia->start.hi != ib->start.hi)
+    return ia->start.hi > ib->start.hi ? 1 : -1;
+  return (ia->start.lo > ib->start.lo) - (ia->start.lo < ib->start.lo);
+}
+
+/* Compile a CSV file of IP ranges into a sorted binary table that can
+ * be mapped by geotable_open(). Each line has the form:
+ *
+ *   start_ip,end_ip,country_code,country_name,continent_code
+ *
+ * Lines starting with # are ignored.
+ *
+ * On error, it aborts. */
+void
+geotable_compile (const char *csv, const char *path)
+{
+  FILE *fp = NULL;
+  GGeoRange4 *r4 = NULL;
+  GGeoRange6 *r6 = NULL;
+  GGeoTableLoc *locs = NULL;
+  GGeoTableHdr hdr;
+  GGeoTableLayout l;
+  char line[GEOTABLE_LINE], *fields[5], *buf = NULL;
+  uint32_t i, n4 = 0, n6 = 0, nlocs = 0, loc, ln = 0;
+  uint32_t *u32;
+  GIPv6Key *k6;
+
+  if ((fp = fopen (csv, "r")) == NULL)
+    FATAL ("Unable to open geo CSV: %s. %s", csv, strerror (errno));
+
+  while (fgets (line, sizeof (line), fp) != NULL) {
+    ln++;
+    line[strcspn (line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+
+    if (split_csv (line, fields, 5) != 5)
+      FATAL ("Invalid geo CSV line %u: expected 5 fields", ln);
+
+    loc = add_location (&locs, &nlocs, fields);
+    if (strchr (fields[0], ':') == NULL) {
+      r4 = xrealloc (r4, (n4 + 1) * sizeof (GGeoRange4));
+      if (parse_ip4 (fields[0], &r4[n4].start) ||
+          parse_ip4 (fields[1], &r4[n4].end))
+        FATAL ("Invalid geo CSV line %u: invalid IPv4 range", ln);
+      if (r4[n4].start > r4[n4].end)
+        FATAL ("Invalid geo CSV line %u: range starts after its end", ln);
+      r4[n4].line = ln;
+      r4[n4++].loc = loc;
+    } else {
+      r6 = xrealloc (r6, (n6 + 1) * sizeof (GGeoRange6));
+      if (parse_ip6 (fields[0], &r6[n6].start) ||
+          parse_ip6 (fields[1], &r6[n6].end))
+        FATAL ("Invalid geo CSV line %u: invalid IPv6 range", ln);
+      if (!ip6_le (&r6[n6].start, &r6[n6].end))
+        FATAL ("Invalid geo CSV line %u: range starts after its end", ln);
+      r6[n6].line = ln;
+      r6[n6++].loc = loc;
+    }
+  }
+  fclose (fp);
+
+  if (n4)
+    qsort (r4, n4, sizeof (GGeoRange4), cmp_range4);
+  if (n6)
+    qsort (r6, n6, sizeof (GGeoRange6), cmp_range6);
+
+  /* a lookup finds the last range starting at or before an IP, thus
+   * sorted ranges must not overlap */
+  for (i = 1; i < n4; i++) {
+    if (r4[i].start <= r4[i - 1].end)
+      FATAL ("Invalid geo CSV line %u: range overlaps line %u", r4[i].line,
+             r4[i - 1].line);
+  }
+  for (i = 1; i < n6; i++) {
+    if (ip6_le (&r6[i].start, &r6[i - 1].end))
+      FATAL ("Invalid geo CSV line %u: range overlaps line %u", r6[i].line,
+             r6[i - 1].line);
+  }
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, GEOTABLE_MAGIC, sizeof (hdr.magic));
+  hdr.bom = GEOTABLE_BOM;
+  hdr.n4 = n4;
+  hdr.n6 = n6;
+  hdr.nlocs = nlocs;
+  geotable_layout (&hdr, &l);
+
+  /* lay out the whole file in memory, padding is zeroed */
+  buf = xcalloc (1, l.size);
+  memcpy (buf, &hdr, sizeof (hdr));
+  for (i = 0; i < n4; i++) {
+    u32 = (uint32_t *) (buf + l.start4);
+    u32[i] = r4[i].start;
+    u32 = (uint32_t *) (buf + l.end4);
+    u32[i] = r4[i].end;
+    u32 = (uint32_t *) (buf + l.loc4);
+    u32[i] = r4[i].loc;
+  }
+  for (i = 0; i < n6; i++) {
+    k6 = (GIPv6Key *) (buf + l.start6);
+    k6[i] = r6[i].start;
+    k6 = (GIPv6Key *) (buf + l.end6);
+    k6[i] = r6[i].end;
+    u32 = (uint32_t *) (buf + l.loc6);
+    u32[i] = r6[i].loc;
+  }
+  if (nlocs)
+    memcpy (buf + l.locs, locs, nlocs * sizeof (GGeoTableLoc));
+
+  if ((fp = fopen (path, "wb")) == NULL)
+    FATAL ("Unable to write geo table: %s. %s", path, strerror (errno));
+  if (fwrite (buf, 1, l.size, fp) != l.size)
+    FATAL ("Unable to write geo table: %s. %s", path, strerror (errno));
+  fclose (fp);
+
+  free (buf);
+  free (locs);
+  free (r4);
+  free (r6);
+}
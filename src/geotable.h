@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifndef GEOTABLE_H_INCLUDED
+#define GEOTABLE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "commons.h"
+
+#define GEOTABLE_MAGIC   "GOGEOTB1"
+#define GEOTABLE_BOM     0x01020304
+#define GEOTABLE_CODE    3
+#define GEOTABLE_NAME    42
+#define GEOTABLE_LINE    1024
+
+/* A location, i.e., a country and its continent. */
+typedef struct GGeoTableLoc_
+{
+  char code[GEOTABLE_CODE];     /* two-letter country code */
+  char continent[GEOTABLE_CODE];        /* two-letter continent code */
+  char country[GEOTABLE_NAME];  /* country name */
+} GGeoTableLoc;
+
+/* Binary IPv6 key, most significant half first */
+typedef struct GIPv6Key_
+{
+  uint64_t hi;
+  uint64_t lo;
+} GIPv6Key;
+
+/* File header. It is followed by the sorted IPv4 range starts, ends and
+ * location indexes, the sorted IPv6 range starts, ends and location
+ * indexes, and the locations. Each section is 8-byte aligned. */
+typedef struct GGeoTableHdr_
+{
+  char magic[8];
+  uint32_t bom;
+  uint32_t n4;
+  uint32_t n6;
+  uint32_t nlocs;
+} GGeoTableHdr;
+
+/* A mapped IP range table */
+typedef struct GGeoTable_
+{
+  void *map;
+  size_t size;
+
+  uint32_t n4;
+  const uint32_t *start4;
+  const uint32_t *end4;
+  const uint32_t *loc4;
+
+  uint32_t n6;
+  const GIPv6Key *start6;
+  const GIPv6Key *end6;
+  const uint32_t *loc6;
+
+  uint32_t nlocs;
+  const GGeoTableLoc *locs;
+} GGeoTable;
+
+const GGeoTableLoc *geotable_lookup (const GGeoTable * table, const char *ip,
+                                     GTypeIP type_ip);
+GGeoTable *geotable_open (const char *path);
+void geotable_close (GGeoTable * table);
+void geotable_compile (const char *csv, const char *path);
+
+#endif
@@ -19,6 +19,11 @@
  * Visit http://goaccess.prosoftcorp.com for new releases.
  */
 
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,7 +35,7 @@
 #include "gkhash.h"
 #endif
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 #include "geolocation.h"
 #endif
 
@@ -38,15 +43,21 @@
 
 #include "error.h"
 #include "gdns.h"
+#include "khash.h"
 #include "util.h"
+#include "wpool.h"
 #include "xmalloc.h"
 
+/* host enrichment, by host, kept across holder rebuilds */
+KHASH_MAP_INIT_STR (shinfo, GHostInfo *);
+static khash_t (shinfo) * host_info = NULL;
+
 typedef struct GPanel_
 {
   GModule module;
   void (*insert) (GRawDataItem item, GHolder * h, const struct GPanel_ *);
   void (*holder_callback) (GHolder * h);
-  void (*lookup) (GRawDataItem item);
+  void (*lookup) (GRawDataItem * items, int len);
 } GPanel;
 
 static void add_data_to_holder (GRawDataItem item, GHolder * h,
@@ -57,6 +68,7 @@ static void add_root_to_holder (GRawDataItem item, GHolder * h,
                                 const GPanel * panel);
 static void add_host_child_to_holder (GHolder * h);
 static void data_visitors (GHolder * h);
+static void lookup_hosts (GRawDataItem * items, int len);
 
 /* *INDENT-OFF* */
 static GPanel paneling[] = {
@@ -64,7 +76,7 @@ static GPanel paneling[] = {
   {REQUESTS        , add_data_to_holder, NULL} ,
   {REQUESTS_STATIC , add_data_to_holder, NULL} ,
   {NOT_FOUND       , add_data_to_holder, NULL} ,
-  {HOSTS           , add_host_to_holder, add_host_child_to_holder} ,
+  {HOSTS           , add_host_to_holder, add_host_child_to_holder, lookup_hosts} ,
   {OS              , add_root_to_holder, NULL} ,
   {BROWSERS        , add_root_to_holder, NULL} ,
   {VISIT_TIMES     , add_data_to_holder, NULL} ,
@@ -72,10 +84,13 @@ static GPanel paneling[] = {
   {REFERRERS       , add_data_to_holder, NULL} ,
   {REFERRING_SITES , add_data_to_holder, NULL} ,
   {KEYPHRASES      , add_data_to_holder, NULL} ,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION    , add_root_to_holder, NULL} ,
 #endif
   {STATUS_CODES    , add_root_to_holder, NULL} ,
+  {CUSTOM_1        , add_data_to_holder, NULL} ,
+  {CUSTOM_2        , add_data_to_holder, NULL} ,
+  {CUSTOM_3        , add_data_to_holder, NULL} ,
 };
 /* *INDENT-ON* */
 
@@ -354,50 +369,290 @@ set_host_child_metrics (char *data, uint8_t id, GMetrics ** nmetrics)
   return 0;
 }
 
-/* Set host panel data, including sub items.
- *
- * On success, the host panel data is set. */
+/* Sort child items by the hits seen for sure in descending order, then
+ * by their hits. */
+static int
+cmp_child_desc (const void *a, const void *b)
+{
+  const GChildItem *ia = *(const GChildItem * const *) a;
+  const GChildItem *ib = *(const GChildItem * const *) b;
+  int sa = ia->hits - ia->error, sb = ib->hits - ib->error;
+
+  if (sa != sb)
+    return (sb > sa) - (sb < sa);
+  return (ib->hits > ia->hits) - (ib->hits < ia->hits);
+}
+
+/* Add the most frequent exact IPs aggregated under the given host
+ * prefix as child nodes. Their hits are those seen for sure, a lower
+ * bound for the IPs that replaced an evicted one. */
 static void
-set_host_sub_list (GHolder * h, GSubList * sub_list)
+set_host_prefix_sub_list (GHolder * h, GSubList * sub_list, const char *host)
 {
+  GChildItem **arr;
   GMetrics *nmetrics;
-#ifdef HAVE_LIBGEOIP
-  char city[CITY_LEN] = "";
-  char continent[CONTINENT_LEN] = "";
-  char country[COUNTRY_LEN] = "";
-#endif
+  GSLList *list, *node;
+  int i, n, key;
 
-  char *host = h->items[h->idx].metrics->data, *hostname = NULL;
-#ifdef HAVE_LIBGEOIP
-  /* add geolocation child nodes */
-  set_geolocation (host, continent, country, city);
+  if ((key = ht_get_keymap (h->module, host)) == -1)
+    return;
+  if (!(list = ht_get_child_list (h->module, key)))
+    return;
 
-  /* country */
-  if (country[0] != '\0') {
-    set_host_child_metrics (country, MTRC_ID_COUNTRY, &nmetrics);
+  n = list_count (list);
+  arr = xcalloc (n, sizeof (GChildItem *));
+  for (i = 0, node = list; node; node = node->next)
+    arr[i++] = node->data;
+  qsort (arr, n, sizeof (GChildItem *), cmp_child_desc);
+  /* more are tracked than displayed */
+  if (n > conf.host_children)
+    n = conf.host_children;
+
+  for (i = 0; i < n; i++) {
+    set_host_child_metrics (arr[i]->data, MTRC_ID_HOST, &nmetrics);
+    nmetrics->hits = arr[i]->hits - arr[i]->error;
     add_sub_item_back (sub_list, h->module, nmetrics);
     h->items[h->idx].sub_list = sub_list;
     h->sub_items_size++;
   }
+  free (arr);
+}
+
+/* Sort slow requests by time served in descending order. */
+static int
+cmp_slow_desc (const void *a, const void *b)
+{
+  const GSlowItem *ia = a;
+  const GSlowItem *ib = b;
+
+  return (ib->serve_time > ia->serve_time) - (ib->serve_time < ia->serve_time);
+}
+
+/* Add the slowest requests kept for a data key as child nodes, the
+ * slowest first. */
+static void
+set_slowest_sub_list (GHolder * h, int key)
+{
+  GSlowHeap *heap;
+  GSlowItem *arr;
+  GSubList *sub_list;
+  GMetrics *nmetrics;
+  char data[SLOW_WHEN_LEN + SLOW_HOST_LEN + SLOW_STATUS_LEN + 4];
+  int i;
+
+  if (!(heap = ht_get_slowest (h->module, key)) || heap->len == 0)
+    return;
 
-  /* city */
-  if (city[0] != '\0') {
-    set_host_child_metrics (city, MTRC_ID_CITY, &nmetrics);
+  arr = xmalloc (heap->len * sizeof (GSlowItem));
+  memcpy (arr, heap->items, heap->len * sizeof (GSlowItem));
+  qsort (arr, heap->len, sizeof (GSlowItem), cmp_slow_desc);
+
+  sub_list = new_gsublist ();
+  for (i = 0; i < heap->len; i++) {
+    snprintf (data, sizeof (data), "[%s] %s %s", arr[i].when, arr[i].host,
+              arr[i].status);
+
+    nmetrics = new_gmetrics ();
+    nmetrics->data = xstrdup (data);
+    nmetrics->hits = 1;
+    nmetrics->avgts.nts = arr[i].serve_time;
+    nmetrics->cumts.nts = arr[i].serve_time;
+    nmetrics->maxts.nts = arr[i].serve_time;
     add_sub_item_back (sub_list, h->module, nmetrics);
-    h->items[h->idx].sub_list = sub_list;
     h->sub_items_size++;
   }
+  h->items[h->idx].sub_list = sub_list;
+  free (arr);
+}
+
+/* Enrich a host with its location, it is resolved apart.
+ *
+ * On success, the newly allocated GHostInfo is returned. */
+static GHostInfo *
+new_host_info (char *host)
+{
+  GHostInfo *info = xcalloc (1, sizeof (GHostInfo));
+#ifdef HAVE_GEOLOCATION
+  char city[CITY_LEN] = "";
+  char continent[CONTINENT_LEN] = "";
+  char country[COUNTRY_LEN] = "";
+  char addr[INET6_ADDRSTRLEN] = "", *slash = NULL;
+
+  /* locate a prefix by its network */
+  xstrncpy (addr, host, sizeof (addr));
+  if ((slash = strchr (addr, '/')))
+    *slash = '\0';
+  set_geolocation (addr, continent, country, city);
+
+  if (country[0] != '\0')
+    info->country = xstrdup (country);
+  if (city[0] != '\0')
+    info->city = xstrdup (city);
+#else
+  (void) host;
 #endif
 
-  /* hostname */
-  if (conf.enable_html_resolver && conf.output_html) {
-    hostname = reverse_ip (host);
-    set_host_child_metrics (hostname, MTRC_ID_HOSTNAME, &nmetrics);
-    add_sub_item_back (sub_list, h->module, nmetrics);
-    h->items[h->idx].sub_list = sub_list;
-    h->sub_items_size++;
-    free (hostname);
+  return info;
+}
+
+/* Determine if a host is resolved on output. A network prefix has no
+ * hostname. */
+static int
+resolve_on_output (const char *host)
+{
+  return strchr (host, '/') == NULL && conf.enable_html_resolver &&
+    conf.output_html;
+}
+
+/* Get the enrichment of a host, located but not resolved, creating it
+ * the first time.
+ *
+ * On success, the host's GHostInfo is returned and `created` is set if
+ * it is new. */
+static GHostInfo *
+put_host_info (char *host, int *created)
+{
+  GHostInfo *info;
+  khiter_t k;
+  int ret;
+
+  if (host_info == NULL)
+    host_info = kh_init (shinfo);
+
+  *created = 0;
+  k = kh_get (shinfo, host_info, host);
+  if (k != kh_end (host_info))
+    return kh_val (host_info, k);
+
+  info = new_host_info (host);
+  k = kh_put (shinfo, host_info, xstrdup (host), &ret);
+  kh_val (host_info, k) = info;
+  *created = 1;
+
+  return info;
+}
+
+/* Get the enrichment of a host. A host is only located and resolved
+ * the first time, so rebuilding the holder does not do it again, the
+ * location data and hostnames do not change while running.
+ *
+ * On success, the host's GHostInfo is returned. */
+static GHostInfo *
+get_host_info (char *host)
+{
+  GHostInfo *info;
+  int created = 0;
+
+  info = put_host_info (host, &created);
+  if (created && resolve_on_output (host))
+    info->reverse = reverse_ip (host);
+
+  return info;
+}
+
+/* Resolve a host on output, as a task of the worker pool. It only
+ * writes its own GHostInfo. */
+static void
+resolve_host_task (void *arg)
+{
+  GHostLookup *lookup = arg;
+
+  lookup->info->reverse = reverse_ip (lookup->host);
+}
+
+/* Resolve the hosts about to be loaded on output all at once on the
+ * worker pool, rather than one lookup after another while loading. */
+static void
+lookup_hosts (GRawDataItem * items, int len)
+{
+  GWGroup grp = { 0 };
+  GHostLookup *lookups = NULL;
+  GHostInfo *info;
+  char *host = NULL;
+  int i, n = 0, created = 0;
+
+  if (!conf.enable_html_resolver || !conf.output_html)
+    return;
+
+  lookups = xcalloc (len, sizeof (GHostLookup));
+  for (i = 0; i < len; i++) {
+    if (!(host = ht_get_datamap (HOSTS, items[i].key)))
+      continue;
+    info = put_host_info (host, &created);
+    if (!created || !resolve_on_output (host)) {
+      free (host);
+      continue;
+    }
+    lookups[n].host = host;
+    lookups[n++].info = info;
   }
+
+  for (i = 0; i < n; i++)
+    wpool_submit (&grp, resolve_host_task, &lookups[i]);
+  wpool_wait (&grp);
+
+  for (i = 0; i < n; i++)
+    free (lookups[i].host);
+  free (lookups);
+}
+
+/* Free all cached host enrichments. */
+void
+free_host_info (void)
+{
+  GHostInfo *info;
+  khiter_t k;
+
+  if (host_info == NULL)
+    return;
+
+  for (k = kh_begin (host_info); k != kh_end (host_info); ++k) {
+    if (!kh_exist (host_info, k))
+      continue;
+    info = kh_val (host_info, k);
+    free (info->country);
+    free (info->city);
+    free (info->reverse);
+    free (info->hostname);
+    free (info);
+    free ((char *) kh_key (host_info, k));
+  }
+  kh_destroy (shinfo, host_info);
+  host_info = NULL;
+}
+
+/* Add a host's child node of the given type. */
+static void
+add_host_child (GHolder * h, GSubList * sub_list, char *data, uint8_t id)
+{
+  GMetrics *nmetrics;
+
+  set_host_child_metrics (data, id, &nmetrics);
+  add_sub_item_back (sub_list, h->module, nmetrics);
+  h->items[h->idx].sub_list = sub_list;
+  h->sub_items_size++;
+}
+
+/* Set host panel data, including sub items.
+ *
+ * On success, the host panel data is set. */
+static void
+set_host_sub_list (GHolder * h, GSubList * sub_list, GHostInfo * info)
+{
+  char *host = h->items[h->idx].metrics->data;
+
+  /* geolocation */
+  if (info->country)
+    add_host_child (h, sub_list, info->country, MTRC_ID_COUNTRY);
+  if (info->city)
+    add_host_child (h, sub_list, info->city, MTRC_ID_CITY);
+
+  /* exact IPs under a prefix */
+  if (strchr (host, '/') != NULL)
+    set_host_prefix_sub_list (h, sub_list, host);
+  /* hostname */
+  else if (info->reverse)
+    add_host_child (h, sub_list, info->reverse, MTRC_ID_HOSTNAME);
 }
 
 /* Set host panel data, including sub items.
@@ -406,31 +661,31 @@ set_host_sub_list (GHolder * h, GSubList * sub_list)
 static void
 add_host_child_to_holder (GHolder * h)
 {
-  GMetrics *nmetrics;
   GSubList *sub_list = new_gsublist ();
+  GHostInfo *info;
 
   char *ip = h->items[h->idx].metrics->data;
-  char *hostname = NULL;
   int n = h->sub_items_size;
 
   /* add child nodes */
-  set_host_sub_list (h, sub_list);
+  info = get_host_info (ip);
+  set_host_sub_list (h, sub_list, info);
 
-  pthread_mutex_lock (&gdns_thread.mutex);
-  hostname = ht_get_hostname (ip);
-  pthread_mutex_unlock (&gdns_thread.mutex);
+  /* a network prefix has no hostname */
+  if (strchr (ip, '/') != NULL)
+    goto out;
+
+  /* a hostname is only cached once resolved */
+  if (info->hostname == NULL)
+    info->hostname = gdns_get_hostname (ip);
 
   /* determine if we have the IP's hostname */
-  if (!hostname) {
+  if (!info->hostname)
     dns_resolver (ip);
-  } else if (hostname) {
-    set_host_child_metrics (hostname, MTRC_ID_HOSTNAME, &nmetrics);
-    add_sub_item_back (sub_list, h->module, nmetrics);
-    h->items[h->idx].sub_list = sub_list;
-    h->sub_items_size++;
-    free (hostname);
-  }
+  else
+    add_host_child (h, sub_list, info->hostname, MTRC_ID_HOSTNAME);
 
+out:
   /* did not add any items */
   if (n == h->sub_items_size)
     free (sub_list);
@@ -481,6 +736,8 @@ add_data_to_holder (GRawDataItem item, GHolder * h, const GPanel * panel)
 
   if (panel->holder_callback)
     panel->holder_callback (h);
+  if (IS_SLOWEST_MODULE (h->module) && conf.slowest_requests)
+    set_slowest_sub_list (h, item.key);
 
   h->idx++;
 }
@@ -562,6 +819,175 @@ add_root_to_holder (GRawDataItem item, GHolder * h,
   h->sub_items_size++;
 }
 
+/* Get the value of a raw data item for the given numeric sort field.
+ *
+ * If the field is not a numeric metric, its hits are returned. */
+static uint64_t
+get_raw_metric (GModule module, GRawDataItem item, GSortField field)
+{
+  switch (field) {
+  case SORT_BY_VISITORS:
+    return ht_get_visitors (module, item.key);
+  case SORT_BY_BW:
+    return ht_get_bw (module, item.key);
+  case SORT_BY_AVGTS:
+    return item.value > 0 ? ht_get_cumts (module, item.key) / item.value : 0;
+  case SORT_BY_CUMTS:
+    return ht_get_cumts (module, item.key);
+  case SORT_BY_MAXTS:
+    return ht_get_maxts (module, item.key);
+  default:
+    return item.value;
+  }
+}
+
+/* Partially order the given items so the k ones with the largest values
+ * come first, in no particular order. This is a quickselect with a
+ * three-way partition, thus linear on average, even with many equal
+ * values. */
+static void
+select_top_metric (GRawMetric * arr, int n, int k)
+{
+  GRawMetric tmp;
+  uint64_t pivot;
+  int lo = 0, hi = n - 1, lt, gt, i;
+
+  while (lo < hi) {
+    pivot = arr[lo + (hi - lo) / 2].value;
+    lt = i = lo;
+    gt = hi;
+    /* [lo, lt) > pivot, [lt, i) == pivot, (gt, hi] < pivot */
+    while (i <= gt) {
+      if (arr[i].value > pivot) {
+        tmp = arr[lt], arr[lt++] = arr[i], arr[i++] = tmp;
+      } else if (arr[i].value < pivot) {
+        tmp = arr[gt], arr[gt--] = arr[i], arr[i] = tmp;
+      } else {
+        i++;
+      }
+    }
+
+    if (k <= lt)
+      hi = lt - 1;
+    else if (k <= gt + 1)
+      return;
+    else
+      lo = gt + 1;
+  }
+}
+
+/* Move the MAX_CHOICES items with the largest value of the sort field
+ * to the front of the raw data, out of all the items. Raw data comes
+ * sorted by hits, so without this, sorting by another metric would
+ * only reorder the top items by hits. */
+static void
+select_top_raw_data (GRawData * raw_data, GModule module, GSortField field)
+{
+  GRawMetric *arr;
+  int i, size = raw_data->idx;
+
+  switch (field) {
+  case SORT_BY_VISITORS:
+  case SORT_BY_BW:
+  case SORT_BY_AVGTS:
+  case SORT_BY_CUMTS:
+  case SORT_BY_MAXTS:
+    break;
+  default:
+    return;
+  }
+  if (size <= MAX_CHOICES)
+    return;
+
+  arr = xmalloc (size * sizeof (GRawMetric));
+  for (i = 0; i < size; i++) {
+    arr[i].item = raw_data->items[i];
+    arr[i].value = get_raw_metric (module, arr[i].item, field);
+  }
+  select_top_metric (arr, size, MAX_CHOICES);
+  for (i = 0; i < size; i++)
+    raw_data->items[i] = arr[i].item;
+  free (arr);
+}
+
+#ifdef TCB_BTREE
+/* Get the sort field the top items are cached for. Fields not selected
+ * by their own metric use the top items by hits. */
+static GSortField
+top_items_field (GSortField field)
+{
+  switch (field) {
+  case SORT_BY_VISITORS:
+  case SORT_BY_BW:
+  case SORT_BY_AVGTS:
+  case SORT_BY_CUMTS:
+  case SORT_BY_MAXTS:
+    return field;
+  default:
+    return SORT_BY_HITS;
+  }
+}
+
+/* Get the top items of a module for the given sort field, as cached by
+ * a previous run, to load a holder without going over all the data.
+ *
+ * If not cached, or new data was stored since, NULL is returned.
+ * On success, the raw data holding the top items is returned. */
+GRawData *
+load_top_items (GModule module, GSortField field)
+{
+  return ht_get_top_items (module, top_items_field (field),
+                           ht_get_genstats ("total_requests"));
+}
+
+/* Cache the top items of each module and sort field along the data, for
+ * a later --load-from-disk run. Modules cached and not changed since
+ * are left as they are. */
+void
+save_top_items (void)
+{
+  GSortField fields[] = {
+    SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_BW, SORT_BY_AVGTS,
+    SORT_BY_CUMTS, SORT_BY_MAXTS,
+  };
+  GRawData *raw_data;
+  GRawDataItem *by_hits;
+  GModule module;
+  uint32_t gen = ht_get_genstats ("total_requests");
+  size_t idx = 0, i, sz;
+  int len;
+
+  FOREACH_MODULE (idx, module_list) {
+    module = module_list[idx];
+    if ((raw_data = ht_get_top_items (module, SORT_BY_HITS, gen)) != NULL) {
+      free_raw_data (raw_data);
+      continue;
+    }
+    if ((raw_data = parse_raw_data (module)) == NULL)
+      continue;
+
+    /* each metric selects from the items sorted by hits, as a holder
+     * built from the data does, so ties are broken the same way */
+    sz = raw_data->idx * sizeof (GRawDataItem);
+    by_hits = xmalloc (sz > 0 ? sz : 1);
+    memcpy (by_hits, raw_data->items, sz);
+    for (i = 0; i < ARRAY_SIZE (fields); i++) {
+      if (fields[i] == SORT_BY_BW && !conf.bandwidth)
+        continue;
+      if (fields[i] >= SORT_BY_AVGTS && !conf.serve_usecs)
+        continue;
+      memcpy (raw_data->items, by_hits, sz);
+      select_top_raw_data (raw_data, module, fields[i]);
+      len = raw_data->idx > MAX_CHOICES ? MAX_CHOICES : raw_data->idx;
+      ht_insert_top_items (module, fields[i], raw_data->items, len,
+                           raw_data->size, gen);
+    }
+    free (by_hits);
+    free_raw_data (raw_data);
+  }
+}
+#endif
+
 /* Load raw data into our holder structure */
 void
 load_holder_data (GRawData * raw_data, GHolder * h, GModule module, GSort sort)
@@ -569,19 +995,24 @@ load_holder_data (GRawData * raw_data, GHolder * h, GModule module, GSort sort)
   int i, size = 0;
   const GPanel *panel = panel_lookup (module);
 
-  size = raw_data->size;
+  /* the raw data may hold the top items only, e.g., cached ones */
+  size = raw_data->idx;
+  select_top_raw_data (raw_data, module, sort.field);
   h->holder_size = size > MAX_CHOICES ? MAX_CHOICES : size;
-  h->ht_size = size;
+  h->ht_size = raw_data->size;
   h->idx = 0;
   h->module = module;
   h->sub_items_size = 0;
   h->items = new_gholder_item (h->holder_size);
 
+  if (panel->lookup)
+    panel->lookup (raw_data->items, h->holder_size);
   for (i = 0; i < h->holder_size; i++) {
     panel->insert (raw_data->items[i], h, panel);
   }
   sort_holder_items (h->items, h->idx, sort);
-  if (h->sub_items_size)
+  /* the slowest requests are kept slowest first */
+  if (h->sub_items_size && !IS_SLOWEST_MODULE (module))
     sort_sub_list (h, sort);
   free_raw_data (raw_data);
 }
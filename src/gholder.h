@@ -23,17 +23,47 @@
 #define MTRC_ID_COUNTRY  0
 #define MTRC_ID_CITY     1
 #define MTRC_ID_HOSTNAME 2
+#define MTRC_ID_HOST     3
 
 #include "commons.h"
 #include "sort.h"
 
+/* A host's enrichment, i.e., its location and hostnames */
+typedef struct GHostInfo_
+{
+  char *country;
+  char *city;
+  char *reverse;                /* resolved on output */
+  char *hostname;               /* resolved by the DNS lookups */
+} GHostInfo;
+
+/* A host resolved on output, by the worker pool */
+typedef struct GHostLookup_
+{
+  char *host;
+  GHostInfo *info;
+} GHostLookup;
+
+/* A raw data item along with the value of the metric it's selected by */
+typedef struct GRawMetric_
+{
+  uint64_t value;
+  GRawDataItem item;
+} GRawMetric;
+
 /* Function Prototypes */
 GHolder *new_gholder (uint32_t size);
 void *add_hostname_node (void *ptr_holder);
 void free_holder_by_module (GHolder ** holder, GModule module);
 void free_holder (GHolder ** holder);
+void free_host_info (void);
 void load_holder_data (GRawData * raw_data, GHolder * h, GModule module,
                        GSort sort);
 void load_host_to_holder (GHolder * h, char *ip);
 
+#ifdef TCB_BTREE
+GRawData *load_top_items (GModule module, GSortField field);
+void save_top_items (void);
+#endif
+
 #endif // for #ifndef GHOLDER_H
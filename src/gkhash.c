@@ -35,15 +35,27 @@
 #include "util.h"
 #include "xmalloc.h"
 
-/* Hash tables storage */
+/* Hash tables storage (active partition) */
 static GKHashStorage *gkh_storage;
+/* Storage used when no partitioning takes place */
+static GKHashStorage *gkh_default_storage;
+
+/* Storage partitions, e.g., one per virtual host */
+static GKHashPartition *gkh_partitions = NULL;
+static int gkh_partitions_len = 0;
+
+/* Longest probe sequence seen so far before warning again */
+static khint_t max_probe_len = PROBE_WARN_LEN;
+
+/* Per module bitmask of the metric tables that are not allocated */
+static uint32_t gkh_ignored_metrics[TOTAL_MODULES];
 
 /* *INDENT-OFF* */
 /* Hash tables used across the whole app */
 static khash_t (is32) *ht_agent_vals  = NULL;
-static khash_t (si32) *ht_agent_keys  = NULL;
-static khash_t (si32) *ht_unique_keys = NULL;
-static khash_t (ss32) *ht_hostnames   = NULL;
+static khash_t (hi32) *ht_agent_keys  = NULL;
+static khash_t (hi32) *ht_unique_keys = NULL;
+static khash_t (hi32) *ht_partitions  = NULL;
 /* *INDENT-ON* */
 
 /* Instantiate a new store */
@@ -81,15 +93,6 @@ new_iu64_ht (void)
   return h;
 }
 
-/* Initialize a new string key - int value hash table */
-static
-khash_t (si32) *
-new_si32_ht (void)
-{
-  khash_t (si32) * h = kh_init (si32);
-  return h;
-}
-
 /* Initialize a new string key - string value hash table */
 static
 khash_t (ss32) *
@@ -108,6 +111,33 @@ new_igsl_ht (void)
   return h;
 }
 
+/* Initialize a new int key - GSlowHeap value hash table */
+static
+khash_t (islw) *
+new_islw_ht (void)
+{
+  khash_t (islw) * h = kh_init (islw);
+  return h;
+}
+
+/* Initialize a new int key - GBitmap value hash table */
+static
+khash_t (ibmp) *
+new_ibmp_ht (void)
+{
+  khash_t (ibmp) * h = kh_init (ibmp);
+  return h;
+}
+
+/* Initialize a new hashed string key - int value hash table */
+static
+khash_t (hi32) *
+new_hi32_ht (void)
+{
+  khash_t (hi32) * h = kh_init (hi32);
+  return h;
+}
+
 /* Destroys both the hash structure and the keys for a
  * string key - int value hash */
 static void
@@ -126,6 +156,24 @@ des_si32_free (khash_t (si32) * hash)
   kh_destroy (si32, hash);
 }
 
+/* Destroys both the hash structure and the keys for a
+ * hashed string key - int value hash */
+static void
+des_hi32_free (khash_t (hi32) * hash)
+{
+  khint_t k;
+  if (!hash)
+    return;
+
+  for (k = 0; k < kh_end (hash); ++k) {
+    if (kh_exist (hash, k)) {
+      free ((char *) kh_key (hash, k).str);
+    }
+  }
+
+  kh_destroy (hi32, hash);
+}
+
 /* Destroys both the hash structure and its string values */
 static void
 des_is32_free (khash_t (is32) * hash)
@@ -190,6 +238,38 @@ des_igsl_free (khash_t (igsl) * hash)
   kh_destroy (igsl, hash);
 }
 
+/* Destroys both the hash structure and its GSlowHeap values */
+static void
+des_islw_free (khash_t (islw) * hash)
+{
+  khint_t k;
+  if (!hash)
+    return;
+
+  for (k = 0; k < kh_end (hash); ++k) {
+    if (kh_exist (hash, k))
+      free (kh_value (hash, k));
+  }
+
+  kh_destroy (islw, hash);
+}
+
+/* Destroys both the hash structure and its GBitmap values */
+static void
+des_ibmp_free (khash_t (ibmp) * hash)
+{
+  khint_t k;
+  if (!hash)
+    return;
+
+  for (k = 0; k < kh_end (hash); ++k) {
+    if (kh_exist (hash, k))
+      bitmap_free (&kh_value (hash, k));
+  }
+
+  kh_destroy (ibmp, hash);
+}
+
 /* Destroys the hash structure */
 static void
 des_iu64 (khash_t (iu64) * hash)
@@ -199,64 +279,156 @@ des_iu64 (khash_t (iu64) * hash)
   kh_destroy (iu64, hash);
 }
 
-/* Initialize map & metric hashes */
+/* Determine if the given metric table is not needed by a module.
+ *
+ * If ignored, 1 is returned, else 0 is returned. */
+static int
+is_metric_ignored (GModule module, GSMetric metric)
+{
+  return (gkh_ignored_metrics[module] & (1U << metric)) != 0;
+}
+
+/* Determine if the table of the given metric is allocated for the
+ * given module. Only hosts keep child items, i.e., the exact IPs under
+ * their prefixes, and only if asked to. */
+static int
+is_metric_used (GModule module, GSMetric metric)
+{
+  if (metric == MTRC_CHILDREN)
+    return module == HOSTS && conf.host_children > 0;
+  return !is_metric_ignored (module, metric);
+}
+
+/* Allocate the hash table of the given metric based on its type */
+static void
+new_metric_ht (GKHashMetric * mtrc)
+{
+  switch (mtrc->type) {
+  case MTRC_TYPE_II32:
+    mtrc->ii32 = new_ii32_ht ();
+    break;
+  case MTRC_TYPE_IS32:
+    mtrc->is32 = new_is32_ht ();
+    break;
+  case MTRC_TYPE_IU64:
+    mtrc->iu64 = new_iu64_ht ();
+    break;
+  case MTRC_TYPE_SS32:
+    mtrc->ss32 = new_ss32_ht ();
+    break;
+  case MTRC_TYPE_IGSL:
+    mtrc->igsl = new_igsl_ht ();
+    break;
+  case MTRC_TYPE_HI32:
+    mtrc->hi32 = new_hi32_ht ();
+    break;
+  case MTRC_TYPE_ISLW:
+    mtrc->islw = new_islw_ht ();
+    break;
+  case MTRC_TYPE_IBMP:
+    mtrc->ibmp = new_ibmp_ht ();
+    break;
+  default:
+    break;
+  }
+}
+
+/* Initialize map & metric hashes. Metric tables ignored by the module
+ * are left NULL. */
 static void
-init_tables (GModule module)
+init_tables (GKHashStorage * storage, GModule module)
 {
   int n = 0, i;
   GKHashMetric metrics[] = {
-    {MTRC_KEYMAP, MTRC_TYPE_SI32, {.si32 = new_si32_ht ()}},
-    {MTRC_ROOTMAP, MTRC_TYPE_IS32, {.is32 = new_is32_ht ()}},
-    {MTRC_DATAMAP, MTRC_TYPE_IS32, {.is32 = new_is32_ht ()}},
-    {MTRC_UNIQMAP, MTRC_TYPE_SI32, {.si32 = new_si32_ht ()}},
-    {MTRC_ROOT, MTRC_TYPE_II32, {.ii32 = new_ii32_ht ()}},
-    {MTRC_HITS, MTRC_TYPE_II32, {.ii32 = new_ii32_ht ()}},
-    {MTRC_VISITORS, MTRC_TYPE_II32, {.ii32 = new_ii32_ht ()}},
-    {MTRC_BW, MTRC_TYPE_IU64, {.iu64 = new_iu64_ht ()}},
-    {MTRC_CUMTS, MTRC_TYPE_IU64, {.iu64 = new_iu64_ht ()}},
-    {MTRC_MAXTS, MTRC_TYPE_IU64, {.iu64 = new_iu64_ht ()}},
-    {MTRC_METHODS, MTRC_TYPE_IS32, {.is32 = new_is32_ht ()}},
-    {MTRC_PROTOCOLS, MTRC_TYPE_IS32, {.is32 = new_is32_ht ()}},
-    {MTRC_AGENTS, MTRC_TYPE_IGSL, {.igsl = new_igsl_ht ()}},
+    {MTRC_KEYMAP, MTRC_TYPE_HI32, {NULL}},
+    {MTRC_ROOTMAP, MTRC_TYPE_IS32, {NULL}},
+    {MTRC_DATAMAP, MTRC_TYPE_IS32, {NULL}},
+    {MTRC_UNIQMAP, MTRC_TYPE_IBMP, {NULL}},
+    {MTRC_ROOT, MTRC_TYPE_II32, {NULL}},
+    {MTRC_HITS, MTRC_TYPE_II32, {NULL}},
+    {MTRC_VISITORS, MTRC_TYPE_II32, {NULL}},
+    {MTRC_BW, MTRC_TYPE_IU64, {NULL}},
+    {MTRC_CUMTS, MTRC_TYPE_IU64, {NULL}},
+    {MTRC_MAXTS, MTRC_TYPE_IU64, {NULL}},
+    {MTRC_METHODS, MTRC_TYPE_IS32, {NULL}},
+    {MTRC_PROTOCOLS, MTRC_TYPE_IS32, {NULL}},
+    {MTRC_AGENTS, MTRC_TYPE_IGSL, {NULL}},
+    {MTRC_CHILDREN, MTRC_TYPE_IGSL, {NULL}},
+    {MTRC_SLOWEST, MTRC_TYPE_ISLW, {NULL}},
   };
 
   n = ARRAY_SIZE (metrics);
   for (i = 0; i < n; i++) {
-    gkh_storage[module].metrics[i] = metrics[i];
+    if (is_metric_used (module, metrics[i].metric))
+      new_metric_ht (&metrics[i]);
+    storage[module].metrics[i] = metrics[i];
   }
 }
 
-/* Initialize hash tables */
+/* Do not allocate the given metric table for the given module. It
+ * must be called before init_storage(). Only the unique visitors,
+ * bandwidth, time served, method and protocol tables can be ignored,
+ * their getters then return 0 or NULL. */
 void
-init_storage (void)
+ht_ignore_metric (GModule module, GSMetric metric)
+{
+  switch (metric) {
+  case MTRC_UNIQMAP:
+  case MTRC_VISITORS:
+  case MTRC_BW:
+  case MTRC_CUMTS:
+  case MTRC_MAXTS:
+  case MTRC_METHODS:
+  case MTRC_PROTOCOLS:
+    gkh_ignored_metrics[module] |= 1U << metric;
+    break;
+  default:
+    break;
+  }
+}
+
+/* Instantiate a full set of per module hash tables */
+static GKHashStorage *
+new_module_storage (void)
 {
+  GKHashStorage *storage;
   GModule module;
   size_t idx = 0;
 
-  /* Hashes used across the whole app (not per module) */
-  ht_agent_keys = (khash_t (si32) *) new_si32_ht ();
-  ht_agent_vals = (khash_t (is32) *) new_is32_ht ();
-  ht_hostnames = (khash_t (ss32) *) new_ss32_ht ();
-  ht_unique_keys = (khash_t (si32) *) new_si32_ht ();
-
-  gkh_storage = new_gkhstorage (TOTAL_MODULES);
+  storage = new_gkhstorage (TOTAL_MODULES);
   FOREACH_MODULE (idx, module_list) {
     module = module_list[idx];
 
-    gkh_storage[module].module = module;
-    init_tables (module);
+    storage[module].module = module;
+    init_tables (storage, module);
   }
+
+  return storage;
+}
+
+/* Initialize hash tables */
+void
+init_storage (void)
+{
+  /* Hashes used across the whole app (not per module) */
+  ht_agent_keys = (khash_t (hi32) *) new_hi32_ht ();
+  ht_agent_vals = (khash_t (is32) *) new_is32_ht ();
+  ht_unique_keys = (khash_t (hi32) *) new_hi32_ht ();
+  ht_partitions = (khash_t (hi32) *) new_hi32_ht ();
+
+  gkh_default_storage = new_module_storage ();
+  gkh_storage = gkh_default_storage;
 }
 
 /* Destroys the hash structure allocated metrics */
 static void
-free_metrics (GModule module)
+free_metrics (GKHashStorage * storage, GModule module)
 {
   int i;
   GKHashMetric mtrc;
 
   for (i = 0; i < GSMTRC_TOTAL; i++) {
-    mtrc = gkh_storage[module].metrics[i];
+    mtrc = storage[module].metrics[i];
     /* Determine the hash structure type */
     switch (mtrc.type) {
     case MTRC_TYPE_II32:
@@ -277,24 +449,53 @@ free_metrics (GModule module)
     case MTRC_TYPE_IGSL:
       des_igsl_free (mtrc.igsl);
       break;
+    case MTRC_TYPE_HI32:
+      des_hi32_free (mtrc.hi32);
+      break;
+    case MTRC_TYPE_ISLW:
+      des_islw_free (mtrc.islw);
+      break;
+    case MTRC_TYPE_IBMP:
+      des_ibmp_free (mtrc.ibmp);
+      break;
     }
   }
 }
 
+/* Destroys a full set of per module hash tables */
+static void
+free_module_storage (GKHashStorage * storage)
+{
+  size_t idx = 0;
+
+  if (storage == NULL)
+    return;
+
+  FOREACH_MODULE (idx, module_list) {
+    free_metrics (storage, module_list[idx]);
+  }
+  free (storage);
+}
+
 /* Destroys the hash structure and its content */
 void
 free_storage (void)
 {
-  size_t idx = 0;
+  int i;
 
   des_is32_free (ht_agent_vals);
-  des_si32_free (ht_agent_keys);
-  des_si32_free (ht_unique_keys);
-  des_ss32_free (ht_hostnames);
-
-  FOREACH_MODULE (idx, module_list) {
-    free_metrics (module_list[idx]);
+  des_hi32_free (ht_agent_keys);
+  des_hi32_free (ht_unique_keys);
+  des_hi32_free (ht_partitions);
+
+  for (i = 0; i < gkh_partitions_len; i++) {
+    free_module_storage (gkh_partitions[i].storage);
+    free (gkh_partitions[i].logger);
+    free (gkh_partitions[i].key);
   }
+  free (gkh_partitions);
+
+  free_module_storage (gkh_default_storage);
 }
 
 /* Given a module and a metric, get the hash table
@@ -336,40 +537,21 @@ get_hash (GModule module, GSMetric metric)
     case MTRC_TYPE_IGSL:
       hash = mtrc.igsl;
       break;
+    case MTRC_TYPE_HI32:
+      hash = mtrc.hi32;
+      break;
+    case MTRC_TYPE_ISLW:
+      hash = mtrc.islw;
+      break;
+    case MTRC_TYPE_IBMP:
+      hash = mtrc.ibmp;
+      break;
     }
   }
 
   return hash;
 }
 
-/* Insert a string key and the corresponding int value.
- * Note: If the key exists, the value is not replaced.
- *
- * On error, or if key exists, -1 is returned.
- * On success 0 is returned */
-static int
-ins_si32 (khash_t (si32) * hash, const char *key, int value)
-{
-  khint_t k;
-  int ret;
-  char *dupkey = NULL;
-
-  if (!hash)
-    return -1;
-
-  dupkey = xstrdup (key);
-  k = kh_put (si32, hash, dupkey, &ret);
-  /* operation failed, or key exists */
-  if (ret == -1 || ret == 0) {
-    free (dupkey);
-    return -1;
-  }
-
-  kh_val (hash, k) = value;
-
-  return 0;
-}
-
 /* Insert an int key and the corresponding string value.
  * Note: If the key exists, the value is not replaced.
  *
@@ -393,34 +575,6 @@ ins_is32 (khash_t (is32) * hash, int key, const char *value)
   return 0;
 }
 
-/* Insert a string key and the corresponding string value.
- * Note: If the key exists, the value is not replaced.
- *
- * On error, or if key exists, -1 is returned.
- * On success 0 is returned */
-static int
-ins_ss32 (khash_t (ss32) * hash, const char *key, const char *value)
-{
-  khint_t k;
-  int ret;
-  char *dupkey = NULL;
-
-  if (!hash)
-    return -1;
-
-  dupkey = xstrdup (key);
-  k = kh_put (ss32, hash, dupkey, &ret);
-  /* operation failed, or key exists */
-  if (ret == -1 || ret == 0) {
-    free (dupkey);
-    return -1;
-  }
-
-  kh_val (hash, k) = xstrdup (value);
-
-  return 0;
-}
-
 /* Insert an int key and an int value
  * Note: If the key exists, its value is replaced by the given value.
  *
@@ -524,26 +678,84 @@ inc_iu64 (khash_t (iu64) * hash, int key, uint64_t inc)
   return 0;
 }
 
-/* Insert a string key and auto increment int value.
+/* Walk the probe sequence of the given key and count the number of
+ * steps taken to reach it.
+ *
+ * On success the length of the probe sequence is returned. */
+static khint_t
+probe_len_hi32 (const khash_t (hi32) * hash, GHashKey hkey)
+{
+  khint_t i, last, mask, step = 0;
+
+  if (!hash->n_buckets)
+    return 0;
+
+  mask = hash->n_buckets - 1;
+  i = kh_hkey_hash_func (hkey) & mask;
+  last = i;
+  while (!__ac_isempty (hash->flags, i) &&
+         (__ac_isdel (hash->flags, i) ||
+          !kh_hkey_hash_equal (hash->keys[i], hkey))) {
+    i = (i + (++step)) & mask;
+    if (i == last)
+      break;
+  }
+
+  return step;
+}
+
+/* Sample the probe length of newly inserted keys and warn if chains
+ * degrade, e.g., a flood of crafted keys colliding on the same bucket. */
+static void
+monitor_probe_len (const khash_t (hi32) * hash, GHashKey hkey)
+{
+  khint_t len = 0;
+
+  if (kh_size (hash) % PROBE_SAMPLE != 0)
+    return;
+
+  if ((len = probe_len_hi32 (hash, hkey)) <= max_probe_len)
+    return;
+
+  LOG_DEBUG (("Hash chain degraded: probe length %u, %u keys, %u buckets\n",
+              len, kh_size (hash), kh_n_buckets (hash)));
+  max_probe_len = len * 2;
+}
+
+/* Insert a hashed string key and auto increment int value.
+ * Note: The key is probed only once using its precomputed hash. If the
+ * key exists, its current value is returned.
  *
  * On error, -1 is returned.
- * On success the value of the key inserted is returned */
+ * On success the value of the key is returned. If the key did not
+ * exist, the new flag is set. */
 static int
-ins_si32_ai (khash_t (si32) * hash, const char *key)
+ins_hi32_ai (khash_t (hi32) * hash, const char *key, uint64_t h, int *new)
 {
-  int size = 0, value = 0;
+  GHashKey hkey = {.str = key,.hash = h };
+  khint_t k;
+  int ret;
 
+  *new = 0;
   if (!hash)
     return -1;
 
-  size = kh_size (hash);
+  k = kh_put (hi32, hash, hkey, &ret);
+  /* operation failed */
+  if (ret == -1)
+    return -1;
+  /* key exists */
+  if (ret == 0)
+    return kh_val (hash, k);
+
   /* the auto increment value starts at SIZE (hash table) + 1 */
-  value = size > 0 ? size + 1 : 1;
+  kh_key (hash, k).str = xstrdup (key);
+  kh_val (hash, k) = kh_size (hash);
+  *new = 1;
 
-  if (ins_si32 (hash, key, value) == -1)
-    return -1;
+  monitor_probe_len (hash, hkey);
 
-  return value;
+  return kh_val (hash, k);
 }
 
 /* Compare if the given needle is in the haystack
@@ -589,53 +801,99 @@ ins_igsl (khash_t (igsl) * hash, int key, int value)
   return 0;
 }
 
-/* Get the int value of a given string key.
+/* Allocate a child item for the given string value. */
+static GChildItem *
+new_child_item (const char *value, int hits, int error)
+{
+  GChildItem *child = xmalloc (sizeof (GChildItem) + strlen (value) + 1);
+
+  child->hits = hits;
+  child->error = error;
+  strcpy (child->data, value);
+
+  return child;
+}
+
+/* Count a string value within the bounded GSLList of an int key. Once
+ * the list holds `max` items, the least frequent one is replaced and
+ * its count inherited as the new item's error (Space-Saving), so the
+ * most frequent values are kept and hits - error are exact or a lower
+ * bound.
  *
  * On error, -1 is returned.
- * On success the int value for the given key is returned */
+ * On success 0 is returned */
 static int
-get_si32 (khash_t (si32) * hash, const char *key)
+ins_igsl_child (khash_t (igsl) * hash, int key, const char *value, int max)
 {
   khint_t k;
+  GSLList *list = NULL, *node, *min = NULL;
+  GChildItem *child;
+  int ret, len = 0;
 
   if (!hash)
     return -1;
 
-  k = kh_get (si32, hash, key);
-  /* key found, return current value */
+  k = kh_get (igsl, hash, key);
   if (k != kh_end (hash))
-    return kh_val (hash, k);
+    list = kh_val (hash, k);
 
-  return -1;
+  for (node = list; node; node = node->next, len++) {
+    child = node->data;
+    if (strcmp (child->data, value) == 0) {
+      child->hits++;
+      return 0;
+    }
+    if (min == NULL || child->hits < ((GChildItem *) min->data)->hits)
+      min = node;
+  }
+
+  /* evict the least frequent item */
+  if (len >= max && min != NULL) {
+    child = min->data;
+    min->data = new_child_item (value, child->hits + 1, child->hits);
+    free (child);
+    return 0;
+  }
+
+  child = new_child_item (value, 1, 0);
+  list = list ? list_insert_prepend (list, child) : list_create (child);
+
+  k = kh_put (igsl, hash, key, &ret);
+  if (ret == -1)
+    return -1;
+
+  kh_val (hash, k) = list;
+
+  return 0;
 }
 
-/* Get the string value of a given int key.
+/* Get the int value of a given hashed string key.
  *
- * On error, NULL is returned.
- * On success the string value for the given key is returned */
-static char *
-get_is32 (khash_t (is32) * hash, int key)
+ * On error, -1 is returned.
+ * On success the int value for the given key is returned */
+static int
+get_hi32 (khash_t (hi32) * hash, const char *key, uint64_t h)
 {
+  GHashKey hkey = {.str = key,.hash = h };
   khint_t k;
-  char *value = NULL;
 
   if (!hash)
-    return NULL;
+    return -1;
 
-  k = kh_get (is32, hash, key);
+  k = kh_get (hi32, hash, hkey);
   /* key found, return current value */
-  if (k != kh_end (hash) && (value = kh_val (hash, k)))
-    return xstrdup (value);
+  if (k != kh_end (hash))
+    return kh_val (hash, k);
 
-  return NULL;
+  return -1;
 }
 
-/* Get the string value of a given string key.
+/* Get the string value of a given int key.
  *
  * On error, NULL is returned.
  * On success the string value for the given key is returned */
 static char *
-get_ss32 (khash_t (ss32) * hash, const char *key)
+get_is32 (khash_t (is32) * hash, int key)
 {
   khint_t k;
   char *value = NULL;
@@ -643,7 +901,7 @@ get_ss32 (khash_t (ss32) * hash, const char *key)
   if (!hash)
     return NULL;
 
-  k = kh_get (ss32, hash, key);
+  k = kh_get (is32, hash, key);
   /* key found, return current value */
   if (k != kh_end (hash) && (value = kh_val (hash, k)))
     return xstrdup (value);
@@ -722,18 +980,15 @@ get_igsl (khash_t (igsl) * hash, int key)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_unique_key (const char *key)
+ht_insert_unique_key (const char *key, uint64_t hash)
 {
-  int value = -1;
-  khash_t (si32) * hash = ht_unique_keys;
+  int new = 0;
+  khash_t (hi32) * ht = ht_unique_keys;
 
-  if (!hash)
+  if (!ht)
     return -1;
 
-  if ((value = get_si32 (hash, key)) != -1)
-    return value;
-
-  return ins_si32_ai (hash, key);
+  return ins_hi32_ai (ht, key, hash, &new);
 }
 
 /* Insert a user agent key string, mapped to an auto incremented value.
@@ -742,18 +997,15 @@ ht_insert_unique_key (const char *key)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_agent_key (const char *key)
+ht_insert_agent_key (const char *key, uint64_t hash)
 {
-  int value = -1;
-  khash_t (si32) * hash = ht_agent_keys;
+  int new = 0;
+  khash_t (hi32) * ht = ht_agent_keys;
 
-  if (!hash)
+  if (!ht)
     return -1;
 
-  if ((value = get_si32 (hash, key)) != -1)
-    return value;
-
-  return ins_si32_ai (hash, key);
+  return ins_hi32_ai (ht, key, hash, &new);
 }
 
 /* Insert a user agent int key, mapped to a user agent string value.
@@ -777,18 +1029,15 @@ ht_insert_agent_value (int key, const char *value)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_keymap (GModule module, const char *key)
+ht_insert_keymap (GModule module, const char *key, uint64_t hash)
 {
-  int value = -1;
-  khash_t (si32) * hash = get_hash (module, MTRC_KEYMAP);
+  int new = 0;
+  khash_t (hi32) * ht = get_hash (module, MTRC_KEYMAP);
 
-  if (!hash)
+  if (!ht)
     return -1;
 
-  if ((value = get_si32 (hash, key)) != -1)
-    return value;
-
-  return ins_si32_ai (hash, key);
+  return ins_hi32_ai (ht, key, hash, &new);
 }
 
 /* Insert a datamap int key and string value.
@@ -821,24 +1070,30 @@ ht_insert_rootmap (GModule module, int key, const char *value)
   return ins_is32 (hash, key, value);
 }
 
-/* Insert a uniqmap string key.
+/* Insert a visitor int key into the bitmap of a data int key, i.e.,
+ * test and set.
  *
- * If the given key exists, 0 is returned.
+ * If the visitor was seen for the given key, 0 is returned.
  * On error, -1 is returned.
- * On success the value of the key inserted is returned */
+ * On success, i.e., a new visitor for the key, 1 is returned */
 int
-ht_insert_uniqmap (GModule module, const char *key)
+ht_insert_uniqmap (GModule module, int key, int value)
 {
-  int value = -1;
-  khash_t (si32) * hash = get_hash (module, MTRC_UNIQMAP);
+  khash_t (ibmp) * hash = get_hash (module, MTRC_UNIQMAP);
+  khint_t k;
+  int ret;
 
   if (!hash)
     return -1;
 
-  if ((value = get_si32 (hash, key)) != -1)
-    return 0;
+  k = kh_put (ibmp, hash, key, &ret);
+  if (ret == -1)
+    return -1;
+  /* an empty bitmap */
+  if (ret)
+    memset (&kh_value (hash, k), 0, sizeof (GBitmap));
 
-  return ins_si32_ai (hash, key);
+  return bitmap_add (&kh_value (hash, k), value);
 }
 
 /* Insert a data int key mapped to the corresponding int root key.
@@ -868,6 +1123,7 @@ ht_insert_hits (GModule module, int key, int inc)
   if (!hash)
     return -1;
 
+  gkh_storage[module].changes++;
   return inc_ii32 (hash, key, inc);
 }
 
@@ -981,19 +1237,131 @@ ht_insert_agent (GModule module, int key, int value)
   return ins_igsl (hash, key, value);
 }
 
-/* Insert an IP hostname mapped to the corresponding hostname.
+/* Count an exact item, e.g., an IP, under the given aggregated int key,
+ * keeping at most `max` of them.
  *
- * On error, or if key exists, -1 is returned.
+ * On error, -1 is returned.
+ * On success 0 is returned */
+int
+ht_insert_child (GModule module, int key, const char *value, int max)
+{
+  khash_t (igsl) * hash = get_hash (module, MTRC_CHILDREN);
+
+  if (!hash)
+    return -1;
+
+  return ins_igsl_child (hash, key, value, max);
+}
+
+/* Push a request onto a bounded min-heap of slow requests. Once it
+ * holds `max` requests, a slower request replaces the fastest one. */
+static void
+push_slow_item (GSlowHeap * heap, const GSlowItem * item, int max)
+{
+  GSlowItem *items = heap->items;
+  int i, child;
+
+  /* sift up from a new leaf */
+  if (heap->len < max) {
+    for (i = heap->len++; i > 0; i = (i - 1) / 2) {
+      if (items[(i - 1) / 2].serve_time <= item->serve_time)
+        break;
+      items[i] = items[(i - 1) / 2];
+    }
+    items[i] = *item;
+    return;
+  }
+
+  if (item->serve_time <= items[0].serve_time)
+    return;
+
+  /* sift down from the root */
+  for (i = 0; (child = 2 * i + 1) < heap->len; i = child) {
+    if (child + 1 < heap->len &&
+        items[child + 1].serve_time < items[child].serve_time)
+      child++;
+    if (items[child].serve_time >= item->serve_time)
+      break;
+    items[i] = items[child];
+  }
+  items[i] = *item;
+}
+
+/* Make room for the heap of an untracked key once `keys` keys are
+ * tracked, by evicting the tracked key with the fewest hits if the
+ * given key has more. The storage keeps a floor no greater than the
+ * hits of any tracked key, hits only grow, so keys below it are turned
+ * away without scanning the tracked ones.
+ *
+ * If the key is not admitted, 1 is returned.
+ * On success 0 is returned */
+static int
+admit_slow_key (GModule module, khash_t (islw) * hash, int key)
+{
+  khash_t (ii32) * hits_hash = get_hash (module, MTRC_HITS);
+  khint_t k, min_k = kh_end (hash);
+  int hits = 0, min = 0, nhits = 0;
+
+  hits = get_ii32 (hits_hash, key);
+  if (hits <= gkh_storage[module].slow_floor)
+    return 1;
+
+  for (k = kh_begin (hash); k != kh_end (hash); ++k) {
+    if (!kh_exist (hash, k))
+      continue;
+    nhits = get_ii32 (hits_hash, kh_key (hash, k));
+    if (min_k == kh_end (hash) || nhits < min) {
+      min = nhits;
+      min_k = k;
+    }
+  }
+  gkh_storage[module].slow_floor = min;
+
+  if (min_k == kh_end (hash) || hits <= min)
+    return 1;
+
+  free (kh_val (hash, min_k));
+  kh_del (islw, hash, min_k);
+
+  return 0;
+}
+
+/* Keep a request among the `max` slowest of a data key. Only the
+ * `keys` most requested keys of a module are tracked, a key admitted
+ * late only holds the requests seen since.
+ *
+ * On error, or if the key is not tracked, -1 is returned.
  * On success 0 is returned */
 int
-ht_insert_hostname (const char *ip, const char *host)
+ht_insert_slowest (GModule module, int key, const GSlowItem * item, int max,
+                   int keys)
 {
-  khash_t (ss32) * hash = ht_hostnames;
+  khash_t (islw) * hash = get_hash (module, MTRC_SLOWEST);
+  GSlowHeap *heap;
+  khint_t k;
+  int ret;
 
   if (!hash)
     return -1;
 
-  return ins_ss32 (hash, ip, host);
+  k = kh_get (islw, hash, key);
+  if (k == kh_end (hash)) {
+    if ((int) kh_size (hash) >= keys && admit_slow_key (module, hash, key))
+      return -1;
+
+    heap = xmalloc (sizeof (GSlowHeap) + max * sizeof (GSlowItem));
+    heap->len = 0;
+
+    k = kh_put (islw, hash, key, &ret);
+    if (ret == -1) {
+      free (heap);
+      return -1;
+    }
+    kh_val (hash, k) = heap;
+  }
+  push_slow_item (kh_val (hash, k), item, max);
+
+  return 0;
 }
 
 /* Get the number of elements in a datamap.
@@ -1010,19 +1378,37 @@ ht_get_size_datamap (GModule module)
   return kh_size (hash);
 }
 
-/* Get the number of elements in a uniqmap.
+/* Get the number of changes made to a module's storage so far. It only
+ * tells whether the module changed since it was last read.
+ *
+ * On success the number of hits inserted into the module is returned */
+uint64_t
+ht_get_changes (GModule module)
+{
+  return gkh_storage[module].changes;
+}
+
+/* Get the number of unique visitors of a module, i.e., the visitors
+ * seen for each data key, all added up.
  *
  * On error, 0 is returned.
- * On success the number of elements in MTRC_UNIQMAP is returned */
+ * On success the number of visitors in MTRC_UNIQMAP is returned */
 uint32_t
 ht_get_size_uniqmap (GModule module)
 {
-  khash_t (is32) * hash = get_hash (module, MTRC_UNIQMAP);
+  khash_t (ibmp) * hash = get_hash (module, MTRC_UNIQMAP);
+  uint32_t size = 0;
+  khint_t k;
 
   if (!hash)
     return 0;
 
-  return kh_size (hash);
+  for (k = kh_begin (hash); k != kh_end (hash); ++k) {
+    if (kh_exist (hash, k))
+      size += kh_value (hash, k).card;
+  }
+
+  return size;
 }
 
 /* Get the string data value of a given int key.
@@ -1047,27 +1433,12 @@ ht_get_datamap (GModule module, int key)
 int
 ht_get_keymap (GModule module, const char *key)
 {
-  khash_t (si32) * hash = get_hash (module, MTRC_KEYMAP);
+  khash_t (hi32) * hash = get_hash (module, MTRC_KEYMAP);
 
   if (!hash)
     return -1;
 
-  return get_si32 (hash, key);
-}
-
-/* Get the int value from MTRC_UNIQMAP given a string key.
- *
- * On error, -1 is returned.
- * On success the int value for the given key is returned */
-int
-ht_get_uniqmap (GModule module, const char *key)
-{
-  khash_t (si32) * hash = get_hash (module, MTRC_UNIQMAP);
-
-  if (!hash)
-    return -1;
-
-  return get_si32 (hash, key);
+  return get_hi32 (hash, key, str_hash64 (key));
 }
 
 /* Get the string root from MTRC_ROOTMAP given an int data key.
@@ -1093,8 +1464,7 @@ ht_get_root (GModule module, int key)
 
 /* Get the int visitors value from MTRC_VISITORS given an int key.
  *
- * If key is not found, 0 is returned.
- * On error, -1 is returned.
+ * If key is not found, or if visitors are ignored, 0 is returned.
  * On success the int value for the given key is returned */
 int
 ht_get_visitors (GModule module, int key)
@@ -1102,7 +1472,7 @@ ht_get_visitors (GModule module, int key)
   khash_t (ii32) * hash = get_hash (module, MTRC_VISITORS);
 
   if (!hash)
-    return -1;
+    return 0;
 
   return get_ii32 (hash, key);
 }
@@ -1182,34 +1552,51 @@ ht_get_protocol (GModule module, int key)
   return get_is32 (hash, key);
 }
 
-/* Get the string value from ht_hostnames given a string key (IP).
+/* Get the string value from ht_agent_vals (user agent) given an int key.
  *
  * On error, NULL is returned.
  * On success the string value for the given key is returned */
 char *
-ht_get_hostname (const char *host)
+ht_get_host_agent_val (int key)
 {
-  khash_t (ss32) * hash = ht_hostnames;
+  khash_t (is32) * hash = ht_agent_vals;
 
   if (!hash)
     return NULL;
 
-  return get_ss32 (hash, host);
+  return get_is32 (hash, key);
 }
 
-/* Get the string value from ht_agent_vals (user agent) given an int key.
+/* Get the list of child items from MTRC_CHILDREN given an int key.
  *
- * On error, NULL is returned.
- * On success the string value for the given key is returned */
-char *
-ht_get_host_agent_val (int key)
+ * On error, or if key is not found, NULL is returned.
+ * On success the GSLList value for the given key is returned */
+GSLList *
+ht_get_child_list (GModule module, int key)
 {
-  khash_t (is32) * hash = ht_agent_vals;
+  khash_t (igsl) * hash = get_hash (module, MTRC_CHILDREN);
+
+  return get_igsl (hash, key);
+}
+
+/* Get the heap of slowest requests from MTRC_SLOWEST given an int key.
+ *
+ * On error, or if key is not found, NULL is returned.
+ * On success the GSlowHeap value for the given key is returned */
+GSlowHeap *
+ht_get_slowest (GModule module, int key)
+{
+  khash_t (islw) * hash = get_hash (module, MTRC_SLOWEST);
+  khint_t k;
 
   if (!hash)
     return NULL;
 
-  return get_is32 (hash, key);
+  k = kh_get (islw, hash, key);
+  if (k == kh_end (hash))
+    return NULL;
+
+  return kh_val (hash, k);
 }
 
 /* Get the list value from MTRC_AGENTS given an int key.
@@ -1227,6 +1614,146 @@ ht_get_host_agent_list (GModule module, int key)
   return NULL;
 }
 
+/* Call the given function on every key of MTRC_KEYMAP whose int value
+ * is greater than `from`, i.e., on the keys inserted after it. */
+void
+ht_foreach_keymap (GModule module, int from,
+                   void (*fn) (const char *key, int nkey, void *user),
+                   void *user)
+{
+  khash_t (hi32) * hash = get_hash (module, MTRC_KEYMAP);
+  khint_t k;
+
+  if (!hash)
+    return;
+
+  for (k = kh_begin (hash); k != kh_end (hash); ++k) {
+    if (kh_exist (hash, k) && kh_val (hash, k) > from)
+      fn (kh_key (hash, k).str, kh_val (hash, k), user);
+  }
+}
+
+/* Clear the counters (hits, visitors, bandwidth and time served) of
+ * every module while keeping their keys, so that the counters hold the
+ * increments since the last reset. */
+void
+ht_reset_counters (void)
+{
+  GModule module;
+  size_t idx = 0;
+
+  FOREACH_MODULE (idx, module_list) {
+    module = module_list[idx];
+    kh_clear (ii32, get_hash (module, MTRC_HITS));
+    if (!is_metric_ignored (module, MTRC_VISITORS))
+      kh_clear (ii32, get_hash (module, MTRC_VISITORS));
+    if (!is_metric_ignored (module, MTRC_BW))
+      kh_clear (iu64, get_hash (module, MTRC_BW));
+    if (!is_metric_ignored (module, MTRC_CUMTS))
+      kh_clear (iu64, get_hash (module, MTRC_CUMTS));
+    if (!is_metric_ignored (module, MTRC_MAXTS))
+      kh_clear (iu64, get_hash (module, MTRC_MAXTS));
+    /* hits restart from zero */
+    gkh_storage[module].slow_floor = 0;
+  }
+}
+
+/* Switch the active storage to the partition identified by the given
+ * key, e.g., a virtual host. The partition is created if needed. Only
+ * per module tables are partitioned, the unique visitor keys and agents
+ * are shared across all partitions.
+ *
+ * On error, or if the partition has been freed, -1 is returned.
+ * On success the index of the partition is returned. */
+int
+ht_switch_partition (const char *key, uint64_t hash)
+{
+  GKHashPartition *part;
+  int new = 0, idx;
+
+  if ((idx = ins_hi32_ai (ht_partitions, key, hash, &new)) == -1)
+    return -1;
+
+  /* auto increment values start at 1 */
+  idx--;
+  if (new) {
+    gkh_partitions =
+      xrealloc (gkh_partitions, (idx + 1) * sizeof (GKHashPartition));
+    part = &gkh_partitions[idx];
+    part->key = xstrdup (key);
+    part->logger = xcalloc (1, sizeof (GLog));
+    part->storage = new_module_storage ();
+    gkh_partitions_len = idx + 1;
+  }
+  if (gkh_partitions[idx].storage == NULL)
+    return -1;
+  gkh_storage = gkh_partitions[idx].storage;
+
+  return idx;
+}
+
+/* Make the partition at the given index the active storage.
+ *
+ * On error, or if the partition has been freed, -1 is returned.
+ * On success 0 is returned. */
+int
+ht_set_partition (int idx)
+{
+  if (idx < 0 || idx >= gkh_partitions_len)
+    return -1;
+  if (gkh_partitions[idx].storage == NULL)
+    return -1;
+  gkh_storage = gkh_partitions[idx].storage;
+
+  return 0;
+}
+
+/* Free the tables of the partition at the given index. Its key and
+ * counters are kept, so records that still belong to it can be told
+ * apart from new ones. */
+void
+ht_free_partition (int idx)
+{
+  if (idx < 0 || idx >= gkh_partitions_len)
+    return;
+
+  if (gkh_storage == gkh_partitions[idx].storage)
+    gkh_storage = gkh_default_storage;
+  free_module_storage (gkh_partitions[idx].storage);
+  gkh_partitions[idx].storage = NULL;
+}
+
+/* Get the number of storage partitions. */
+int
+ht_get_partition_len (void)
+{
+  return gkh_partitions_len;
+}
+
+/* Get the key of the partition at the given index.
+ *
+ * On error, NULL is returned.
+ * On success the partition key is returned. */
+const char *
+ht_get_partition_key (int idx)
+{
+  if (idx < 0 || idx >= gkh_partitions_len)
+    return NULL;
+  return gkh_partitions[idx].key;
+}
+
+/* Get the counters of the partition at the given index.
+ *
+ * On error, NULL is returned.
+ * On success the partition logger is returned. */
+GLog *
+ht_get_partition_log (int idx)
+{
+  if (idx < 0 || idx >= gkh_partitions_len)
+    return NULL;
+  return gkh_partitions[idx].logger;
+}
+
 /* Store the key/value pairs from a hash table into raw_data and sorts the the
  * hits structure.
  *
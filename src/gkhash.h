@@ -22,10 +22,31 @@
 #define GKHASH_H_INCLUDED
 
 #include <stdint.h>
+#include <string.h>
+
+#include "bitmap.h"
 #include "parser.h"
 #include "gstorage.h"
 #include "khash.h"
 
+/* Sample one out of every N newly inserted keys */
+#define PROBE_SAMPLE   1024
+/* Warn if a probe sequence gets longer than this */
+#define PROBE_WARN_LEN 32
+
+/* A string key carrying its precomputed 64-bit hash. The hash is
+ * computed once by the parser and reused by every table the key is
+ * stored in, including upon resizing. */
+typedef struct GHashKey_
+{
+  const char *str;
+  uint64_t hash;
+} GHashKey;
+
+#define kh_hkey_hash_func(k) (khint32_t) ((k).hash ^ ((k).hash >> 32))
+#define kh_hkey_hash_equal(a, b) \
+  ((a).hash == (b).hash && strcmp ((a).str, (b).str) == 0)
+
 /* int keys, int payload */
 KHASH_MAP_INIT_INT (ii32, int);
 /* int keys, string payload */
@@ -38,6 +59,12 @@ KHASH_MAP_INIT_STR (si32, int);
 KHASH_MAP_INIT_STR (ss32, char *);
 /* int keys, GSLList payload */
 KHASH_MAP_INIT_INT (igsl, GSLList *);
+/* int keys, GSlowHeap payload */
+KHASH_MAP_INIT_INT (islw, GSlowHeap *);
+/* int keys, GBitmap payload */
+KHASH_MAP_INIT_INT (ibmp, GBitmap);
+/* hashed string keys, int payload */
+KHASH_INIT (hi32, GHashKey, int, 1, kh_hkey_hash_func, kh_hkey_hash_equal);
 
 /* Metrics Storage */
 
@@ -55,7 +82,7 @@ KHASH_MAP_INIT_INT (igsl, GSLList *);
  * 26/Dec/2014      -> 7
  * Windows          -> 8
  */
-/*khash_t(si32) MTRC_KEYMAP */
+/*khash_t(hi32) MTRC_KEYMAP */
 
 /* Maps integer keys of root elements from the keymap hash
  * to actual string values.
@@ -77,16 +104,14 @@ KHASH_MAP_INIT_INT (igsl, GSLList *);
  */
 /*khash_t(is32) MTRC_DATAMAP */
 
-/* Maps a string key made from the integer key of the
- * IP/date/UA and the integer key from the data field of
- * each module to numeric autoincremented values. e.g., "14"
- * => 1 -> unique visitor key (concatenated) with 4 -> data
- * key.
+/* Maps integer keys of data elements from the keymap hash to a
+ * bitmap of the integer keys of the IP/date/UA seen for each, so
+ * a visitor is counted once per data key.
  *
- * "14" -> 1
- * "15" -> 2
+ * 4 -> {1, 2, 5}
+ * 5 -> {1}
  */
-/*khash_t(si32) MTRC_UNIQMAP */
+/*khash_t(ibmp) MTRC_UNIQMAP */
 
 /* Maps integer key from the keymap hash to the number of
  * hits.
@@ -143,6 +168,19 @@ KHASH_MAP_INIT_INT (igsl, GSLList *);
  */
 /*khash_t(igsl) MTRC_AGENTS */
 
+/* Maps numeric data keys to a bounded list of the most frequent exact
+ * items (GChildItem) aggregated under them, along with their error.
+ * Only allocated for hosts.
+ * 1 -> 10.0.5.17 (321, 0), 10.0.5.4 (87, 12)
+ */
+/*khash_t(igsl) MTRC_CHILDREN */
+
+/* Maps the numeric data keys of the most requested items to a bounded
+ * heap of their slowest requests (GSlowHeap).
+ * 1 -> [10/Oct/2015 13:55:36] 10.0.5.17 200 (2.31 s), ...
+ */
+/*khash_t(islw) MTRC_SLOWEST */
+
 /* Enumerated Storage Metrics */
 typedef enum GSMetricType_
 {
@@ -158,6 +196,12 @@ typedef enum GSMetricType_
   MTRC_TYPE_SS32,
   /* int key - GSLList val */
   MTRC_TYPE_IGSL,
+  /* hashed string key - int val */
+  MTRC_TYPE_HI32,
+  /* int key - GSlowHeap val */
+  MTRC_TYPE_ISLW,
+  /* int key - GBitmap val */
+  MTRC_TYPE_IBMP,
 } GSMetricType;
 
 typedef struct GKHashMetric_
@@ -172,6 +216,9 @@ typedef struct GKHashMetric_
     khash_t (si32) * si32;
     khash_t (ss32) * ss32;
     khash_t (igsl) * igsl;
+    khash_t (hi32) * hi32;
+    khash_t (islw) * islw;
+    khash_t (ibmp) * ibmp;
   };
 } GKHashMetric;
 
@@ -180,19 +227,30 @@ typedef struct GKHashStorage_
 {
   GModule module;
   GKHashMetric metrics[GSMTRC_TOTAL];
+  int slow_floor;               /* at most the hits of any MTRC_SLOWEST key */
+  uint64_t changes;             /* bumped on every hit */
 } GKHashStorage;
 
+/* Per module storage and counters of a single partition, e.g., a
+ * virtual host */
+typedef struct GKHashPartition_
+{
+  char *key;
+  GLog *logger;
+  GKHashStorage *storage;
+} GKHashPartition;
+
 void init_storage (void);
 void free_storage (void);
 
-int ht_insert_unique_key (const char *key);
-int ht_insert_agent_key (const char *key);
+int ht_insert_unique_key (const char *key, uint64_t hash);
+int ht_insert_agent_key (const char *key, uint64_t hash);
 int ht_insert_agent_value (int key, const char *value);
 
-int ht_insert_keymap (GModule module, const char *key);
+int ht_insert_keymap (GModule module, const char *key, uint64_t hash);
 int ht_insert_datamap (GModule module, int key, const char *value);
 int ht_insert_rootmap (GModule module, int key, const char *value);
-int ht_insert_uniqmap (GModule module, const char *key);
+int ht_insert_uniqmap (GModule module, int key, int value);
 int ht_insert_root (GModule module, int key, int value);
 int ht_insert_hits (GModule module, int key, int inc);
 int ht_insert_visitor (GModule module, int key, int inc);
@@ -202,25 +260,41 @@ int ht_insert_maxts (GModule module, int key, uint64_t value);
 int ht_insert_method (GModule module, int key, const char *value);
 int ht_insert_protocol (GModule module, int key, const char *value);
 int ht_insert_agent (GModule module, int key, int value);
-int ht_insert_hostname (const char *ip, const char *host);
+int ht_insert_child (GModule module, int key, const char *value, int max);
+int ht_insert_slowest (GModule module, int key, const GSlowItem * item,
+                       int max, int keys);
 
 uint32_t ht_get_size_datamap (GModule module);
+uint64_t ht_get_changes (GModule module);
 uint32_t ht_get_size_uniqmap (GModule module);
 
 char *ht_get_host_agent_val (int key);
 char *ht_get_datamap (GModule module, int key);
-char *ht_get_hostname (const char *host);
 char *ht_get_method (GModule module, int key);
 char *ht_get_protocol (GModule module, int key);
 char *ht_get_root (GModule module, int key);
 int ht_get_keymap (GModule module, const char *key);
-int ht_get_uniqmap (GModule module, const char *key);
 int ht_get_visitors (GModule module, int key);
 uint64_t ht_get_bw (GModule module, int key);
 uint64_t ht_get_cumts (GModule module, int key);
 uint64_t ht_get_maxts (GModule module, int key);
+GSLList *ht_get_child_list (GModule module, int key);
+GSlowHeap *ht_get_slowest (GModule module, int key);
 GSLList *ht_get_host_agent_list (GModule module, int key);
 
+void ht_foreach_keymap (GModule module, int from,
+                        void (*fn) (const char *key, int nkey, void *user),
+                        void *user);
+void ht_reset_counters (void);
+void ht_ignore_metric (GModule module, GSMetric metric);
+
+GLog *ht_get_partition_log (int idx);
+const char *ht_get_partition_key (int idx);
+int ht_get_partition_len (void);
+int ht_switch_partition (const char *key, uint64_t hash);
+int ht_set_partition (int idx);
+void ht_free_partition (int idx);
+
 GRawData *parse_raw_data (GModule module);
 
 #endif // for #ifndef GKHASH_H
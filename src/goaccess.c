@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <signal.h>
 
@@ -48,19 +49,24 @@
 #include "gkhash.h"
 #endif
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 #include "geolocation.h"
 #endif
 
 #include "csv.h"
+#include "custom.h"
 #include "error.h"
 #include "gdashboard.h"
 #include "gdns.h"
 #include "gholder.h"
+#include "goaccess.h"
 #include "json.h"
 #include "options.h"
 #include "output.h"
+#include "ship.h"
 #include "util.h"
+#include "wpool.h"
+#include "xmalloc.h"
 
 static WINDOW *header_win, *main_win;
 
@@ -69,6 +75,8 @@ GConf conf = {
 };
 
 int active_gdns = 0;
+volatile sig_atomic_t snapshot_pending = 0;
+static volatile sig_atomic_t report_stop = 0;
 
 static int main_win_height = 0;
 static GDash *dash;
@@ -76,6 +84,16 @@ static GHolder *holder;
 static GLog *logger;
 GSpinner *parsing_spinner;
 
+/* Holders of the panels off the first screen are built in the
+ * background by the worker pool, see allocate_holder_visible() */
+static struct
+{
+  GWGroup grp;
+  pthread_mutex_t mutex;
+  int changed;                  /* holders got ready since last checked */
+  int ready[TOTAL_MODULES];
+} holder_tasks = {.mutex = PTHREAD_MUTEX_INITIALIZER };
+
 /* *INDENT-OFF* */
 static GScroll gscroll = {
   {
@@ -90,7 +108,7 @@ static GScroll gscroll = {
     {0, 0}, /* referrers   {scroll, offset} */
     {0, 0}, /* ref sites   {scroll, offset} */
     {0, 0}, /* keywords    {scroll, offset} */
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     {0, 0}, /* geolocation {scroll, offset} */
 #endif
     {0, 0}, /* status      {scroll, offset} */
@@ -111,16 +129,26 @@ house_keeping (void)
     free_agent_list ();
 #endif
 
-  /* REVERSE DNS THREAD */
+  /* REVERSE DNS LOOKUPS */
   pthread_mutex_lock (&gdns_thread.mutex);
-  /* kill dns pthread */
+  /* stop the lookups, the thread exits once its lookup is done */
   active_gdns = 0;
-  free_holder (&holder);
+  pthread_cond_broadcast (&gdns_thread.not_empty);
   gdns_free_queue ();
+  gdns_free_hostnames ();
+  pthread_mutex_unlock (&gdns_thread.mutex);
 
-  free_storage ();
+  /* WORKER POOL */
+  wpool_free ();
 
-  pthread_mutex_unlock (&gdns_thread.mutex);
+  free_holder (&holder);
+  free_host_info ();
+#ifdef TCB_BTREE
+  /* dashboards of the next --load-from-disk run start from those */
+  if (conf.keep_db_files)
+    save_top_items ();
+#endif
+  free_storage ();
 
   /* DASHBOARD */
   if (dash && !conf.output_html) {
@@ -129,18 +157,25 @@ house_keeping (void)
   }
 
   /* GEOLOCATION */
-#ifdef HAVE_LIBGEOIP
-  if (geo_location_data != NULL)
-    GeoIP_delete (geo_location_data);
+#ifdef HAVE_GEOLOCATION
+  geoip_free ();
 #endif
 
+  /* DELTA SHIPPING */
+  ship_close ();
+  aggr_close ();
+
   /* LOGGER */
   free (logger);
+  free_log_filter ();
+  free_custom_panels ();
 
   /* INVALID REQUESTS */
   if (conf.invalid_requests_log) {
     LOG_DEBUG (("Closing invalid requests log.\n"));
     invalid_log_close ();
+    print_invalid_summary (stderr);
+    free_invalid_reasons ();
   }
 
   /* CONFIGURATION */
@@ -160,10 +195,15 @@ house_keeping (void)
 static void
 allocate_holder_by_module (GModule module)
 {
-  GRawData *raw_data;
+  GRawData *raw_data = NULL;
 
+#ifdef TCB_BTREE
+  /* top items cached by a previous run, unless new data came in */
+  raw_data = load_top_items (module, module_sort[module].field);
+#endif
   /* extract data from the corresponding hash table */
-  raw_data = parse_raw_data (module);
+  if (!raw_data)
+    raw_data = parse_raw_data (module);
   if (!raw_data) {
     LOG_DEBUG (("raw data is NULL for module: %d.\n", module));
     return;
@@ -172,16 +212,107 @@ allocate_holder_by_module (GModule module)
   load_holder_data (raw_data, holder + module, module, module_sort[module]);
 }
 
+/* Flag the holder of the given module as ready, or not, to be loaded
+ * into the dashboard. */
+static void
+set_holder_ready (GModule module, int ready)
+{
+  pthread_mutex_lock (&holder_tasks.mutex);
+  holder_tasks.ready[module] = ready;
+  pthread_mutex_unlock (&holder_tasks.mutex);
+}
+
+/* Determine if the holder of the given module is ready.
+ *
+ * If not built yet, 0 is returned.
+ * If ready, 1 is returned. */
+static int
+is_holder_ready (GModule module)
+{
+  int ready;
+
+  pthread_mutex_lock (&holder_tasks.mutex);
+  ready = holder_tasks.ready[module];
+  pthread_mutex_unlock (&holder_tasks.mutex);
+
+  return ready;
+}
+
+/* Build the holder of a module, as a task of the worker pool. Each
+ * module is a task of its own, the holders of different modules share
+ * nothing. */
+static void
+allocate_holder_task (void *arg)
+{
+  GModule module = *(int *) arg;
+
+  allocate_holder_by_module (module);
+  set_holder_ready (module, 1);
+}
+
+/* Build the holder of a module off the first screen, and flag it so
+ * the dashboard picks it up. */
+static void
+allocate_holder_bg_task (void *arg)
+{
+  allocate_holder_task (arg);
+
+  pthread_mutex_lock (&holder_tasks.mutex);
+  holder_tasks.changed = 1;
+  pthread_mutex_unlock (&holder_tasks.mutex);
+}
+
 /* Iterate over all modules/panels and extract data from hash
- * structures and load it into an instance of GHolder */
+ * structures and load it into an instance of GHolder. The modules are
+ * built in parallel by the worker pool. */
 static void
 allocate_holder (void)
 {
+  GWGroup grp = { 0 };
   size_t idx = 0;
 
   holder = new_gholder (TOTAL_MODULES);
   FOREACH_MODULE (idx, module_list) {
-    allocate_holder_by_module (module_list[idx]);
+    wpool_submit (&grp, allocate_holder_task, &module_list[idx]);
+  }
+  wpool_wait (&grp);
+}
+
+/* Wait for the holders being built in the background, if any. This
+ * must be done before the storage or the holder is modified, or a
+ * holder is built on the main thread. */
+static void
+wait_holder_tasks (void)
+{
+  wpool_wait (&holder_tasks.grp);
+}
+
+/* Build the holders of the panels on the first screen and leave the
+ * rest to the worker pool, in scroll order, so the dashboard is drawn
+ * sooner. */
+static void
+allocate_holder_visible (void)
+{
+  GWGroup grp = { 0 };
+  size_t idx = 0;
+  int visible;
+
+  term_size (main_win, &main_win_height);
+  visible = main_win_height / DASH_COLLAPSED + 1;
+
+  holder = new_gholder (TOTAL_MODULES);
+  FOREACH_MODULE (idx, module_list) {
+    set_holder_ready (module_list[idx], 0);
+    if ((int) idx < visible)
+      wpool_submit (&grp, allocate_holder_task, &module_list[idx]);
+  }
+  wpool_wait (&grp);
+
+  idx = 0;
+  FOREACH_MODULE (idx, module_list) {
+    if ((int) idx >= visible)
+      wpool_submit (&holder_tasks.grp, allocate_holder_bg_task,
+                    &module_list[idx]);
   }
 }
 
@@ -249,7 +380,7 @@ allocate_data (void)
       dash->module[module].head = KEYPH_HEAD;
       dash->module[module].desc = KEYPH_DESC;
       break;
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     case GEO_LOCATION:
       dash->module[module].head = GEOLO_HEAD;
       dash->module[module].desc = GEOLO_DESC;
@@ -259,6 +390,20 @@ allocate_data (void)
       dash->module[module].head = CODES_HEAD;
       dash->module[module].desc = CODES_DESC;
       break;
+    case CUSTOM_1:
+    case CUSTOM_2:
+    case CUSTOM_3:
+      dash->module[module].head = module_to_head (module);
+      dash->module[module].desc = CUSTM_DESC;
+      break;
+    }
+
+    /* still being built */
+    if (!is_holder_ready (module)) {
+      dash->module[module].loading = 1;
+      dash->module[module].dash_size = DASH_COLLAPSED;
+      dash->total_alloc += DASH_COLLAPSED;
+      continue;
     }
 
     size = holder[module].idx;
@@ -279,9 +424,7 @@ allocate_data (void)
       dash->module[module].dash_size = DASH_COLLAPSED;
     dash->total_alloc += dash->module[module].dash_size;
 
-    pthread_mutex_lock (&gdns_thread.mutex);
     load_data_to_dash (&holder[module], dash, module, &gscroll);
-    pthread_mutex_unlock (&gdns_thread.mutex);
   }
 }
 
@@ -424,9 +567,11 @@ expand_current_module (void)
   reset_scroll_offsets (&gscroll);
   gscroll.expanded = 1;
 
+  wait_holder_tasks ();
   free_holder_by_module (&holder, gscroll.current);
   free_dashboard (dash);
   allocate_holder_by_module (gscroll.current);
+  set_holder_ready (gscroll.current, 1);
   allocate_data ();
 }
 
@@ -444,9 +589,11 @@ expand_module_from_ypos (int y)
   reset_scroll_offsets (&gscroll);
   gscroll.expanded = 1;
 
+  wait_holder_tasks ();
   free_holder_by_module (&holder, gscroll.current);
   free_dashboard (dash);
   allocate_holder_by_module (gscroll.current);
+  set_holder_ready (gscroll.current, 1);
   allocate_data ();
 
   render_screens ();
@@ -566,9 +713,9 @@ render_search_dialog (int search)
   if (render_find_dialog (main_win, &gscroll))
     return;
 
-  pthread_mutex_lock (&gdns_thread.mutex);
+  wait_holder_tasks ();
+
   search = perform_next_find (holder, &gscroll);
-  pthread_mutex_unlock (&gdns_thread.mutex);
   if (search != 0)
     return;
 
@@ -581,9 +728,8 @@ render_search_dialog (int search)
 static void
 search_next_match (int search)
 {
-  pthread_mutex_lock (&gdns_thread.mutex);
+  wait_holder_tasks ();
   search = perform_next_find (holder, &gscroll);
-  pthread_mutex_unlock (&gdns_thread.mutex);
   if (search != 0)
     return;
 
@@ -593,21 +739,23 @@ search_next_match (int search)
 }
 
 /* Process appended log data and update dashboard screen */
-static void
-perform_tail_follow (uint64_t * size1)
+static int
+parse_tail (uint64_t * size1)
 {
   uint64_t size2 = 0;
   char buf[LINE_BUFFER];
   FILE *fp = NULL;
 
-  if (logger->piping || logger->load_from_disk_only)
-    return;
+  if (logger->piping || logger->load_from_disk_only || !conf.ifile)
+    return 0;
 
   size2 = file_size (conf.ifile);
 
   /* file hasn't changed */
   if (size2 == *size1)
-    return;
+    return 0;
+
+  wait_holder_tasks ();
 
   if (!(fp = fopen (conf.ifile, "r")))
     FATAL ("Unable to read log file %s.", strerror (errno));
@@ -617,10 +765,17 @@ perform_tail_follow (uint64_t * size1)
   fclose (fp);
 
   *size1 = size2;
-  pthread_mutex_lock (&gdns_thread.mutex);
+
+  return 1;
+}
+
+/* Rebuild the holder and the dashboard from the storage and render
+ * them. */
+static void
+refresh_dashboard (void)
+{
+  wait_holder_tasks ();
   free_holder (&holder);
-  pthread_cond_broadcast (&gdns_thread.not_empty);
-  pthread_mutex_unlock (&gdns_thread.mutex);
 
   free_dashboard (dash);
   allocate_holder ();
@@ -628,9 +783,51 @@ perform_tail_follow (uint64_t * size1)
 
   term_size (main_win, &main_win_height);
   render_screens ();
+}
+
+/* Parse the lines appended to the log since the last time, if any, and
+ * refresh the dashboard. */
+static void
+perform_tail_follow (uint64_t * size1)
+{
+  if (!parse_tail (size1))
+    return;
+
+  refresh_dashboard ();
   usleep (200000);      /* 0.2 seconds */
 }
 
+/* Load the holders built in the background since the last time, if
+ * any, into the dashboard. */
+static void
+perform_holder_ready (void)
+{
+  int changed;
+
+  pthread_mutex_lock (&holder_tasks.mutex);
+  changed = holder_tasks.changed;
+  holder_tasks.changed = 0;
+  pthread_mutex_unlock (&holder_tasks.mutex);
+
+  if (!changed)
+    return;
+
+  free_dashboard (dash);
+  allocate_data ();
+  render_screens ();
+}
+
+/* Merge the deltas shipped by agents, if any, and refresh the
+ * dashboard. */
+static void
+perform_aggregate (void)
+{
+  /* merging modifies the storage */
+  wait_holder_tasks ();
+  if (aggr_poll (logger, 0) > 0)
+    refresh_dashboard ();
+}
+
 /* Iterate over available panels and advance the panel pointer. */
 static int
 next_module (void)
@@ -683,10 +880,8 @@ static void
 render_sort_dialog (void)
 {
   load_sort_win (main_win, gscroll.current, &module_sort[gscroll.current]);
-  pthread_mutex_lock (&gdns_thread.mutex);
+  wait_holder_tasks ();
   free_holder (&holder);
-  pthread_cond_broadcast (&gdns_thread.not_empty);
-  pthread_mutex_unlock (&gdns_thread.mutex);
   free_dashboard (dash);
   allocate_holder ();
   allocate_data ();
@@ -701,11 +896,13 @@ get_keys (void)
   int c, quit = 1;
   uint64_t size1 = 0;
 
-  if (!logger->piping && !logger->load_from_disk_only)
+  if (!logger->piping && !logger->load_from_disk_only && conf.ifile)
     size1 = file_size (conf.ifile);
 
   while (quit) {
     c = wgetch (stdscr);
+    /* panels built in the background since the last key */
+    perform_holder_ready ();
     switch (c) {
     case 'q':  /* quit */
       if (!gscroll.expanded) {
@@ -770,13 +967,13 @@ get_keys (void)
       break;
     case 35:   /* Shift + 3 */
       /* reset expanded module */
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
       set_module_to (&gscroll, GEO_LOCATION);
 #else
       set_module_to (&gscroll, STATUS_CODES);
 #endif
       break;
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     case 36:   /* Shift + 4 */
       /* reset expanded module */
       set_module_to (&gscroll, STATUS_CODES);
@@ -869,7 +1066,11 @@ get_keys (void)
       window_resize ();
       break;
     default:
+      if (conf.aggregate_socket)
+        perform_aggregate ();
       perform_tail_follow (&size1);
+      if (snapshot_pending)
+        take_snapshot (logger);
       break;
     }
   }
@@ -900,32 +1101,296 @@ set_general_stats (void)
 }
 
 /* Set up and open GeoIP database */
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 static void
 init_geoip (void)
 {
+#ifdef HAVE_LIBGEOIP
   /* open custom city GeoIP database */
   if (conf.geoip_database != NULL)
     geo_location_data = geoip_open_db (conf.geoip_database);
   /* fall back to legacy GeoIP database */
   else
     geo_location_data = GeoIP_new (conf.geo_db);
+#else
+  /* open the compiled IP range table, if any */
+  if (conf.geoip_table != NULL)
+    geo_table = geotable_open (conf.geoip_table);
+#endif
 }
 #endif
 
-/* Determine the type of output, i.e., JSON, CSV, HTML */
+/* Determine the output file extension, i.e., json, csv, html */
+static const char *
+output_ext (void)
+{
+  if (conf.output_format && strcmp ("csv", conf.output_format) == 0)
+    return "csv";
+  if (conf.output_format && strcmp ("json", conf.output_format) == 0)
+    return "json";
+  return "html";
+}
+
+/* Determine the type of output, i.e., JSON, CSV, HTML and write it to
+ * the given file or stdout if none given */
 static void
-standard_output (void)
+write_output (GLog * glog, const char *filename)
 {
   /* CSV */
   if (conf.output_format && strcmp ("csv", conf.output_format) == 0)
-    output_csv (logger, holder);
+    output_csv (glog, holder, filename);
   /* JSON */
   else if (conf.output_format && strcmp ("json", conf.output_format) == 0)
-    output_json (logger, holder);
+    output_json (glog, holder, filename);
   /* HTML */
   else
-    output_html (logger, holder);
+    output_html (glog, holder, filename);
+}
+
+/* Write the report to a temporary file next to the --snapshot-file,
+ * then move it over, so a reader never sees a partial report.
+ *
+ * On error, 1 is returned.
+ * On success, 0 is returned. */
+static int
+write_snapshot (GLog * glog)
+{
+  char *tmp = NULL;
+  int fd, ret = 0;
+
+  tmp = xmalloc (strlen (conf.snapshot_file) + 8);
+  sprintf (tmp, "%s.XXXXXX", conf.snapshot_file);
+  if ((fd = mkstemp (tmp)) == -1) {
+    LOG_DEBUG (("Unable to create %s. %s\n", tmp, strerror (errno)));
+    free (tmp);
+    return 1;
+  }
+  fchmod (fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  close (fd);
+
+  time (&end_proc);
+  write_output (glog, tmp);
+
+  if (rename (tmp, conf.snapshot_file) == -1) {
+    LOG_DEBUG (("Unable to rename %s. %s\n", tmp, strerror (errno)));
+    unlink (tmp);
+    ret = 1;
+  }
+  free (tmp);
+
+  return ret;
+}
+
+/* Take a report snapshot, i.e., on SIGUSR1. The storage is consistent
+ * between two lines, so it is called from the parser. A forked child
+ * gets a copy-on-write image of the storage, builds the holders from it
+ * and writes the report, while the parent carries on parsing. */
+void
+take_snapshot (GLog * glog)
+{
+  static pid_t pid = 0;
+  size_t idx = 0;
+
+  snapshot_pending = 0;
+  /* one snapshot at a time */
+  if (pid > 0 && waitpid (pid, NULL, WNOHANG) == 0) {
+    LOG_DEBUG (("A snapshot is still being written.\n"));
+    return;
+  }
+
+  if ((pid = fork ()) == -1) {
+    LOG_DEBUG (("Unable to fork a snapshot. %s\n", strerror (errno)));
+    pid = 0;
+  }
+  if (pid != 0)
+    return;
+
+  /* only this thread lives on in the child, start the DNS queue over as
+   * its lock may have been held by a worker, holders are built here */
+  gdns_init ();
+  holder = new_gholder (TOTAL_MODULES);
+  FOREACH_MODULE (idx, module_list) {
+    allocate_holder_by_module (module_list[idx]);
+  }
+  _exit (write_snapshot (glog) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* Build the report file name of a partition, e.g.,
+ * <dir>/www.example.com.html
+ *
+ * On success, a malloc'd file name is returned. */
+static char *
+get_partition_filename (const char *key)
+{
+  const char *ext = output_ext ();
+  char *name = NULL, *p;
+  size_t len;
+
+  const char *dir = conf.vhost_reports_dir ? : conf.daily_reports_dir;
+
+  len = strlen (dir) + strlen (key) + strlen (ext) + 3;
+  name = xmalloc (len);
+  sprintf (name, "%s/", dir);
+
+  /* keep the key from escaping the given directory */
+  p = name + strlen (name);
+  for (; *key != '\0'; key++, p++)
+    *p = *key == '/' ? '_' : *key;
+  sprintf (p, ".%s", ext);
+
+  return name;
+}
+
+/* Write the report of a single partition to its own file. Partitions
+ * that have already been flushed are skipped. */
+static void
+write_partition (int idx)
+{
+  char *filename = NULL;
+
+  free_holder (&holder);
+  if (ht_set_partition (idx) == -1)
+    return;
+  allocate_holder ();
+
+  filename = get_partition_filename (ht_get_partition_key (idx));
+  write_output (ht_get_partition_log (idx), filename);
+  free (filename);
+}
+
+/* Write the report of a partition and free its tables, e.g., a day
+ * the log has already moved past */
+void
+flush_partition (int idx)
+{
+  time (&end_proc);
+  write_partition (idx);
+  free_holder (&holder);
+  ht_free_partition (idx);
+}
+
+/* Output one report per storage partition, i.e., per virtual host or
+ * per day */
+static void
+partition_output (void)
+{
+  int idx, len = ht_get_partition_len ();
+
+  for (idx = 0; idx < len; idx++)
+    write_partition (idx);
+}
+
+/* Output to stdout, or to a file per partition if partitioning */
+static void
+standard_output (void)
+{
+  if (conf.vhost_reports_dir || conf.daily_reports_dir)
+    partition_output ();
+  else
+    write_output (logger, NULL);
+}
+
+/* Run as an agent, shipping the parsed data, then following the log
+ * and shipping what is appended to it every few seconds. It stops once
+ * the aggregator goes away or, if the log was piped, after the first
+ * shipment. */
+static void
+agent_output (void)
+{
+  int interval = conf.ship_interval ? conf.ship_interval : SHIP_INTERVAL;
+  uint64_t size = 0;
+
+  if (!logger->piping && conf.ifile)
+    size = file_size (conf.ifile);
+
+  while (ship_delta (logger) == 0 && !logger->piping) {
+    sleep (interval);
+    parse_tail (&size);
+  }
+  LOG_DEBUG (("Agent stopped shipping.\n"));
+}
+
+/* Rebuild the holders of the modules whose storage changed since they
+ * were last built, the others are kept as they are. */
+static void
+refresh_changed_holders (uint64_t * changes)
+{
+  GWGroup grp = { 0 };
+  GModule module;
+  size_t idx = 0;
+  uint64_t now;
+
+  FOREACH_MODULE (idx, module_list) {
+    module = module_list[idx];
+    if ((now = ht_get_changes (module)) == changes[module])
+      continue;
+    changes[module] = now;
+    free_holder_by_module (&holder, module);
+    wpool_submit (&grp, allocate_holder_task, &module_list[idx]);
+  }
+  wpool_wait (&grp);
+}
+
+/* Stop following the log once the current report is written. */
+static void
+stop_report_handler (GO_UNUSED int sig)
+{
+  report_stop = 1;
+}
+
+/* Follow the log, writing the report to the --snapshot-file every
+ * --report-interval seconds, until SIGINT or SIGTERM. Only the holders
+ * of the panels whose data changed are rebuilt, each one from all of its
+ * data; the others are kept as is. */
+static void
+report_output (void)
+{
+  uint64_t changes[TOTAL_MODULES] = { 0 };
+  uint64_t size = 0;
+  struct sigaction act;
+  size_t idx = 0;
+
+  if (logger->piping || !conf.ifile)
+    FATAL ("--report-interval requires a log file, not piped data.");
+
+  sigemptyset (&act.sa_mask);
+  act.sa_flags = SA_RESTART;
+  act.sa_handler = stop_report_handler;
+  sigaction (SIGINT, &act, NULL);
+  sigaction (SIGTERM, &act, NULL);
+
+  /* the holders were built once parsed */
+  FOREACH_MODULE (idx, module_list) {
+    changes[module_list[idx]] = ht_get_changes (module_list[idx]);
+  }
+
+  size = file_size (conf.ifile);
+  while (1) {
+    /* this write takes any snapshot requested meanwhile */
+    snapshot_pending = 0;
+    write_snapshot (logger);
+    if (report_stop)
+      break;
+    sleep (conf.report_interval);
+    if (parse_tail (&size))
+      refresh_changed_holders (changes);
+  }
+}
+
+/* Merge the deltas shipped by agents until all agents that connected
+ * have disconnected. */
+static void
+aggregate_output (void)
+{
+  int seen = 0;
+
+  while (!seen || aggr_peers () > 0) {
+    aggr_poll (logger, -1);
+    if (snapshot_pending)
+      take_snapshot (logger);
+    if (aggr_peers () > 0)
+      seen = 1;
+  }
 }
 
 /* Output to a terminal */
@@ -934,10 +1399,11 @@ curses_output (void)
 {
   allocate_data ();
   if (!conf.skip_term_resolver)
-    gdns_thread_create ();
+    gdns_activate ();
 
   render_screens ();
   get_keys ();
+  wait_holder_tasks ();
 
   /* restore tty modes and reset
    * terminal into non-visual mode */
@@ -969,11 +1435,51 @@ parse_cmd_line (int argc, char **argv)
   /* Not outputting to a terminal */
   if (!isatty (STDOUT_FILENO) || conf.output_format != NULL)
     conf.output_html = 1;
+  /* Reports are written to files */
+  if (conf.vhost_reports_dir || conf.daily_reports_dir)
+    conf.output_html = 1;
+  if (conf.vhost_reports_dir && conf.daily_reports_dir)
+    FATAL ("Per virtual host and per day reports cannot be combined.");
+  /* Agents ship their data instead of outputting it */
+  if (conf.ship_to)
+    conf.output_html = 1;
+  /* Periodic reports are written to a file */
+  if (conf.report_interval)
+    conf.output_html = 1;
+  if (conf.report_interval && !conf.snapshot_file)
+    FATAL ("--report-interval requires --snapshot-file.");
+  if (conf.ship_to && (conf.aggregate_socket || conf.vhost_reports_dir ||
+                       conf.daily_reports_dir))
+    FATAL ("Shipping deltas cannot be combined with aggregating or reports.");
+#ifdef HAVE_LIBTOKYOCABINET
+  if (conf.vhost_reports_dir || conf.daily_reports_dir)
+    FATAL ("Per partition reports are not supported by on-disk storage.");
+  if (conf.host_children)
+    FATAL ("Host children are not supported by on-disk storage.");
+  if (conf.slowest_requests)
+    FATAL ("Slowest requests are not supported by on-disk storage.");
+  if (conf.ship_to || conf.aggregate_socket)
+    FATAL ("Shipping deltas is not supported by on-disk storage.");
+  /* changes are not tracked, a refresh would never rebuild a panel */
+  if (conf.report_interval)
+    FATAL ("Periodic reports are not supported by on-disk storage.");
+  if (conf.snapshot_file)
+    FATAL ("Snapshots are not supported by on-disk storage.");
+  /* its databases are not shared across threads, tasks run in turn */
+  conf.threads = 1;
+#endif
+  if (conf.snapshot_file && (conf.ship_to || conf.vhost_reports_dir ||
+                             conf.daily_reports_dir))
+    FATAL ("Snapshots cannot be combined with shipping deltas or reports.");
+  if (conf.report_interval && conf.aggregate_socket)
+    FATAL ("Periodic reports cannot be combined with aggregating.");
   /* Log piped, and log file passed */
   if (conf.ifile && !isatty (STDIN_FILENO) && !conf.output_html)
     cmd_help ();
-  /* No data piped, no file was used and not loading from disk */
-  if (!conf.ifile && isatty (STDIN_FILENO) && !conf.load_from_disk)
+  /* No data piped, no file was used, not loading from disk and not
+   * aggregating */
+  if (!conf.ifile && isatty (STDIN_FILENO) && !conf.load_from_disk &&
+      !conf.aggregate_socket)
     cmd_help ();
 
   set_default_static_files ();
@@ -993,6 +1499,30 @@ setup_signal_handlers (void)
 }
 #endif
 
+/* Flag a report snapshot, taken once the current line is processed. */
+static void
+sigusr1_handler (GO_UNUSED int sig)
+{
+  snapshot_pending = 1;
+}
+
+/* Take a report snapshot on SIGUSR1 if --snapshot-file is given. Reads
+ * are restarted, so a signal does not cut the log short. */
+static void
+setup_snapshot_signal (void)
+{
+  struct sigaction act;
+
+  if (!conf.snapshot_file)
+    return;
+
+  sigemptyset (&act.sa_mask);
+  act.sa_flags = SA_RESTART;
+  act.sa_handler = sigusr1_handler;
+
+  sigaction (SIGUSR1, &act, NULL);
+}
+
 /* Where all begins... */
 int
 main (int argc, char **argv)
@@ -1007,15 +1537,22 @@ main (int argc, char **argv)
   verify_global_config (argc, argv);
   parse_conf_file (&argc, &argv);
   parse_cmd_line (argc, argv);
+  setup_snapshot_signal ();
+  /* workers for parsing, building holders and resolving */
+  wpool_init (conf.threads);
 
-  /* initialize modules and set first */
+  /* compile the user-defined panels, then initialize modules and set first */
+  init_custom_panels ();
   gscroll.current = init_modules ();
-  /* initialize storage */
+  /* seed the hash function used for string keys */
+  seed_str_hash ();
+  /* drop the metrics the panels don't track, then initialize storage */
+  set_panel_metrics ();
   init_storage ();
   /* setup to use the current locale */
   set_locale ();
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   init_geoip ();
 #endif
 
@@ -1061,8 +1598,20 @@ out:
   time (&start_proc);
   if (conf.load_from_disk)
     set_general_stats ();
+  /* days may be flushed (output) while parsing */
+  gdns_init ();
+  parse_initial_sort ();
+  if (conf.aggregate_socket && aggr_listen (conf.aggregate_socket) == -1)
+    FATAL ("Unable to listen on %s. %s", conf.aggregate_socket,
+           strerror (errno));
+  /* connect early, so the aggregator waits for this agent */
+  if (conf.ship_to && ship_connect (conf.ship_to) == -1)
+    FATAL ("Unable to connect to the aggregator %s. %s", conf.ship_to,
+           strerror (errno));
   if (!quit && parse_log (&logger, NULL, -1))
     FATAL ("Error while processing file");
+  /* sorting by bandwidth or time served is only known once parsed */
+  parse_initial_sort ();
 
   logger->offset = logger->processed;
 
@@ -1072,19 +1621,36 @@ out:
    *
    * If it gets to this point, usually the log/date/time format did
    * not match the log entries. */
-  if (logger->valid == 0)
+  if (logger->valid == 0 && !conf.aggregate_socket && !conf.ship_to) {
+    /* the reasons lines failed are what tells what to fix */
+    invalid_log_close ();
+    print_invalid_summary (stderr);
+    if (conf.filter && logger->invalid < logger->processed)
+      FATAL ("No valid request matched the --filter expression.");
     FATAL ("Nothing valid to process. Verify your date/time/log format.");
+  }
 
-  /* init reverse lookup thread */
-  gdns_init ();
-  parse_initial_sort ();
-  allocate_holder ();
+  /* merge what agents ship before outputting */
+  if (conf.aggregate_socket && conf.output_html)
+    aggregate_output ();
+
+  if (conf.output_html)
+    allocate_holder ();
+  /* draw the dashboard before the panels off screen are built */
+  else
+    allocate_holder_visible ();
 
   end_spinner ();
   time (&end_proc);
 
+  /* agent */
+  if (conf.ship_to)
+    agent_output ();
+  /* periodic report */
+  else if (conf.report_interval)
+    report_output ();
   /* stdout */
-  if (conf.output_html)
+  else if (conf.output_html)
     standard_output ();
   /* curses */
   else
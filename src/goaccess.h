@@ -21,9 +21,16 @@
 #ifndef GOACCESS_H_INCLUDED
 #define GOACCESS_H_INCLUDED
 
+#include <signal.h>
+
+#include "parser.h"
 #include "ui.h"
 
 extern GSpinner *parsing_spinner;
-extern int active_gdns;         /* kill dns pthread flag */
+extern int active_gdns;         /* DNS lookups are active */
+extern volatile sig_atomic_t snapshot_pending;  /* SIGUSR1 received */
+
+void flush_partition (int idx);
+void take_snapshot (GLog * glog);
 
 #endif
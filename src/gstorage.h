@@ -24,7 +24,7 @@
 #include "commons.h"
 
 /* Total number of storage metrics (GSMetric) */
-#define GSMTRC_TOTAL 13
+#define GSMTRC_TOTAL 15
 
 /* Enumerated Storage Metrics */
 typedef enum GSMetric_
@@ -42,8 +42,47 @@ typedef enum GSMetric_
   MTRC_METHODS,
   MTRC_PROTOCOLS,
   MTRC_AGENTS,
+  MTRC_CHILDREN,
+  MTRC_SLOWEST,
 } GSMetric;
 
+/* Items tracked under an aggregated data key for each one displayed.
+ * Space-Saving only keeps for sure the items seen more often than once
+ * per its capacity, thus more are tracked than displayed */
+#define CHILD_SKETCH_FACTOR 10
+
+/* An exact item counted under an aggregated data key, e.g., an IP
+ * address under its network prefix. Hits include the count inherited
+ * from the item it replaced, i.e., the error, thus hits - error are
+ * the hits seen for sure */
+typedef struct GChildItem_
+{
+  int hits;
+  int error;
+  char data[];
+} GChildItem;
+
+#define SLOW_WHEN_LEN 32
+#define SLOW_HOST_LEN 48
+#define SLOW_STATUS_LEN 8
+
+/* A request kept among the slowest of a data key */
+typedef struct GSlowItem_
+{
+  uint64_t serve_time;
+  char when[SLOW_WHEN_LEN];
+  char host[SLOW_HOST_LEN];
+  char status[SLOW_STATUS_LEN];
+} GSlowItem;
+
+/* A bounded min-heap of the slowest requests of a data key, the
+ * fastest of them is at its root */
+typedef struct GSlowHeap_
+{
+  int len;
+  GSlowItem items[];
+} GSlowHeap;
+
 GMetrics *new_gmetrics (void);
 
 int *int2ptr (int val);
@@ -23,6 +23,7 @@
 #define _FILE_OFFSET_BITS 64
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,7 +40,11 @@
 #include "gkhash.h"
 #endif
 
+#include "custom.h"
+#include "error.h"
+#include "gholder.h"
 #include "settings.h"
+#include "ship.h"
 #include "ui.h"
 #include "util.h"
 
@@ -65,10 +70,13 @@ static GPanel paneling[] = {
   {REFERRERS, print_json_data},
   {REFERRING_SITES, print_json_data},
   {KEYPHRASES, print_json_data},
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION, print_json_data},
 #endif
   {STATUS_CODES, print_json_data},
+  {CUSTOM_1, print_json_data},
+  {CUSTOM_2, print_json_data},
+  {CUSTOM_3, print_json_data},
 };
 
 static GPanel *
@@ -177,16 +185,47 @@ print_json_host_geo (FILE * fp, GSubList * sub_list, char *sep)
     "hostname",
   };
 
-  int i;
+  int i = 0;
   if (sub_list == NULL)
     return;
 
-  fprintf (fp, ",\n");
-  for (i = 0, iter = sub_list->head; iter; iter = iter->next, i++) {
-    fprintf (fp, "%s\t\"%s\": \"", sep, key[iter->metrics->id]);
+  for (iter = sub_list->head; iter; iter = iter->next) {
+    /* exact IPs under a host prefix are output as a list */
+    if (iter->metrics->id == MTRC_ID_HOST) {
+      i++;
+      continue;
+    }
+    fprintf (fp, ",\n%s\t\"%s\": \"", sep, key[iter->metrics->id]);
+    escape_json_output (fp, iter->metrics->data);
+    fprintf (fp, "\"");
+  }
+  if (i == 0)
+    return;
+
+  fprintf (fp, ",\n%s\t\"hosts\": [", sep);
+  for (i = 0, iter = sub_list->head; iter; iter = iter->next) {
+    if (iter->metrics->id != MTRC_ID_HOST)
+      continue;
+    fprintf (fp, "%s{\"data\": \"", i++ ? ", " : "");
     escape_json_output (fp, iter->metrics->data);
-    fprintf (fp, (i != sub_list->size - 1) ? "\",\n" : "\"");
+    fprintf (fp, "\", \"hits\": %d}", iter->metrics->hits);
   }
+  fprintf (fp, "]");
+}
+
+/* Write the key of a panel. User-defined panels are keyed by the name
+ * given to --custom-panel. */
+static void
+print_json_panel_key (FILE * fp, GModule module)
+{
+  const char *name = custom_panel_name (module);
+
+  fprintf (fp, "\t\"");
+  if (name)
+    escape_json_output (fp, (char *) name);
+  else
+    fprintf (fp, "%s", module_to_id (module));
+  fprintf (fp, "\": [\n");
 }
 
 static void
@@ -196,7 +235,7 @@ print_json_host_data (FILE * fp, GHolder * h, int valid)
   char *sep = char_repeat (2, '\t');
   int i;
 
-  fprintf (fp, "\t\"%s\": [\n", module_to_id (h->module));
+  print_json_panel_key (fp, h->module);
   for (i = 0; i < h->idx; i++) {
     set_data_metrics (h->items[i].metrics, &nmetrics, valid);
 
@@ -245,7 +284,7 @@ print_json_data (FILE * fp, GHolder * h, int valid)
   char *sep = char_repeat (2, '\t');
   int i;
 
-  fprintf (fp, "\t\"%s\": [\n", module_to_id (h->module));
+  print_json_panel_key (fp, h->module);
   for (i = 0; i < h->idx; i++) {
     set_data_metrics (h->items[i].metrics, &nmetrics, valid);
 
@@ -295,7 +334,7 @@ print_json_summary (FILE * fp, GLog * logger)
   fprintf (fp, "\t\t\"%s\": %lld,\n", OVERALL_GENTIME, t);
 
   /* visitors */
-  total = ht_get_size_uniqmap (VISITORS);
+  total = ht_get_size_uniqmap (VISITORS) + aggr_visitors ();
   fprintf (fp, "\t\t\"%s\": %d,\n", OVERALL_VISITORS, total);
 
   /* files */
@@ -339,13 +378,16 @@ print_json_summary (FILE * fp, GLog * logger)
 /* entry point to generate a a json report writing it to the fp */
 /* follow the JSON style similar to http://developer.github.com/v3/ */
 void
-output_json (GLog * logger, GHolder * holder)
+output_json (GLog * logger, GHolder * holder, const char *filename)
 {
   GModule module;
   FILE *fp = stdout;
   const GPanel *panel = NULL;
   size_t idx = 0;
 
+  if (filename != NULL && (fp = fopen (filename, "w")) == NULL)
+    FATAL ("Unable to open report file %s. %s", filename, strerror (errno));
+
   fprintf (fp, "{\n");
   print_json_summary (fp, logger);
 
@@ -356,7 +398,11 @@ output_json (GLog * logger, GHolder * holder)
       continue;
 
     panel->render (fp, holder + module, logger->valid);
-    module != TOTAL_MODULES - 1 ? fprintf (fp, ",\n") : fprintf (fp, "\n");
+    /* the last panel may not be the last module, e.g., no custom panels */
+    if (idx + 1 < TOTAL_MODULES && module_list[idx + 1] != -1)
+      fprintf (fp, ",\n");
+    else
+      fprintf (fp, "\n");
   }
 
   fprintf (fp, "}");
@@ -27,6 +27,6 @@
 
 #include "parser.h"
 
-void output_json (GLog * logger, GHolder * holder);
+void output_json (GLog * logger, GHolder * holder, const char *filename);
 
 #endif
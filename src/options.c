@@ -29,6 +29,10 @@
 #include <getopt.h>
 #include <errno.h>
 
+#ifdef HAVE_GEOTABLE
+#include "geotable.h"
+#endif
+
 #ifdef HAVE_LIBTOKYOCABINET
 #include "tcabdb.h"
 #include "tcbtdb.h"
@@ -59,19 +63,31 @@ struct option long_opts[] = {
   {"version"              , no_argument       , 0 , 'V' } ,
   {"debug-file"           , required_argument , 0 , 'l' } ,
   {"invalid-requests"     , required_argument , 0 ,  0  } ,
+  {"invalid-requests-sample", required_argument , 0 ,  0  } ,
   {"444-as-404"           , no_argument       , 0 ,  0  } ,
   {"4xx-to-unique-count"  , no_argument       , 0 ,  0  } ,
+  {"aggregate"            , required_argument , 0 ,  0  } ,
   {"all-static-files"     , no_argument       , 0 ,  0  } ,
   {"color"                , required_argument , 0 ,  0  } ,
   {"color-scheme"         , required_argument , 0 ,  0  } ,
+  {"custom-panel"         , required_argument , 0 ,  0  } ,
+  {"daily-reports"        , required_argument , 0 ,  0  } ,
   {"date-format"          , required_argument , 0 ,  0  } ,
   {"double-decode"        , no_argument       , 0 ,  0  } ,
+  {"drop-page-cache"      , no_argument       , 0 ,  0  } ,
+  {"filter"               , required_argument , 0 ,  0  } ,
+  {"flush-daily"          , no_argument       , 0 ,  0  } ,
+  {"host-children"        , required_argument , 0 ,  0  } ,
+  {"host-prefix"          , required_argument , 0 ,  0  } ,
   {"html-report-title"    , required_argument , 0 ,  0  } ,
   {"ignore-crawlers"      , no_argument       , 0 ,  0  } ,
+  {"ignore-metric"        , required_argument , 0 ,  0  } ,
   {"ignore-panel"         , required_argument , 0 ,  0  } ,
   {"ignore-status"        , required_argument , 0 ,  0  } ,
   {"ignore-referer"       , required_argument , 0 ,  0  } ,
   {"log-format"           , required_argument , 0 ,  0  } ,
+  {"max-cpu"              , required_argument , 0 ,  0  } ,
+  {"max-read-rate"        , required_argument , 0 ,  0  } ,
   {"no-color"             , no_argument       , 0 ,  0  } ,
   {"no-tab-scroll"        , no_argument       , 0 ,  0  } ,
   {"no-column-names"      , no_argument       , 0 ,  0  } ,
@@ -82,11 +98,19 @@ struct option long_opts[] = {
   {"no-term-resolver"     , no_argument       , 0 , 'r' } ,
   {"output-format"        , required_argument , 0 , 'o' } ,
   {"real-os"              , no_argument       , 0 ,  0  } ,
+  {"record-cache"         , required_argument , 0 ,  0  } ,
+  {"report-interval"      , required_argument , 0 ,  0  } ,
+  {"ship-interval"        , required_argument , 0 ,  0  } ,
+  {"ship-to"              , required_argument , 0 ,  0  } ,
+  {"slowest-requests"     , required_argument , 0 ,  0  } ,
+  {"snapshot-file"        , required_argument , 0 ,  0  } ,
   {"sort-panel"           , required_argument , 0 ,  0  } ,
   {"static-file"          , required_argument , 0 ,  0  } ,
   {"storage"              , no_argument       , 0 , 's' } ,
   {"dcf"                  , no_argument       , 0 ,  0  } ,
+  {"threads"              , required_argument , 0 ,  0  } ,
   {"time-format"          , required_argument , 0 ,  0  } ,
+  {"vhost-reports"        , required_argument , 0 ,  0  } ,
   {"with-mouse"           , no_argument       , 0 , 'm' } ,
   {"with-output-resolver" , no_argument       , 0 , 'd' } ,
 #ifdef HAVE_LIBGEOIP
@@ -94,6 +118,10 @@ struct option long_opts[] = {
   {"geoip-database"       , required_argument , 0 ,  0  } ,
   {"geoip-city-data"      , required_argument , 0 ,  0  } ,
 #endif
+#ifdef HAVE_GEOTABLE
+  {"geoip-table"          , required_argument , 0 ,  0  } ,
+  {"geoip-table-compile"  , required_argument , 0 ,  0  } ,
+#endif
 #ifdef TCB_BTREE
   {"cache-lcnum"          , required_argument , 0 ,  0  } ,
   {"cache-ncnum"          , required_argument , 0 ,  0  } ,
@@ -151,10 +179,19 @@ cmd_help (void)
   "  -l --debug-file=<filename>      - Send all debug messages to the specified\n"
   "                                    file.\n"
   "  -p --config-file=<filename>     - Custom configuration file.\n"
+  "  --daily-reports=<dir>           - Write one report per day into the\n"
+  "                                    given directory.\n"
+  "  --flush-daily                   - Write and free each day as soon as the\n"
+  "                                    log moves past it. Requires a time\n"
+  "                                    ordered log.\n"
   "  --invalid-requests=<filename>   - Log invalid requests to the specified\n"
   "                                    file.\n"
+  "  --invalid-requests-sample=<num> - Log one out of every num invalid\n"
+  "                                    requests of each reason.\n"
   "  --no-global-config              - Don't load global configuration\n"
-  "                                    file.\n\n"
+  "                                    file.\n"
+  "  --vhost-reports=<dir>           - Write one report per virtual host (%%v)\n"
+  "                                    into the given directory.\n\n"
 
   /* Parse Options */
   "Parse Options\n\n"
@@ -173,21 +210,60 @@ cmd_help (void)
   "                                    404.\n"
   "  --4xx-to-unique-count           - Add 4xx client errors to the unique\n"
   "                                    visitors count.\n"
+  "  --aggregate=<socket>            - Merge the deltas shipped by agents to\n"
+  "                                    the given Unix socket.\n"
   "  --all-static-files              - Include static files with a query\n"
   "                                    string.\n"
+  "  --custom-panel=<def>            - Add a panel keyed by a rule over a\n"
+  "                                    field, as NAME,FIELD,RULE,ARG. e.g.,\n"
+  "                                    'API,path,segment,2'. Up to 3.\n"
   "  --double-decode                 - Decode double-encoded values.\n"
+  "  --drop-page-cache               - Drop the log from the page cache as it\n"
+  "                                    is read.\n"
+  "  --filter=<expr>                 - Only parse the requests matching the\n"
+  "                                    given expression. e.g.,\n"
+  "                                    'vhost=api and status>=500'. See\n"
+  "                                    manpage for its fields and operators.\n"
+  "  --host-children=<num>           - Display the given number of most\n"
+  "                                    frequent IPs under each host prefix.\n"
+  "  --host-prefix=<v4>[,<v6>]       - Aggregate hosts by network prefix\n"
+  "                                    length. e.g., 24,64\n"
   "  --ignore-crawlers               - Ignore crawlers.\n"
+  "  --ignore-metric=PANEL,METRIC    - Do not track the given metric on a panel.\n"
+  "                                    e.g., STATUS_CODES,VISITORS. Metrics are\n"
+  "                                    VISITORS, BW, TS, METHOD and PROTOCOL.\n"
   "  --ignore-panel=<PANEL>          - Ignore parsing/displaying the given panel.\n"
   "  --ignore-referer=<NEEDLE>       - Ignore a referer from being counted.\n"
   "                                    Wild cards are allowed. i.e., *.bing.com\n"
   "  --ignore-status=<CODE>          - Ignore parsing the given status code.\n"
+  "  --max-cpu=<percent>             - Pace parsing to use at most the given\n"
+  "                                    share of a CPU. e.g., 25\n"
+  "  --max-read-rate=<MB/s>          - Pace reading the log to at most the\n"
+  "                                    given rate. e.g., 20\n"
   "  --real-os                       - Display real OS names. e.g, Windows XP,\n"
   "                                    Snow Leopard.\n"
+  "  --record-cache=<path>           - Cache the parsed records of the log in\n"
+  "                                    the given file, later runs on the same\n"
+  "                                    log read them instead of parsing it.\n"
+  "  --report-interval=<secs>        - Follow the log, writing the report to\n"
+  "                                    --snapshot-file every given seconds.\n"
+  "  --ship-interval=<secs>          - Seconds between shipped deltas.\n"
+  "                                    Default is 5.\n"
+  "  --ship-to=<socket>              - Run as an agent, shipping deltas to the\n"
+  "                                    aggregator on the given Unix socket.\n"
+  "  --slowest-requests=<num>[,<keys>]\n"
+  "                                  - Keep the given number of slowest\n"
+  "                                    requests of the most requested keys.\n"
+  "  --snapshot-file=<path>          - Write a report to the given file on\n"
+  "                                    SIGUSR1, while parsing carries on.\n"
   "  --sort-panel=PANEL,METRIC,ORDER - Sort panel on initial load. For example:\n"
   "                                    --sort-panel=VISITORS,BY_HITS,ASC. See\n"
   "                                    manpage for a list of panels/fields.\n"
   "  --static-file=<extension>       - Add static file extension. e.g.: .mp3.\n"
-  "                                    Extensions are case sensitive.\n\n"
+  "                                    Extensions are case sensitive.\n"
+  "  --threads=<num>                 - Threads parsing, building panels and\n"
+  "                                    resolving. Default is the CPUs\n"
+  "                                    available, cgroup quota included.\n\n"
 
 /* GeoIP Options */
 #ifdef HAVE_LIBGEOIP
@@ -197,6 +273,13 @@ cmd_help (void)
   "  --geoip-database=<path>         - Specify path to GeoIP database file.\n"
   "                                    i.e., GeoLiteCity.dat, GeoIPv6.dat ...\n\n"
 #endif
+#ifdef HAVE_GEOTABLE
+  "GeoIP Options\n\n"
+  "  --geoip-table=<path>            - Specify path to a compiled IP range\n"
+  "                                    table file.\n"
+  "  --geoip-table-compile=<csv>     - Compile the given CSV of IP ranges into\n"
+  "                                    the file given by --geoip-table.\n\n"
+#endif
 
 /* On-Disk Database Options */
 #ifdef TCB_BTREE
@@ -277,6 +360,7 @@ verify_global_config (int argc, char **argv)
 void
 read_option_args (int argc, char **argv)
 {
+  char *end = NULL;
   int o, idx = 0;
 
 #ifdef HAVE_LIBGEOIP
@@ -375,6 +459,32 @@ read_option_args (int argc, char **argv)
         invalid_log_open (conf.invalid_requests_log);
       }
 
+      /* filter expression */
+      if (!strcmp ("filter", long_opts[idx].name))
+        conf.filter = optarg;
+
+      /* record cache */
+      if (!strcmp ("record-cache", long_opts[idx].name))
+        conf.record_cache = optarg;
+
+      /* periodic report while following the log */
+      if (!strcmp ("report-interval", long_opts[idx].name)) {
+        conf.report_interval = atoi (optarg);
+        if (conf.report_interval < 1)
+          FATAL ("--report-interval expects a positive number of seconds.");
+      }
+
+      /* report snapshot on SIGUSR1 */
+      if (!strcmp ("snapshot-file", long_opts[idx].name))
+        conf.snapshot_file = optarg;
+
+      /* sample invalid requests */
+      if (!strcmp ("invalid-requests-sample", long_opts[idx].name)) {
+        conf.invalid_requests_sample = atoi (optarg);
+        if (conf.invalid_requests_sample <= 0)
+          FATAL ("--invalid-requests-sample expects a positive number.");
+      }
+
       /* static file */
       if (!strcmp ("static-file", long_opts[idx].name) &&
           conf.static_file_idx < MAX_EXTENSIONS) {
@@ -386,6 +496,18 @@ read_option_args (int argc, char **argv)
       if (!strcmp ("4xx-to-unique-count", long_opts[idx].name))
         conf.client_err_to_unique_count = 1;
 
+      /* one report per day */
+      if (!strcmp ("daily-reports", long_opts[idx].name))
+        conf.daily_reports_dir = optarg;
+
+      /* flush each day once the log moves past it */
+      if (!strcmp ("flush-daily", long_opts[idx].name))
+        conf.flush_daily = 1;
+
+      /* one report per virtual host */
+      if (!strcmp ("vhost-reports", long_opts[idx].name))
+        conf.vhost_reports_dir = optarg;
+
       /* html report title */
       if (!strcmp ("html-report-title", long_opts[idx].name))
         conf.html_report_title = optarg;
@@ -402,6 +524,32 @@ read_option_args (int argc, char **argv)
       if (!strcmp ("ignore-crawlers", long_opts[idx].name))
         conf.ignore_crawlers = 1;
 
+      /* aggregate hosts by network prefix, e.g., 24,64 */
+      if (!strcmp ("host-prefix", long_opts[idx].name)) {
+        conf.host_prefix6 = 0;
+        if (sscanf (optarg, "%d,%d", &conf.host_prefix4,
+                    &conf.host_prefix6) < 1 || conf.host_prefix4 < 0 ||
+            conf.host_prefix4 > 32 || conf.host_prefix6 < 0 ||
+            conf.host_prefix6 > 128)
+          FATAL ("--host-prefix expects an IPv4 and an IPv6 prefix length.");
+      }
+
+      /* most frequent IPs kept under each host prefix */
+      if (!strcmp ("host-children", long_opts[idx].name)) {
+        conf.host_children = atoi (optarg);
+        if (conf.host_children < 0)
+          FATAL ("--host-children expects a positive number.");
+      }
+
+      /* slowest requests kept per request, e.g., 5,100 */
+      if (!strcmp ("slowest-requests", long_opts[idx].name)) {
+        conf.slowest_keys = MAX_CHOICES;
+        if (sscanf (optarg, "%d,%d", &conf.slowest_requests,
+                    &conf.slowest_keys) < 1 || conf.slowest_requests < 0 ||
+            conf.slowest_keys < 1)
+          FATAL ("--slowest-requests expects a number of requests and keys.");
+      }
+
       /* ignore status code */
       if (!strcmp ("ignore-status", long_opts[idx].name) &&
           conf.ignore_status_idx < MAX_IGNORE_STATUS) {
@@ -409,6 +557,18 @@ read_option_args (int argc, char **argv)
           conf.ignore_status[conf.ignore_status_idx++] = optarg;
       }
 
+      /* user-defined panel */
+      if (!strcmp ("custom-panel", long_opts[idx].name)) {
+        if (conf.custom_panel_idx >= MAX_CUSTOM_PANELS)
+          FATAL ("At most %d --custom-panel can be given.", MAX_CUSTOM_PANELS);
+        conf.custom_panels[conf.custom_panel_idx++] = optarg;
+      }
+
+      /* ignore metric */
+      if (!strcmp ("ignore-metric", long_opts[idx].name) &&
+          conf.ignore_metric_idx < MAX_IGNORE_METRICS)
+        conf.ignore_metrics[conf.ignore_metric_idx++] = optarg;
+
       /* ignore panel */
       if (!strcmp ("ignore-panel", long_opts[idx].name) &&
           conf.ignore_panel_idx < TOTAL_MODULES) {
@@ -426,14 +586,54 @@ read_option_args (int argc, char **argv)
           conf.sort_panel_idx < TOTAL_MODULES)
         conf.sort_panels[conf.sort_panel_idx++] = optarg;
 
+      /* max CPU share while parsing */
+      if (!strcmp ("max-cpu", long_opts[idx].name)) {
+        conf.max_cpu = atoi (optarg);
+        if (conf.max_cpu < 1 || conf.max_cpu > 100)
+          FATAL ("--max-cpu expects a percentage between 1 and 100.");
+      }
+
+      /* worker threads */
+      if (!strcmp ("threads", long_opts[idx].name)) {
+        conf.threads = atoi (optarg);
+        if (conf.threads <= 0)
+          FATAL ("--threads expects a number of threads.");
+      }
+
+      /* max read rate */
+      if (!strcmp ("max-read-rate", long_opts[idx].name)) {
+        conf.max_read_rate = strtod (optarg, &end);
+        if (end == optarg || *end != '\0' || !(conf.max_read_rate > 0))
+          FATAL ("--max-read-rate expects a positive rate in MB/s.");
+      }
+
       /* real os */
       if (!strcmp ("real-os", long_opts[idx].name))
         conf.real_os = 1;
 
+      /* merge the deltas shipped by agents */
+      if (!strcmp ("aggregate", long_opts[idx].name))
+        conf.aggregate_socket = optarg;
+
+      /* ship deltas to an aggregator */
+      if (!strcmp ("ship-to", long_opts[idx].name))
+        conf.ship_to = optarg;
+
+      /* seconds between shipped deltas */
+      if (!strcmp ("ship-interval", long_opts[idx].name)) {
+        conf.ship_interval = atoi (optarg);
+        if (conf.ship_interval <= 0)
+          FATAL ("--ship-interval expects a number of seconds.");
+      }
+
       /* double decode */
       if (!strcmp ("double-decode", long_opts[idx].name))
         conf.double_decode = 1;
 
+      /* drop the log from the page cache */
+      if (!strcmp ("drop-page-cache", long_opts[idx].name))
+        conf.drop_page_cache = 1;
+
       /* no color */
       if (!strcmp ("no-color", long_opts[idx].name))
         conf.no_color = 1;
@@ -459,6 +659,16 @@ read_option_args (int argc, char **argv)
           !strcmp ("geoip-database", long_opts[idx].name))
         conf.geoip_database = optarg;
 
+#ifdef HAVE_GEOTABLE
+      /* specifies the path of the compiled IP range table */
+      if (!strcmp ("geoip-table", long_opts[idx].name))
+        conf.geoip_table = optarg;
+
+      /* compile a CSV of IP ranges into the IP range table */
+      if (!strcmp ("geoip-table-compile", long_opts[idx].name))
+        conf.geoip_table_csv = optarg;
+#endif
+
       /* load data from disk */
       if (!strcmp ("load-from-disk", long_opts[idx].name))
         conf.load_from_disk = 1;
@@ -526,4 +736,13 @@ read_option_args (int argc, char **argv)
 
   for (idx = optind; idx < argc; idx++)
     cmd_help ();
+
+#ifdef HAVE_GEOTABLE
+  if (conf.geoip_table_csv != NULL) {
+    if (conf.geoip_table == NULL)
+      FATAL ("--geoip-table-compile requires --geoip-table=<path>");
+    geotable_compile (conf.geoip_table_csv, conf.geoip_table);
+    exit (EXIT_SUCCESS);
+  }
+#endif
 }
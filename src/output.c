@@ -24,6 +24,7 @@
 #define _FILE_OFFSET_BITS 64
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,6 +44,7 @@
 
 #include "error.h"
 #include "settings.h"
+#include "ship.h"
 #include "ui.h"
 #include "util.h"
 #include "xmalloc.h"
@@ -76,10 +78,13 @@ static GPanel paneling[] = {
   {REFERRERS       , print_html_data , NULL    , NULL  } ,
   {REFERRING_SITES , print_html_data , NULL    , NULL  } ,
   {KEYPHRASES      , print_html_data , NULL    , NULL  } ,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION    , print_html_data , NULL    , NULL  } ,
 #endif
   {STATUS_CODES    , print_html_data , NULL    , NULL  } ,
+  {CUSTOM_1        , print_html_data , NULL    , CUSTM_LABEL} ,
+  {CUSTOM_2        , print_html_data , NULL    , CUSTM_LABEL} ,
+  {CUSTOM_3        , print_html_data , NULL    , CUSTM_LABEL} ,
 };
 
 /* base64 icons */
@@ -977,6 +982,8 @@ get_max_hit (GHolder * h)
 static void
 print_pure_menu (FILE * fp, char *now)
 {
+  GModule module;
+
   fprintf (fp, "<div id=\"menu\" class=\"pure-u\">");
   fprintf (fp, "<div class=\"pure-menu pure-menu-open\">");
   fprintf (fp, "<a class=\"pure-menu-heading\" href=\"%s\">", GO_WEBSITE);
@@ -998,10 +1005,17 @@ print_pure_menu (FILE * fp, char *now)
   fprintf (fp, "<li><a href=\"#%s\">Referring sites</a></li>", SITES_ID);
   if (!ignore_panel (KEYPHRASES))
     fprintf (fp, "<li><a href=\"#%s\">Keyphrases</a></li>", KEYPH_ID);
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   fprintf (fp, "<li><a href=\"#%s\">Geo Location</a></li>", GEOLO_ID);
 #endif
   fprintf (fp, "<li><a href=\"#%s\">Status codes</a></li>", CODES_ID);
+  for (module = CUSTOM_1; module < TOTAL_MODULES; module++) {
+    if (get_module_index (module) == -1)
+      continue;
+    fprintf (fp, "<li><a href=\"#%s\">", module_to_id (module));
+    clean_output (fp, (char *) module_to_head (module));
+    fprintf (fp, "</a></li>");
+  }
   fprintf (fp, "<li class=\"menu-item-divided\"></li>");
 
   fprintf (fp, "</ul>");
@@ -1179,7 +1193,14 @@ print_graph (FILE * fp, int max_hit, int max_vis, int hits, int visitors)
 static void
 print_table_head (FILE * fp, GModule module)
 {
-  print_html_h2 (fp, module_to_head (module), module_to_id (module));
+  /* the head of a user-defined panel is its name, escape it */
+  if (IS_CUSTOM_MODULE (module)) {
+    fprintf (fp, "<h2 id=\"%s\">", module_to_id (module));
+    clean_output (fp, (char *) module_to_head (module));
+    fprintf (fp, "</h2>");
+  } else {
+    print_html_h2 (fp, module_to_head (module), module_to_id (module));
+  }
   print_p (fp, module_to_desc (module));
 }
 
@@ -1601,7 +1622,7 @@ print_html_summary (FILE * fp, GLog * logger)
   fprintf (fp, "<h3 class='label trunc'>%lld secs</h3>", t);
   print_html_end_col_wrap (fp);
 
-  total = ht_get_size_uniqmap (VISITORS);
+  total = ht_get_size_uniqmap (VISITORS) + aggr_visitors ();
   print_html_begin_col_wrap (fp, 6, "blue");
   print_html_col_title (fp, T_UNIQUE_VIS);
   fprintf (fp, "<h3 class='label trunc'>%'d</h3>", total);
@@ -1680,9 +1701,11 @@ print_html_summary (FILE * fp, GLog * logger)
   free (size);
 }
 
-/* entry point to generate a report writing it to the fp */
+/* entry point to generate a report writing it to the fp
+ *
+ * If no filename is given, the report is written to stdout. */
 void
-output_html (GLog * logger, GHolder * holder)
+output_html (GLog * logger, GHolder * holder, const char *filename)
 {
   GModule module;
   FILE *fp = stdout;
@@ -1691,6 +1714,9 @@ output_html (GLog * logger, GHolder * holder)
   const GPanel *panel;
   size_t idx = 0;
 
+  if (filename != NULL && (fp = fopen (filename, "w")) == NULL)
+    FATAL ("Unable to open report file %s. %s", filename, strerror (errno));
+
   generate_time ();
   strftime (now, DATE_TIME, "%Y-%m-%d %H:%M:%S", now_tm);
 
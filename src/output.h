@@ -136,6 +136,6 @@
  "TavyPO8yx3FaCCFvaq2f6+rq+kT+u+OUKVOwb98+zJ07d6LWum7nzp1bL7vsMmzYsGHswo9hDP9R" \
  "8H8BM/XVggoDbGIAAAAASUVORK5CYII="
 
-void output_html (GLog * logger, GHolder * holder);
+void output_html (GLog * logger, GHolder * holder, const char *filename);
 
 #endif
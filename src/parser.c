@@ -31,6 +31,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -44,6 +45,7 @@
 #include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef HAVE_LIBTOKYOCABINET
@@ -53,16 +55,19 @@
 #include "gkhash.h"
 #endif
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 #include "geolocation.h"
 #endif
 
 #include "parser.h"
 
 #include "browsers.h"
+#include "custom.h"
 #include "goaccess.h"
 #include "error.h"
+#include "filter.h"
 #include "opesys.h"
+#include "reccache.h"
 #include "util.h"
 #include "xmalloc.h"
 
@@ -72,6 +77,9 @@
 static int gen_visitor_key (GKeyData * kdata, GLogItem * glog);
 static int gen_404_key (GKeyData * kdata, GLogItem * glog);
 static int gen_browser_key (GKeyData * kdata, GLogItem * glog);
+static int gen_custom1_key (GKeyData * kdata, GLogItem * glog);
+static int gen_custom2_key (GKeyData * kdata, GLogItem * glog);
+static int gen_custom3_key (GKeyData * kdata, GLogItem * glog);
 static int gen_host_key (GKeyData * kdata, GLogItem * glog);
 static int gen_keyphrase_key (GKeyData * kdata, GLogItem * glog);
 static int gen_os_key (GKeyData * kdata, GLogItem * glog);
@@ -82,7 +90,7 @@ static int gen_request_key (GKeyData * kdata, GLogItem * glog);
 static int gen_static_request_key (GKeyData * kdata, GLogItem * glog);
 static int gen_status_code_key (GKeyData * kdata, GLogItem * glog);
 static int gen_visit_time_key (GKeyData * kdata, GLogItem * glog);
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 static int gen_geolocation_key (GKeyData * kdata, GLogItem * glog);
 #endif
 
@@ -99,6 +107,7 @@ static void insert_maxts (int data_nkey, uint64_t ts, GModule module);
 static void insert_method (int data_nkey, const char *method, GModule module);
 static void insert_protocol (int data_nkey, const char *proto, GModule module);
 static void insert_agent (int data_nkey, int agent_nkey, GModule module);
+static void insert_child (int data_nkey, const char *child, GModule module);
 
 /* *INDENT-OFF* */
 static GParse paneling[] = {
@@ -233,7 +242,7 @@ static GParse paneling[] = {
     NULL,
     NULL,
   },
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {
     GEO_LOCATION,
     gen_geolocation_key,
@@ -288,10 +297,79 @@ static GParse paneling[] = {
     NULL,
     NULL,
     NULL,
+  }, {
+    CUSTOM_1,
+    gen_custom1_key,
+    insert_data,
+    NULL,
+    insert_hit,
+    insert_visitor,
+    insert_bw,
+    insert_cumts,
+    insert_maxts,
+    NULL,
+    NULL,
+    NULL,
+  }, {
+    CUSTOM_2,
+    gen_custom2_key,
+    insert_data,
+    NULL,
+    insert_hit,
+    insert_visitor,
+    insert_bw,
+    insert_cumts,
+    insert_maxts,
+    NULL,
+    NULL,
+    NULL,
+  }, {
+    CUSTOM_3,
+    gen_custom3_key,
+    insert_data,
+    NULL,
+    insert_hit,
+    insert_visitor,
+    insert_bw,
+    insert_cumts,
+    insert_maxts,
+    NULL,
+    NULL,
+    NULL,
   },
 };
 /* *INDENT-ON* */
 
+/* Pacing state of the log reader, see pace_log() */
+typedef struct GPace_
+{
+  struct timespec wall;         /* last check, monotonic */
+  struct timespec cpu;          /* last check, process CPU time */
+  uint64_t bytes;               /* bytes read since last check */
+  unsigned int lines;           /* lines read since last check */
+  unsigned int batch;           /* lines between checks */
+} GPace;
+
+static GPace pace = {.batch = 1 };
+
+/* Compiled --filter expression, if any */
+static GFilter *log_filter = NULL;
+/* sidecar of parsed records, see --record-cache */
+static GRecCache *rec_cache = NULL;
+
+/* invalid lines per reason, see count_invalid() */
+static GInvalidReason invalid_reasons[INVALID_REASONS];
+
+#ifdef HAVE_POSIX_FADVISE
+/* bytes of the log read so far, and dropped from the page cache */
+static off_t log_read_bytes = 0;
+static off_t log_dropped_bytes = 0;
+#endif
+
+/* lines read ahead, parsed by the worker pool, see queue_line() */
+static GParseBatch parse_batches[2];
+static int parse_cur = 0;
+
 /* Initialize a new GKeyData instance */
 static void
 new_modulekey (GKeyData * kdata)
@@ -300,9 +378,11 @@ new_modulekey (GKeyData * kdata)
     .data = NULL,
     .data_key = NULL,
     .data_nkey = 0,
+    .data_hash = 0,
     .root = NULL,
     .root_key = NULL,
     .root_nkey = 0,
+    .root_hash = 0,
     .uniq_key = NULL,
     .uniq_nkey = 0,
   };
@@ -325,6 +405,82 @@ panel_lookup (GModule module)
   return NULL;
 }
 
+/* Determine if parsed lines are being written to the record cache.
+ *
+ * If not writing, 0 is returned.
+ * If writing, 1 is returned. */
+static int
+writing_records (void)
+{
+  return rec_cache != NULL && rec_cache->writing;
+}
+
+/* Free the compiled --filter expression */
+void
+free_log_filter (void)
+{
+  filter_free (log_filter);
+  log_filter = NULL;
+}
+
+/* Stop tracking the given metric on the given panel, i.e., null out
+ * its parsing callback and don't allocate its storage.
+ *
+ * On error, FATAL is triggered. */
+static void
+ignore_panel_metric (GParse * parse, const char *metric)
+{
+  GModule module = parse->module;
+
+  if (!strcmp ("VISITORS", metric)) {
+    /* the overall unique visitors count comes from this panel */
+    if (module == VISITORS)
+      FATAL ("Unique visitors cannot be ignored on the VISITORS panel.");
+    parse->visitor = NULL;
+    ht_ignore_metric (module, MTRC_UNIQMAP);
+    ht_ignore_metric (module, MTRC_VISITORS);
+  } else if (!strcmp ("BW", metric)) {
+    parse->bw = NULL;
+    ht_ignore_metric (module, MTRC_BW);
+  } else if (!strcmp ("TS", metric)) {
+    parse->cumts = NULL;
+    parse->maxts = NULL;
+    ht_ignore_metric (module, MTRC_CUMTS);
+    ht_ignore_metric (module, MTRC_MAXTS);
+  } else if (!strcmp ("METHOD", metric)) {
+    parse->method = NULL;
+    ht_ignore_metric (module, MTRC_METHODS);
+  } else if (!strcmp ("PROTOCOL", metric)) {
+    parse->protocol = NULL;
+    ht_ignore_metric (module, MTRC_PROTOCOLS);
+  } else {
+    FATAL ("Invalid metric for --ignore-metric: %s", metric);
+  }
+}
+
+/* Apply all --ignore-metric=PANEL,METRIC options. It must be called
+ * before the storage is initialized.
+ *
+ * On error, FATAL is triggered. */
+void
+set_panel_metrics (void)
+{
+  GParse *parse = NULL;
+  char panel[IGNORE_METRIC_LEN], metric[IGNORE_METRIC_LEN];
+  int i, module;
+
+  for (i = 0; i < conf.ignore_metric_idx; ++i) {
+    if (sscanf (conf.ignore_metrics[i], "%31[^,],%31s", panel, metric) != 2)
+      FATAL ("Invalid --ignore-metric: %s", conf.ignore_metrics[i]);
+    if ((module = get_module_enum (panel)) == -1)
+      FATAL ("Invalid panel for --ignore-metric: %s", panel);
+    /* e.g., GEO_LOCATION when built without geolocation */
+    if (!(parse = panel_lookup (module)))
+      continue;
+    ignore_panel_metric (parse, metric);
+  }
+}
+
 /* Allocate memory for a new GRawData instance.
  *
  * On success, the newly allocated GRawData is returned . */
@@ -377,15 +533,14 @@ init_log (void)
   return glog;
 }
 
-/* Initialize a new GLogItem instance.
+/* Allocate a new GLogItem instance, not tied to a logger, e.g., for a
+ * line parsed by a worker.
  *
  * On success, the new GLogItem instance is returned. */
 GLogItem *
-init_log_item (GLog * logger)
+new_log_item (void)
 {
-  GLogItem *glog;
-  logger->items = xmalloc (sizeof (GLogItem));
-  glog = logger->items;
+  GLogItem *glog = xmalloc (sizeof (GLogItem));
   memset (glog, 0, sizeof *glog);
 
   glog->agent = NULL;
@@ -394,7 +549,9 @@ init_log_item (GLog * logger)
   glog->continent = NULL;
   glog->country = NULL;
   glog->date = NULL;
+  glog->extra = NULL;
   glog->host = NULL;
+  glog->host_prefix = NULL;
   glog->keyphrase = NULL;
   glog->method = NULL;
   glog->os = NULL;
@@ -418,10 +575,22 @@ init_log_item (GLog * logger)
   return glog;
 }
 
+/* Initialize a new GLogItem instance.
+ *
+ * On success, the new GLogItem instance is returned. */
+GLogItem *
+init_log_item (GLog * logger)
+{
+  logger->items = new_log_item ();
+  return logger->items;
+}
+
 /* Free all members of a GLogItem */
 static void
 free_logger (GLogItem * glog)
 {
+  int i;
+
   if (glog->agent != NULL)
     free (glog->agent);
   if (glog->browser != NULL)
@@ -434,8 +603,12 @@ free_logger (GLogItem * glog)
     free (glog->country);
   if (glog->date != NULL)
     free (glog->date);
+  if (glog->extra != NULL)
+    free (glog->extra);
   if (glog->host != NULL)
     free (glog->host);
+  if (glog->host_prefix != NULL)
+    free (glog->host_prefix);
   if (glog->keyphrase != NULL)
     free (glog->keyphrase);
   if (glog->method != NULL)
@@ -462,6 +635,8 @@ free_logger (GLogItem * glog)
     free (glog->uniq_key);
   if (glog->vhost != NULL)
     free (glog->vhost);
+  for (i = 0; i < MAX_CUSTOM_PANELS; i++)
+    free (glog->custom_keys[i]);
 
   free (glog);
 }
@@ -563,7 +738,7 @@ extract_keyphrase (char *ref, char **keyphrase)
   return 0;
 }
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 /* Extract geolocation for the given host.
  *
  * On error, 1 is returned.
@@ -572,7 +747,7 @@ extract_keyphrase (char *ref, char **keyphrase)
 static int
 extract_geolocation (GLogItem * glog, char *continent, char *country)
 {
-  if (geo_location_data == NULL)
+  if (!is_geoip_resource ())
     return 1;
 
   geoip_get_country (glog->host, country, glog->type_ip);
@@ -729,17 +904,26 @@ extract_method (const char *token)
   return NULL;
 }
 
+/* Raise a flag of the configuration. Lines may be parsed by several
+ * workers at once, hence the atomic access. */
+static void
+set_conf_flag (int *flag)
+{
+  if (!__atomic_load_n (flag, __ATOMIC_RELAXED))
+    __atomic_store_n (flag, 1, __ATOMIC_RELAXED);
+}
+
 /* Determine if time-served data was stored on-disk. */
 static void
 contains_usecs (void)
 {
-  if (conf.serve_usecs)
+  if (__atomic_load_n (&conf.serve_usecs, __ATOMIC_RELAXED))
     return;
 
 #ifdef TCB_BTREE
   ht_insert_genstats ("serve_usecs", 1);
 #endif
-  conf.serve_usecs = 1; /* flag */
+  set_conf_flag (&conf.serve_usecs);    /* flag */
 }
 
 /* Determine if the given token is a valid HTTP protocol.
@@ -1029,7 +1213,7 @@ parse_specifier (GLogItem * glog, char **str, const char *p)
     if (tkn == bEnd || *bEnd != '\0' || errno == ERANGE)
       bandw = 0;
     glog->resp_size = bandw;
-    conf.bandwidth = 1;
+    set_conf_flag (&conf.bandwidth);
     free (tkn);
     break;
     /* referrer */
@@ -1129,6 +1313,15 @@ parse_specifier (GLogItem * glog, char **str, const char *p)
     contains_usecs ();  /* set flag */
     free (tkn);
     break;
+    /* free-form field for user-defined panels, e.g., a cookie */
+  case 'C':
+    if (glog->extra)
+      return 1;
+    tkn = parse_string (&(*str), p[1], 1);
+    if (tkn == NULL)
+      return 1;
+    glog->extra = tkn;
+    break;
     /* move forward through str until not a space */
   case '~':
     find_alpha (&(*str));
@@ -1148,7 +1341,7 @@ parse_specifier (GLogItem * glog, char **str, const char *p)
  * On success, the malloc'd token is assigned to a GLogItem member and
  * 0 is returned. */
 static int
-parse_format (GLogItem * glog, char *str)
+parse_format (GLogItem * glog, char *str, int test)
 {
   const char *p;
   const char *lfmt = conf.log_format;
@@ -1168,12 +1361,23 @@ parse_format (GLogItem * glog, char *str)
         return 0;
 
       /* attempt to parse format specifiers */
-      if (parse_specifier (glog, &str, p) == 1)
+      if (parse_specifier (glog, &str, p) == 1) {
+        glog->errspec = (unsigned char) *p;
         return 1;
+      }
+      /* all filtered fields are in, skip the rest of a filtered line,
+       * unless the whole line is to be cached */
+      if (!test && log_filter && p == log_filter->ready &&
+          !filter_match (log_filter, glog)) {
+        glog->filtered = 1;
+        if (!writing_records ())
+          return 1;
+      }
       special = 0;
     } else if (special && isspace (p[0])) {
       return 1;
-    } else {
+    } else if (*str != '\0') {
+      /* never past the end of the line, what follows is not part of it */
       str++;
     }
   }
@@ -1236,19 +1440,156 @@ inc_resp_size (GLog * logger, uint64_t resp_size)
 #endif
 }
 
-/* Keep track of all invalid log strings. */
+/* Keep track of all invalid log strings. Those are aggregated by the
+ * reason they failed and, if sampling, only one out of every N lines
+ * of a reason is logged. */
 static void
-count_invalid (GLog * logger, const char *line, int test)
+tally_invalid (GLog * logger, const char *line, int reason, int test)
 {
+  GInvalidReason *inv = &invalid_reasons[reason & (INVALID_REASONS - 1)];
+  int sample = conf.invalid_requests_sample;
+
   logger->invalid++;
 #ifdef TCB_BTREE
   if (!test)
     ht_insert_genstats ("failed_requests", 1);
-#else
-  (void) test;
 #endif
-  if (conf.invalid_requests_log)
+  if (!conf.invalid_requests_log || test)
+    return;
+
+  if (inv->sample == NULL)
+    inv->sample = xstrdup (line ? line : "");
+  if (sample <= 1 || inv->lines % sample == 0)
     LOG_INVALID (("%s", line));
+  inv->lines++;
+}
+
+/* Keep track of an invalid log string, and cache it as such. */
+static void
+count_invalid (GLog * logger, const char *line, int reason, int test)
+{
+  if (!test && writing_records ())
+    reccache_put_invalid (rec_cache, line, reason);
+  tally_invalid (logger, line, reason, test);
+}
+
+/* Keep track of a parsed record dropped while storing it, e.g., one of
+ * a day already written. It is cached as a parsed record, thus only
+ * counted, and its line is no longer at hand, so the summary shows the
+ * record's host, date and request instead. */
+static void
+count_dropped (GLog * logger, GLogItem * glog, int reason)
+{
+  char sample[INVALID_SAMPLE + 1];
+
+  snprintf (sample, sizeof (sample), "%s [%s] %s\n", glog->host, glog->date,
+            glog->req);
+  tally_invalid (logger, sample, reason, 0);
+}
+
+/* Describe the reason lines were invalid. */
+static const char *
+invalid_reason_str (int reason)
+{
+  switch (reason) {
+  case INVALID_FORMAT:
+    return "log format mismatch";
+  case INVALID_EMPTY:
+    return "empty line or comment";
+  case INVALID_REQUIRED:
+    return "missing %h, %d or %r";
+  case INVALID_FLUSHED:
+    return "day already written";
+  case 'd':
+    return "%d date";
+  case 't':
+    return "%t time";
+  case 'x':
+    return "%x date/time";
+  case 'v':
+    return "%v virtual host";
+  case 'h':
+    return "%h host";
+  case 'm':
+    return "%m method";
+  case 'U':
+    return "%U request";
+  case 'q':
+    return "%q query string";
+  case 'H':
+    return "%H protocol";
+  case 'r':
+    return "%r request line";
+  case 's':
+    return "%s status code";
+  case 'b':
+    return "%b size";
+  case 'R':
+    return "%R referer";
+  case 'u':
+    return "%u user agent";
+  case 'L':
+    return "%L serve time (ms)";
+  case 'T':
+    return "%T serve time (s)";
+  case 'D':
+    return "%D serve time (us)";
+  case 'C':
+    return "%C custom field";
+  default:
+    return "other specifier";
+  }
+}
+
+/* Print a summary of the invalid lines aggregated by reason, the most
+ * frequent first, along with the first line that failed. */
+void
+print_invalid_summary (FILE * fp)
+{
+  GInvalidReason *inv;
+  uint64_t total = 0, max;
+  size_t len;
+  int i, r;
+  char done[INVALID_REASONS] = { 0 };
+
+  for (i = 0; i < INVALID_REASONS; i++)
+    total += invalid_reasons[i].lines;
+  if (total == 0)
+    return;
+
+  fprintf (fp, "Invalid requests: %llu\n", (unsigned long long) total);
+  fprintf (fp, "%12s  %-22s  %s\n", "Lines", "Reason", "First line");
+  while (1) {
+    /* only a handful of reasons are ever used, select the next one */
+    for (i = 0, r = -1, max = 0; i < INVALID_REASONS; i++) {
+      if (!done[i] && invalid_reasons[i].lines > max) {
+        max = invalid_reasons[i].lines;
+        r = i;
+      }
+    }
+    if (r == -1)
+      break;
+
+    done[r] = 1;
+    inv = &invalid_reasons[r];
+    if ((len = strcspn (inv->sample, "\r\n")) > INVALID_SAMPLE)
+      len = INVALID_SAMPLE;
+    fprintf (fp, "%12llu  %-22s  %.*s\n", (unsigned long long) inv->lines,
+             invalid_reason_str (r), (int) len, inv->sample);
+  }
+}
+
+/* Free the sample lines kept per invalid reason. */
+void
+free_invalid_reasons (void)
+{
+  int i;
+
+  for (i = 0; i < INVALID_REASONS; i++) {
+    free (invalid_reasons[i].sample);
+    invalid_reasons[i].sample = NULL;
+    invalid_reasons[i].lines = 0;
+  }
 }
 
 /* Keep track of all valid log strings. */
@@ -1281,6 +1622,15 @@ count_process (GLog * logger, int test)
   unlock_spinner ();
 }
 
+/* Keep track of the valid log strings of a storage partition. */
+static void
+count_partition (GLog * plog, GLogItem * glog)
+{
+  plog->processed++;
+  plog->valid++;
+  plog->resp_size += glog->resp_size;
+}
+
 /* Keep track of all excluded log strings (IPs).
  *
  * If IP not range, 1 is returned.
@@ -1357,13 +1707,20 @@ ignore_line (GLog * logger, GLogItem * glog, int test)
   if (ignore_status_code (glog->status))
     return 1;
 
-  /* check if we need to remove the request's query string */
-  if (conf.ignore_qstr)
-    strip_qstring (glog->req);
-
   return 0;
 }
 
+/* Extract the keys of the user-defined panels. This is done before the
+ * query string is stripped, so rules can still read its parameters. */
+static void
+set_custom_keys (GLogItem * glog)
+{
+  int i;
+
+  for (i = 0; i < conf.custom_panel_idx; i++)
+    glog->custom_keys[i] = custom_panel_key (i, glog);
+}
+
 /* A wrapper function to determine if the request is static.
  *
  * If the request is not static, 0 is returned.
@@ -1391,15 +1748,16 @@ is_404 (GLogItem * glog)
   return 0;
 }
 
-/* A wrapper function to insert a keymap string key.
+/* A wrapper function to insert a keymap string key along with its
+ * precomputed hash.
  *
  * If the given key exists, its value is returned.
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 static int
-insert_keymap (char *key, GModule module)
+insert_keymap (char *key, uint64_t hash, GModule module)
 {
-  return ht_insert_keymap (module, key);
+  return ht_insert_keymap (module, key, hash);
 }
 
 /* A wrapper function to insert a datamap int key and string value. */
@@ -1409,15 +1767,16 @@ insert_data (int nkey, const char *data, GModule module)
   ht_insert_datamap (module, nkey, data);
 }
 
-/* A wrapper function to insert a uniqmap string key.
+/* A wrapper function to mark a unique visitor int key as seen for a
+ * data int key.
  *
- * If the given key exists, 0 is returned.
+ * If the visitor was seen for the given key, 0 is returned.
  * On error, -1 is returned.
- * On success the value of the key inserted is returned */
+ * On success, i.e., a new visitor for the key, 1 is returned */
 static int
-insert_uniqmap (char *uniq_key, GModule module)
+insert_uniqmap (int data_nkey, int uniq_nkey, GModule module)
 {
-  return ht_insert_uniqmap (module, uniq_key);
+  return ht_insert_uniqmap (module, data_nkey, uniq_nkey);
 }
 
 /* A wrapper function to insert a rootmap int key from the keymap
@@ -1486,6 +1845,34 @@ insert_agent (int data_nkey, int agent_nkey, GModule module)
   ht_insert_agent (module, data_nkey, agent_nkey);
 }
 
+static void
+insert_child (int data_nkey, const char *child, GModule module)
+{
+  ht_insert_child (module, data_nkey, child,
+                   conf.host_children * CHILD_SKETCH_FACTOR);
+}
+
+/* Keep the request among the slowest of its data key. A timestamp is
+ * displayed as a date, other dates and times are kept as logged. */
+static void
+insert_slowest (int data_nkey, GLogItem * glog, GModule module)
+{
+  GSlowItem item;
+  const char *time = glog->time ? glog->time : "";
+
+  item.serve_time = glog->serve_time;
+  if (!has_timestamp (conf.time_format) ||
+      convert_date (item.when, time, conf.time_format, "%d/%b/%Y:%H:%M:%S",
+                    sizeof (item.when)) != 0)
+    snprintf (item.when, sizeof (item.when), "%s:%s", glog->date, time);
+  xstrncpy (item.host, glog->host, sizeof (item.host));
+  xstrncpy (item.status, glog->status ? glog->status : "-",
+            sizeof (item.status));
+
+  ht_insert_slowest (module, data_nkey, &item, conf.slowest_requests,
+                     conf.slowest_keys);
+}
+
 /* The following generates a unique key to identity unique visitors.
  * The key is made out of the IP, date, and user agent.
  * Note that for readability, doing a simple snprintf/sprintf should
@@ -1652,12 +2039,58 @@ gen_vhost_key (GKeyData * kdata, GLogItem * glog)
   return 0;
 }
 
+/* Generate the key of a user-defined panel from the key extracted by
+ * its rule.
+ *
+ * If no key was extracted, 1 is returned.
+ * On success, 0 is returned. */
+static int
+gen_custom_key (GKeyData * kdata, GLogItem * glog, int idx)
+{
+  char *key = glog->custom_keys[idx];
+
+  if (key == NULL)
+    return 1;
+
+  get_kdata (kdata, key, key);
+
+  return 0;
+}
+
+static int
+gen_custom1_key (GKeyData * kdata, GLogItem * glog)
+{
+  return gen_custom_key (kdata, glog, 0);
+}
+
+static int
+gen_custom2_key (GKeyData * kdata, GLogItem * glog)
+{
+  return gen_custom_key (kdata, glog, 1);
+}
+
+static int
+gen_custom3_key (GKeyData * kdata, GLogItem * glog)
+{
+  return gen_custom_key (kdata, glog, 2);
+}
+
 static int
 gen_host_key (GKeyData * kdata, GLogItem * glog)
 {
   if (!glog->host)
     return 1;
 
+  /* aggregate the host by its network prefix, e.g., 10.0.5.0/24 */
+  if (conf.host_prefix4 || conf.host_prefix6)
+    glog->host_prefix =
+      ip_to_prefix (glog->host, conf.host_prefix4, conf.host_prefix6);
+
+  if (glog->host_prefix) {
+    get_kdata (kdata, glog->host_prefix, glog->host_prefix);
+    return 0;
+  }
+
   get_kdata (kdata, glog->host, glog->host);
 
   return 0;
@@ -1672,9 +2105,13 @@ gen_browser_key (GKeyData * kdata, GLogItem * glog)
   if (glog->agent == NULL || *glog->agent == '\0')
     return 1;
 
-  agent = xstrdup (glog->agent);
-  glog->browser = verify_browser (agent, browser_type);
-  glog->browser_type = xstrdup (browser_type);
+  /* classified already if read from or written to the record cache */
+  if (glog->browser == NULL) {
+    agent = xstrdup (glog->agent);
+    glog->browser = verify_browser (agent, browser_type);
+    glog->browser_type = xstrdup (browser_type);
+    free (agent);
+  }
 
   /* e.g., Firefox 11.12 */
   kdata->data = glog->browser;
@@ -1684,8 +2121,6 @@ gen_browser_key (GKeyData * kdata, GLogItem * glog)
   kdata->root = glog->browser_type;
   kdata->root_key = glog->browser_type;
 
-  free (agent);
-
   return 0;
 }
 
@@ -1698,9 +2133,12 @@ gen_os_key (GKeyData * kdata, GLogItem * glog)
   if (glog->agent == NULL || *glog->agent == '\0')
     return 1;
 
-  agent = xstrdup (glog->agent);
-  glog->os = verify_os (agent, os_type);
-  glog->os_type = xstrdup (os_type);
+  if (glog->os == NULL) {
+    agent = xstrdup (glog->agent);
+    glog->os = verify_os (agent, os_type);
+    glog->os_type = xstrdup (os_type);
+    free (agent);
+  }
 
   /* e.g., Linux,Ubuntu 10.12 */
   kdata->data = glog->os;
@@ -1710,8 +2148,6 @@ gen_os_key (GKeyData * kdata, GLogItem * glog)
   kdata->root = glog->os_type;
   kdata->root_key = glog->os_type;
 
-  free (agent);
-
   return 0;
 }
 
@@ -1748,7 +2184,7 @@ gen_keyphrase_key (GKeyData * kdata, GLogItem * glog)
   return 0;
 }
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 static int
 gen_geolocation_key (GKeyData * kdata, GLogItem * glog)
 {
@@ -1875,33 +2311,41 @@ set_datamap (GLogItem * glog, GKeyData * kdata, const GParse * parse)
   /* insert agent */
   if (parse->agent && conf.list_agents)
     parse->agent (kdata->data_nkey, glog->agent_nkey, module);
+  /* insert the exact host under its network prefix */
+  if (module == HOSTS && glog->host_prefix && conf.host_children)
+    insert_child (kdata->data_nkey, glog->host, module);
+  /* keep the slowest requests of the most requested keys */
+  if (IS_SLOWEST_MODULE (module) && conf.slowest_requests && conf.serve_usecs)
+    insert_slowest (kdata->data_nkey, glog, module);
 }
 
 static void
 map_log (GLogItem * glog, const GParse * parse, GModule module)
 {
   GKeyData kdata;
-  char *uniq_key = NULL;
 
   new_modulekey (&kdata);
   if (parse->key_data (&kdata, glog) == 1)
     return;
 
-  /* each module requires a data key/value */
-  if (parse->datamap && kdata.data_key)
-    kdata.data_nkey = insert_keymap (kdata.data_key, module);
+  /* each module requires a data key/value, hash it once and let it
+   * travel along with the key */
+  if (parse->datamap && kdata.data_key) {
+    kdata.data_hash = str_hash64 (kdata.data_key);
+    kdata.data_nkey = insert_keymap (kdata.data_key, kdata.data_hash, module);
+  }
 
   /* each module contains a uniq visitor key/value */
   if (parse->visitor && glog->uniq_key && include_uniq (glog)) {
-    uniq_key = ints_to_str (glog->uniq_nkey, kdata.data_nkey);
-    /* unique key already exists? */
-    kdata.uniq_nkey = insert_uniqmap (uniq_key, module);
-    free (uniq_key);
+    /* visitor already seen for this data key? */
+    kdata.uniq_nkey = insert_uniqmap (kdata.data_nkey, glog->uniq_nkey, module);
   }
 
   /* root keys are optional */
-  if (parse->rootmap && kdata.root_key)
-    kdata.root_nkey = insert_keymap (kdata.root_key, module);
+  if (parse->rootmap && kdata.root_key) {
+    kdata.root_hash = str_hash64 (kdata.root_key);
+    kdata.root_nkey = insert_keymap (kdata.root_key, kdata.root_hash, module);
+  }
 
   /* each module requires a root key/value */
   if (parse->datamap && kdata.data_key)
@@ -1917,7 +2361,8 @@ process_log (GLogItem * glog)
 
   /* Insert one unique visitor key per request to avoid the
    * overhead of storing one key per module */
-  glog->uniq_nkey = ht_insert_unique_key (glog->uniq_key);
+  glog->uniq_nkey =
+    ht_insert_unique_key (glog->uniq_key, str_hash64 (glog->uniq_key));
 
   /* If we need to store user agents per IP, then we store them and retrieve
    * its numeric key.
@@ -1925,7 +2370,8 @@ process_log (GLogItem * glog)
    * map for value -> key*/
   if (conf.list_agents) {
     /* insert UA key and get a numeric value */
-    glog->agent_nkey = ht_insert_agent_key (glog->agent);
+    glog->agent_nkey =
+      ht_insert_agent_key (glog->agent, str_hash64 (glog->agent));
     /* insert a numeric key and map it to a UA string */
     ht_insert_agent_value (glog->agent_nkey, glog->agent);
   }
@@ -1938,72 +2384,468 @@ process_log (GLogItem * glog)
   }
 }
 
-/* process a line from the log and store it accordingly */
-static int
-pre_process_log (GLog * logger, char *line, int test)
+/* Build the key of the partition the given record belongs to, i.e.,
+ * its virtual host or its day.
+ *
+ * On error, or if not partitioning, NULL is returned.
+ * On success, a malloc'd key is returned. */
+static char *
+get_partition_key (GLogItem * glog)
 {
-  GLogItem *glog;
+  if (conf.vhost_reports_dir)
+    return xstrdup (glog->vhost ? glog->vhost : VHOST_UNKNOWN);
+  if (conf.daily_reports_dir && glog->date)
+    return get_visitors_date (glog->date, conf.date_format, "%Y-%m-%d");
+  return NULL;
+}
 
-  if (valid_line (line)) {
-    count_invalid (logger, line, test);
-    return 0;
+/* A new day partition was just created, keep it open and flush the
+ * oldest open day if more than DAILY_OPEN_DAYS are open. */
+static void
+flush_stale_days (int idx)
+{
+  static int open_days[DAILY_OPEN_DAYS + 1];
+  static int open_len = 0;
+  const char *oldest = NULL, *key = NULL;
+  int i, old = 0;
+
+  open_days[open_len++] = idx;
+  if (open_len <= DAILY_OPEN_DAYS)
+    return;
+
+  /* keys are %Y-%m-%d, thus they sort chronologically */
+  for (i = 0; i < open_len; i++) {
+    key = ht_get_partition_key (open_days[i]);
+    if (oldest == NULL || strcmp (key, oldest) < 0) {
+      oldest = key;
+      old = i;
+    }
   }
 
-  count_process (logger, test);
-  glog = init_log_item (logger);
-  /* parse a line of log, and fill structure with appropriate values */
-  if (parse_format (glog, line)) {
-    count_invalid (logger, line, test);
-    goto cleanup;
+  LOG_DEBUG (("Flushing day %s\n", oldest));
+  flush_partition (open_days[old]);
+  open_days[old] = open_days[--open_len];
+
+  /* make the new day the active storage again */
+  ht_set_partition (idx);
+}
+
+/* Switch the storage to the partition the given record belongs to,
+ * i.e., its virtual host or its day.
+ *
+ * On error, if not partitioning, or if the partition was already
+ * flushed, NULL is returned.
+ * On success the partition's logger is returned. */
+static GLog *
+switch_partition (GLogItem * glog)
+{
+  char *key = NULL;
+  int idx, len;
+
+  if ((key = get_partition_key (glog)) == NULL)
+    return NULL;
+
+  len = ht_get_partition_len ();
+  idx = ht_switch_partition (key, str_hash64 (key));
+  free (key);
+
+  if (idx < 0)
+    return NULL;
+
+  /* first record of a new day */
+  if (conf.flush_daily && conf.daily_reports_dir && idx == len)
+    flush_stale_days (idx);
+
+  return ht_get_partition_log (idx);
+}
+
+/* Store a parsed log item, unless it is ignored. */
+static void
+process_item (GLog * logger, GLogItem * glog)
+{
+  GLog *plog;
+
+  /* ignore line */
+  if (ignore_line (logger, glog, 0))
+    return;
+
+  set_custom_keys (glog);
+  /* check if we need to remove the request's query string */
+  if (conf.ignore_qstr)
+    strip_qstring (glog->req);
+
+  if (is_404 (glog))
+    glog->is_404 = 1;
+  else if (is_static (glog))
+    glog->is_static = 1;
+
+  glog->uniq_key = get_uniq_visitor_key (glog);
+
+  plog = switch_partition (glog);
+  /* it belongs to a day that has already been flushed */
+  if (plog == NULL && (conf.vhost_reports_dir || conf.daily_reports_dir)) {
+    count_dropped (logger, glog, INVALID_FLUSHED);
+    return;
   }
 
+  inc_resp_size (logger, glog->resp_size);
+  process_log (glog);
+  count_valid (logger, 0);
+  if (plog != NULL)
+    count_partition (plog, glog);
+}
+
+/* Parse a line of log into the given log item. Nothing else but a few
+ * flags raised atomically, e.g., conf.bandwidth, is touched, so lines
+ * can be parsed by the workers.
+ *
+ * On error, 1 is returned and the item's errspec is the reason, unless
+ * the item is flagged as filtered.
+ * On success, 0 is returned. */
+static int
+parse_line (GLogItem * glog, char *line, int test)
+{
+  /* parse a line of log, and fill structure with appropriate values */
+  if (parse_format (glog, line, test))
+    return 1;
+
   /* must have the following fields */
   if (glog->host == NULL || glog->date == NULL || glog->req == NULL) {
-    count_invalid (logger, line, test);
-    goto cleanup;
+    glog->errspec = INVALID_REQUIRED;
+    return 1;
   }
   /* agent will be null in cases where %u is not specified */
   if (glog->agent == NULL)
     glog->agent = alloc_string ("-");
 
+  return 0;
+}
+
+/* Count, cache and store a parsed line. Lines are stored in the order
+ * they were read. */
+static void
+store_line (GLog * logger, GLogItem * glog, char *line, int invalid,
+            int test)
+{
+  if (invalid) {
+    if (!glog->filtered)
+      count_invalid (logger, line, glog->errspec, test);
+    /* cached as is, the filter is evaluated again when read back */
+    else if (!test && writing_records ())
+      reccache_put_invalid (rec_cache, line, glog->errspec);
+    return;
+  }
+
   /* testing log only */
   if (test) {
     count_valid (logger, test);
-    goto cleanup;
+    return;
   }
 
-  /* ignore line */
-  if (ignore_line (logger, glog, test))
-    goto cleanup;
+  /* cache the parsed line, filtering it was deferred until now */
+  if (writing_records ()) {
+    reccache_put_item (rec_cache, glog);
+    if (log_filter && !filter_match (log_filter, glog))
+      return;
+  }
 
-  if (is_404 (glog))
-    glog->is_404 = 1;
-  else if (is_static (glog))
-    glog->is_static = 1;
+  process_item (logger, glog);
+}
 
-  glog->uniq_key = get_uniq_visitor_key (glog);
+/* process a line from the log and store it accordingly */
+static int
+pre_process_log (GLog * logger, char *line, int test)
+{
+  GLogItem *glog;
+  int invalid = 0;
 
-  inc_resp_size (logger, glog->resp_size);
-  process_log (glog);
-  count_valid (logger, test);
+  /* the previous line is fully processed */
+  if (snapshot_pending && !test)
+    take_snapshot (logger);
 
-cleanup:
+  if (valid_line (line)) {
+    count_invalid (logger, line, INVALID_EMPTY, test);
+    return 0;
+  }
+
+  count_process (logger, test);
+  glog = init_log_item (logger);
+  invalid = parse_line (glog, line, test);
+  store_line (logger, glog, line, invalid, test);
   free_logger (glog);
 
   return 0;
 }
 
+/* Parse a run of lines, as a task of the worker pool. */
+static void
+parse_chunk_task (void *arg)
+{
+  GParseChunk *chunk = arg;
+  GParsedLine *pl;
+  int i;
+
+  for (i = 0; i < chunk->len; i++) {
+    pl = &chunk->lines[i];
+    if (valid_line (pl->line))
+      continue;
+    pl->glog = new_log_item ();
+    pl->invalid = parse_line (pl->glog, pl->line, 0);
+  }
+}
+
+/* Hand a batch of lines to the worker pool, in chunks. */
+static void
+parse_batch (GParseBatch * batch)
+{
+  GParseChunk *chunk;
+  int i, n = 0;
+
+  for (i = 0; i < batch->len; i += PARSE_CHUNK_LINES) {
+    chunk = &batch->chunks[n++];
+    chunk->lines = batch->lines + i;
+    chunk->len = batch->len - i;
+    if (chunk->len > PARSE_CHUNK_LINES)
+      chunk->len = PARSE_CHUNK_LINES;
+    wpool_submit (&batch->grp, parse_chunk_task, chunk);
+  }
+}
+
+/* Wait for a batch to be parsed, then store its lines in order. The
+ * storage is only ever modified here, by the reader. */
+static void
+store_batch (GLog * logger, GParseBatch * batch)
+{
+  GParsedLine *pl;
+  int i;
+
+  wpool_wait (&batch->grp);
+  for (i = 0; i < batch->len; i++) {
+    pl = &batch->lines[i];
+    /* the previous line is fully processed */
+    if (snapshot_pending)
+      take_snapshot (logger);
+
+    if (pl->glog == NULL) {
+      count_invalid (logger, pl->line, INVALID_EMPTY, 0);
+    } else {
+      count_process (logger, 0);
+      store_line (logger, pl->glog, pl->line, pl->invalid, 0);
+      free_logger (pl->glog);
+    }
+    free (pl->line);
+  }
+  batch->len = 0;
+}
+
+/* Queue a line read to be parsed by the worker pool. Once a batch is
+ * full, it is handed to the workers and the previous one, parsed
+ * meanwhile, is stored, so reading and storing overlap parsing. */
+static void
+queue_line (GLog * logger, const char *line)
+{
+  GParseBatch *batch = &parse_batches[parse_cur];
+  GParsedLine *pl;
+
+  if (batch->lines == NULL)
+    batch->lines = xcalloc (PARSE_BATCH_LINES, sizeof (GParsedLine));
+
+  pl = &batch->lines[batch->len++];
+  pl->line = xstrdup (line);
+  pl->glog = NULL;
+  pl->invalid = 0;
+  if (batch->len < PARSE_BATCH_LINES)
+    return;
+
+  parse_batch (batch);
+  parse_cur ^= 1;
+  store_batch (logger, &parse_batches[parse_cur]);
+}
+
+/* Store the lines still queued, the older batch first. */
+static void
+flush_lines (GLog * logger)
+{
+  GParseBatch *batch = &parse_batches[parse_cur];
+
+  parse_batch (batch);
+  store_batch (logger, &parse_batches[parse_cur ^ 1]);
+  store_batch (logger, batch);
+
+  free (parse_batches[0].lines);
+  free (parse_batches[1].lines);
+  parse_batches[0].lines = parse_batches[1].lines = NULL;
+}
+
+/* Determine if the lines read are parsed by the worker pool. A single
+ * thread parses them as they are read, so does testing the log format.
+ */
+static int
+parse_in_pool (int test)
+{
+  return !test && wpool_threads () > 1;
+}
+
+
+/* Advise the kernel that the log is going to be read sequentially, so
+ * it can read ahead aggressively. */
+static void
+advise_log_start (FILE * fp)
+{
+#ifdef HAVE_POSIX_FADVISE
+  log_read_bytes = log_dropped_bytes = 0;
+  posix_fadvise (fileno (fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+  (void) fp;
+#endif
+}
+
+/* Drop from the page cache the part of the log behind the read cursor,
+ * once every PAGE_CACHE_CHUNK bytes. Only whole pages are dropped. This
+ * keeps a large scan from evicting the cache of other processes. */
+static void
+advise_log_read (FILE * fp, size_t bytes)
+{
+#ifdef HAVE_POSIX_FADVISE
+  static long pagesize = 0;
+  off_t end;
+
+  log_read_bytes += bytes;
+  if (log_read_bytes - log_dropped_bytes < PAGE_CACHE_CHUNK)
+    return;
+
+  if (pagesize == 0)
+    pagesize = sysconf (_SC_PAGESIZE);
+  end = log_read_bytes - (log_read_bytes % pagesize);
+  if (posix_fadvise (fileno (fp), log_dropped_bytes, end - log_dropped_bytes,
+                     POSIX_FADV_DONTNEED) == 0)
+    log_dropped_bytes = end;
+#else
+  (void) fp;
+  (void) bytes;
+#endif
+}
+
+/* Drop the remainder of the log from the page cache and report how
+ * much of it was dropped. */
+static void
+advise_log_end (FILE * fp)
+{
+#ifdef HAVE_POSIX_FADVISE
+  char *size = NULL;
+
+  if (posix_fadvise (fileno (fp), log_dropped_bytes, 0,
+                     POSIX_FADV_DONTNEED) == 0)
+    log_dropped_bytes = log_read_bytes;
+
+  size = filesize_str ((float) log_dropped_bytes);
+  LOG_DEBUG (("Dropped %s of the log from the page cache.\n", size));
+  free (size);
+#else
+  (void) fp;
+  LOG_DEBUG (("posix_fadvise(2) not available, page cache not dropped.\n"));
+#endif
+}
+
+/* Determine if the page cache should be dropped while reading the log.
+ * It only applies to a regular file and not while testing the log
+ * format. */
+static int
+drop_page_cache (GLog * logger, int test)
+{
+  return conf.drop_page_cache && !logger->piping && !test;
+}
+
+/* Get the difference between two points in time in seconds. */
+static double
+ts_diff (const struct timespec *end, const struct timespec *begin)
+{
+  return (end->tv_sec - begin->tv_sec) + (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+/* Determine if reading the log should be paced to stay within a read
+ * rate (--max-read-rate) or CPU share (--max-cpu). */
+static int
+pace_log_enabled (int test)
+{
+  return !test && (conf.max_read_rate > 0 || conf.max_cpu > 0);
+}
+
+/* Pace reading and parsing the log. This is a token bucket refilled at
+ * the allowed rate whose burst is a single batch of lines: once a batch
+ * is done, it sleeps for as long as the bytes read and the CPU time
+ * used by the batch take at the allowed rates. The batch size adapts
+ * so that each batch takes about PACE_SLICE_MS of work. */
+static void
+pace_log (size_t bytes)
+{
+  struct timespec wall, cpu, ts;
+  double work = 0, need = 0, cpu_need = 0, batch;
+
+  pace.bytes += bytes;
+  if (++pace.lines < pace.batch)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &wall);
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+  /* first batch, simply start the clocks */
+  if (pace.wall.tv_sec == 0 && pace.wall.tv_nsec == 0)
+    goto reset;
+
+  work = ts_diff (&wall, &pace.wall);
+  if (conf.max_read_rate > 0)
+    need = pace.bytes / (conf.max_read_rate * 1024 * 1024);
+  if (conf.max_cpu > 0)
+    cpu_need = ts_diff (&cpu, &pace.cpu) * 100 / conf.max_cpu;
+  if (cpu_need > need)
+    need = cpu_need;
+
+  if (need > work) {
+    ts.tv_sec = (time_t) (need - work);
+    ts.tv_nsec = (long) ((need - work - ts.tv_sec) * 1e9);
+    nanosleep (&ts, NULL);
+  }
+
+  /* adapt the batch size to the time the last one took */
+  batch = work > 0 ? pace.batch * (PACE_SLICE_MS / 1000.0) / work : 0;
+  if (work <= 0 || batch > PACE_MAX_BATCH)
+    batch = PACE_MAX_BATCH;
+  pace.batch = batch < 1 ? 1 : (unsigned int) batch;
+
+  clock_gettime (CLOCK_MONOTONIC, &wall);
+
+reset:
+  pace.wall = wall;
+  pace.cpu = cpu;
+  pace.bytes = 0;
+  pace.lines = 0;
+}
+
 #ifndef WITH_GETLINE
 static int
 read_line (FILE * fp, int lines2test, GLog ** logger)
 {
   char line[LINE_BUFFER] = "";
   int i = 0, test = -1 == lines2test ? 0 : 1;
+  int parallel = parse_in_pool (test);
+  size_t len = 0;
 
   while (fgets (line, LINE_BUFFER, fp) != NULL) {
     if (lines2test >= 0 && i++ == lines2test)
       break;
 
+    len = strlen (line);
+    if (drop_page_cache ((*logger), test))
+      advise_log_read (fp, len);
+    if (pace_log_enabled (test))
+      pace_log (len);
+
+    /* hand it to the workers */
+    if (parallel) {
+      queue_line ((*logger), line);
+      continue;
+    }
     /* start processing log line */
     if (pre_process_log ((*logger), line, test)) {
       if (!(*logger)->piping)
@@ -2011,6 +2853,8 @@ read_line (FILE * fp, int lines2test, GLog ** logger)
       return 1;
     }
   }
+  if (parallel)
+    flush_lines ((*logger));
 
   return 0;
 }
@@ -2024,11 +2868,22 @@ read_line (FILE * fp, int lines2test, GLog ** logger)
   size_t len = 0;
   ssize_t read;
   int i = 0, test = -1 == lines2test ? 0 : 1;
+  int parallel = parse_in_pool (test);
 
   while ((read = getline (&line, &len, fp)) != -1) {
     if (lines2test >= 0 && i++ == lines2test)
       break;
 
+    if (drop_page_cache ((*logger), test))
+      advise_log_read (fp, read);
+    if (pace_log_enabled (test))
+      pace_log (read);
+
+    /* hand it to the workers */
+    if (parallel) {
+      queue_line ((*logger), line);
+      continue;
+    }
     /* start processing log line */
     if (pre_process_log ((*logger), line, test)) {
       if (!(*logger)->piping)
@@ -2038,18 +2893,80 @@ read_line (FILE * fp, int lines2test, GLog ** logger)
     }
   }
   free (line);
+  if (parallel)
+    flush_lines ((*logger));
 
   return 0;
 }
 #endif
 
+/* Determine if a cached invalid line is dropped by --filter before it
+ * fails to parse, as it is while reading the log.
+ *
+ * If filtered, 1 is returned, else 0 is returned. */
+static int
+filtered_invalid (char *line, int reason)
+{
+  GLogItem *glog;
+  int filtered;
+
+  if (log_filter == NULL || reason == INVALID_EMPTY)
+    return 0;
+
+  glog = new_log_item ();
+  parse_format (glog, line, 0);
+  filtered = glog->filtered;
+  free_logger (glog);
+
+  return filtered;
+}
+
+/* Read the parsed lines back from the record cache, as if the log was
+ * read and parsed. */
+static void
+read_record_cache (GLog * logger)
+{
+  GLogItem *glog;
+  char *line = NULL;
+  int entry, reason = 0;
+
+  /* restore the flags set while parsing */
+  if (rec_cache->hdr.flags & REC_FLAG_BW)
+    conf.bandwidth = 1;
+  if (rec_cache->hdr.flags & REC_FLAG_USECS)
+    contains_usecs ();
+
+  do {
+    if (snapshot_pending)
+      take_snapshot (logger);
+
+    glog = init_log_item (logger);
+    entry = reccache_get (rec_cache, glog, &line, &reason);
+    if (entry == REC_INVALID) {
+      if (reason != INVALID_EMPTY)
+        count_process (logger, 0);
+      if (!filtered_invalid (line, reason))
+        count_invalid (logger, line, reason, 0);
+      free (line);
+    } else if (entry == REC_ITEM) {
+      count_process (logger, 0);
+      if (log_filter == NULL || filter_match (log_filter, glog))
+        process_item (logger, glog);
+    }
+    free_logger (glog);
+  } while (entry != REC_EOF);
+}
+
 static int
 read_log (GLog ** logger, int lines2test)
 {
   FILE *fp = NULL;
+  int test = -1 == lines2test ? 0 : 1;
 
-  /* no data piped, no log passed, load from disk only then */
-  if (conf.load_from_disk && !conf.ifile && isatty (STDIN_FILENO)) {
+  /* no data piped, no log passed, load from disk (or aggregate) only
+   * then */
+  if ((conf.load_from_disk || conf.aggregate_socket) && !conf.ifile &&
+      isatty (STDIN_FILENO)) {
     (*logger)->load_from_disk_only = 1;
     return 0;
   }
@@ -2060,13 +2977,37 @@ read_log (GLog ** logger, int lines2test)
     (*logger)->piping = 1;
   }
 
+  /* read the log from its record cache if up to date, else cache it */
+  if (conf.record_cache && !test) {
+    if ((*logger)->piping)
+      FATAL ("--record-cache requires a log file, not piped data.");
+    rec_cache = reccache_open (conf.record_cache, conf.ifile);
+    if (rec_cache && !rec_cache->writing) {
+      read_record_cache (*logger);
+      reccache_close (rec_cache, 1);
+      rec_cache = NULL;
+      return 0;
+    }
+  }
+
   /* make sure we can open the log (if not reading from stdin) */
   if (!(*logger)->piping && (fp = fopen (conf.ifile, "r")) == NULL)
     FATAL ("Unable to open the specified log file. %s", strerror (errno));
 
+  if (drop_page_cache ((*logger), test))
+    advise_log_start (fp);
+
   /* read line by line */
-  if (read_line (fp, lines2test, logger))
+  if (read_line (fp, lines2test, logger)) {
+    reccache_close (rec_cache, 0);
+    rec_cache = NULL;
     return 1;
+  }
+  reccache_close (rec_cache, 1);
+  rec_cache = NULL;
+
+  if (drop_page_cache ((*logger), test))
+    advise_log_end (fp);
 
   /* definitely not portable! */
   if ((*logger)->piping)
@@ -2090,6 +3031,9 @@ verify_formats (void)
 
   if (conf.log_format == NULL || *conf.log_format == '\0')
     FATAL ("No log format was found on your conf file.");
+
+  if (conf.vhost_reports_dir && !strstr (conf.log_format, "%v"))
+    FATAL ("Per virtual host reports require %%v on the log format.");
 }
 
 /* entry point to parse the log line by line */
@@ -2108,6 +3052,9 @@ parse_log (GLog ** logger, char *tail, int lines2test)
   /* verify that we have the required formats */
   verify_formats ();
 
+  if (conf.filter && log_filter == NULL)
+    log_filter = filter_compile (conf.filter, conf.log_format);
+
   /* perform some additional checks before parsing panels */
   verify_panels ();
 
@@ -27,7 +27,44 @@
 #define REF_SITE_LEN    512
 #define NUM_TESTS       20
 
+/* Drop the log from the page cache every N bytes read */
+#define PAGE_CACHE_CHUNK (8 * 1024 * 1024)
+
+/* Pace the log every batch of lines, the batch size adapts so each one
+ * takes about PACE_SLICE_MS of work */
+#define PACE_SLICE_MS    50
+#define PACE_MAX_BATCH   65536
+
+/* Lines read ahead and parsed by the worker pool, in tasks of
+ * PARSE_CHUNK_LINES lines */
+#define PARSE_BATCH_LINES 1024
+#define PARSE_CHUNK_LINES 128
+
+/* Days kept open before the oldest one is flushed. This tolerates
+ * records slightly out of order around midnight */
+#define DAILY_OPEN_DAYS 2
+
+/* Partition of the records without a virtual host. Underscores are not
+ * valid in host names, thus it never clashes with a virtual host */
+#define VHOST_UNKNOWN "_unknown"
+
+/* Reasons a line is invalid other than a failed format specifier,
+ * which is given by the specifier character itself */
+#define INVALID_FORMAT   '\0'   /* log format mismatch */
+#define INVALID_EMPTY    '\1'   /* empty line or comment */
+#define INVALID_REQUIRED '\2'   /* missing host, date or request */
+#define INVALID_FLUSHED  '\3'   /* record of a day already written */
+#define INVALID_REASONS  256
+/* Length of the sample line kept per reason */
+#define INVALID_SAMPLE   120
+
+/* Max length of a --ignore-metric panel or metric name */
+#define IGNORE_METRIC_LEN 32
+
+#include <stdio.h>
+
 #include "commons.h"
+#include "wpool.h"
 
 /* Log properties. Note: This is per line parsed */
 typedef struct GLogItem_
@@ -38,7 +75,9 @@ typedef struct GLogItem_
   char *continent;
   char *country;
   char *date;
+  char *extra;
   char *host;
+  char *host_prefix;
   char *keyphrase;
   char *method;
   char *os;
@@ -54,6 +93,8 @@ typedef struct GLogItem_
   char *vhost;
 
   char site[REF_SITE_LEN];
+  /* keys extracted for the user-defined panels */
+  char *custom_keys[MAX_CUSTOM_PANELS];
 
   uint64_t resp_size;
   uint64_t serve_time;
@@ -63,6 +104,8 @@ typedef struct GLogItem_
   int is_static;
   int uniq_nkey;
   int agent_nkey;
+  int errspec;                  /* format specifier that failed */
+  int filtered;                 /* rejected by --filter */
 } GLogItem;
 
 /* Overall parsed log properties */
@@ -79,6 +122,38 @@ typedef struct GLog_
   GLogItem *items;
 } GLog;
 
+/* A line read ahead, parsed by a worker and stored by the reader */
+typedef struct GParsedLine_
+{
+  char *line;
+  GLogItem *glog;               /* NULL if empty or a comment */
+  int invalid;
+} GParsedLine;
+
+/* A run of lines parsed by a single task */
+typedef struct GParseChunk_
+{
+  GParsedLine *lines;
+  int len;
+} GParseChunk;
+
+/* Lines read ahead, parsed by the worker pool while the reader stores
+ * the previous batch */
+typedef struct GParseBatch_
+{
+  GParsedLine *lines;
+  GParseChunk chunks[PARSE_BATCH_LINES / PARSE_CHUNK_LINES];
+  GWGroup grp;
+  int len;
+} GParseBatch;
+
+/* Invalid lines failing for a given reason */
+typedef struct GInvalidReason_
+{
+  uint64_t lines;
+  char *sample;                 /* first line that failed */
+} GInvalidReason;
+
 /* Raw Data extracted from table stores */
 typedef struct GRawDataItem_
 {
@@ -103,10 +178,12 @@ typedef struct GKeyData_
   void *data;
   void *data_key;
   int data_nkey;
+  uint64_t data_hash;
 
   void *root;
   void *root_key;
   int root_nkey;
+  uint64_t root_hash;
 
   void *uniq_key;
   int uniq_nkey;
@@ -134,12 +211,17 @@ typedef struct GParse_
 
 GLog *init_log (void);
 GLogItem *init_log_item (GLog * logger);
+GLogItem *new_log_item (void);
 GRawDataItem *new_grawdata_item (unsigned int size);
 GRawData *new_grawdata (void);
 int parse_log (GLog ** logger, char *tail, int n);
 int test_format (GLog * logger);
+void free_invalid_reasons (void);
+void free_log_filter (void);
 void free_raw_data (GRawData * raw_data);
+void print_invalid_summary (FILE * fp);
 void reset_struct (GLog * logger);
+void set_panel_metrics (void);
 void verify_formats (void);
 
 #endif
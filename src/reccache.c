@@ -0,0 +1,509 @@
+/**
+ * reccache.c -- binary cache of parsed log records
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * The first run over a log writes every parsed line to a sidecar file,
+ * the following runs over the same, unchanged, log read it back instead
+ * of tokenizing the text, converting its fields and classifying its user
+ * agents. The file is a header followed by a stream of entries, each
+ * tagged by a byte:
+ *
+ *   REC_STRING   uint32_t length, bytes. Defines the next dictionary id.
+ *   REC_ITEM     GRecord, strings as dictionary ids.
+ *   REC_INVALID  uint32_t reason, uint32_t length, the line.
+ *
+ * Records keep the fields as parsed, before any ignore, filter or panel
+ * option is applied, so those can change between runs. Options that
+ * change how a line is parsed are part of the header fingerprint.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reccache.h"
+
+#include "browsers.h"
+#include "error.h"
+#include "opesys.h"
+#include "settings.h"
+#include "xmalloc.h"
+
+/* FNV-1a, stable across runs unlike the seeded storage hash */
+static uint64_t
+fnv1a (uint64_t hash, const char *str)
+{
+  if (str == NULL)
+    str = "";
+  do {
+    hash ^= (unsigned char) *str;
+    hash *= 0x100000001b3ULL;
+  } while (*str++);
+
+  return hash;
+}
+
+/* Fingerprint the options that change how a line is parsed. */
+static uint64_t
+parse_fingerprint (void)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  char flags[8];
+
+  snprintf (flags, sizeof flags, "%d%d%d%d", conf.double_decode,
+            conf.append_method, conf.append_protocol, conf.real_os);
+
+  hash = fnv1a (hash, conf.log_format);
+  hash = fnv1a (hash, conf.date_format);
+  hash = fnv1a (hash, conf.time_format);
+  hash = fnv1a (hash, flags);
+
+  return hash;
+}
+
+/* Build the header a cache of the given log must have. */
+static void
+init_header (GRecHeader * hdr, const struct stat *st)
+{
+  memset (hdr, 0, sizeof *hdr);
+  memcpy (hdr->magic, REC_MAGIC, sizeof hdr->magic);
+  hdr->version = REC_VERSION;
+  hdr->fingerprint = parse_fingerprint ();
+  hdr->log_size = st->st_size;
+  hdr->log_mtime = st->st_mtime;
+}
+
+/* Determine if an existing cache was fully written from the same log
+ * and with the same parsing options.
+ *
+ * If not usable, 0 is returned.
+ * If usable, 1 is returned. */
+static int
+valid_header (const GRecHeader * hdr, const GRecHeader * want)
+{
+  if (memcmp (hdr->magic, want->magic, sizeof hdr->magic) != 0)
+    return 0;
+  if (hdr->version != want->version || !hdr->complete)
+    return 0;
+  if (hdr->fingerprint != want->fingerprint)
+    return 0;
+  if (hdr->log_size != want->log_size || hdr->log_mtime != want->log_mtime)
+    return 0;
+
+  return 1;
+}
+
+/* Append a string to the dictionary, its id being its index. Id 0 is
+ * reserved for NULL. */
+static uint32_t
+push_string (GRecCache * cache, char *str)
+{
+  if (cache->nstrings == cache->cap) {
+    cache->cap *= 2;
+    cache->strings = xrealloc (cache->strings, cache->cap * sizeof (char *));
+    if (cache->writing) {
+      cache->agents =
+        xrealloc (cache->agents, cache->cap * sizeof (GRecAgent));
+      memset (cache->agents + cache->nstrings, 0,
+              (cache->cap - cache->nstrings) * sizeof (GRecAgent));
+    }
+  }
+  cache->strings[cache->nstrings] = str;
+
+  return cache->nstrings++;
+}
+
+static GRecCache *
+new_reccache (const char *path, FILE * fp, int writing)
+{
+  GRecCache *cache = xcalloc (1, sizeof (GRecCache));
+
+  cache->fp = fp;
+  cache->path = xstrdup (path);
+  cache->writing = writing;
+  cache->buf = xmalloc (REC_BUFFER);
+  setvbuf (fp, cache->buf, _IOFBF, REC_BUFFER);
+
+  cache->cap = REC_DICT_INIT;
+  cache->strings = xcalloc (cache->cap, sizeof (char *));
+  cache->nstrings = 1;
+  if (writing) {
+    cache->nslots = REC_DICT_INIT * 2;
+    cache->slots = xcalloc (cache->nslots, sizeof (GRecSlot));
+    cache->agents = xcalloc (cache->cap, sizeof (GRecAgent));
+  }
+
+  return cache;
+}
+
+/* Open the record cache of the given log. If the cache at path was
+ * written from the same log and options, it is opened for reading,
+ * otherwise it is (re)created for writing.
+ *
+ * On error, NULL is returned.
+ * On success, the new cache is returned. */
+GRecCache *
+reccache_open (const char *path, const char *log)
+{
+  GRecHeader hdr, want;
+  struct stat st;
+  FILE *fp;
+  GRecCache *cache;
+
+  if (stat (log, &st) != 0)
+    return NULL;
+  init_header (&want, &st);
+
+  if ((fp = fopen (path, "rb")) != NULL) {
+    if (fread (&hdr, sizeof hdr, 1, fp) == 1 && valid_header (&hdr, &want)) {
+      cache = new_reccache (path, fp, 0);
+      cache->hdr = hdr;
+      return cache;
+    }
+    fclose (fp);
+  }
+
+  if ((fp = fopen (path, "wb")) == NULL) {
+    LOG_DEBUG (("Unable to write record cache %s: %s\n", path,
+                strerror (errno)));
+    return NULL;
+  }
+
+  cache = new_reccache (path, fp, 1);
+  cache->hdr = want;
+  if (fwrite (&cache->hdr, sizeof cache->hdr, 1, fp) != 1)
+    cache->failed = 1;
+
+  return cache;
+}
+
+static void
+put_bytes (GRecCache * cache, const void *data, size_t len)
+{
+  if (len && fwrite (data, len, 1, cache->fp) != 1)
+    cache->failed = 1;
+}
+
+static void
+put_entry (GRecCache * cache, GRecEntry entry)
+{
+  unsigned char tag = entry;
+  put_bytes (cache, &tag, 1);
+}
+
+/* Double the dictionary slots and rehash them. */
+static void
+grow_slots (GRecCache * cache)
+{
+  GRecSlot *old = cache->slots;
+  uint32_t i, j, nold = cache->nslots;
+
+  cache->nslots *= 2;
+  cache->slots = xcalloc (cache->nslots, sizeof (GRecSlot));
+  for (i = 0; i < nold; i++) {
+    if (old[i].key == NULL)
+      continue;
+    j = old[i].hash & (cache->nslots - 1);
+    while (cache->slots[j].key != NULL)
+      j = (j + 1) & (cache->nslots - 1);
+    cache->slots[j] = old[i];
+  }
+  free (old);
+}
+
+/* Get the dictionary id of a string, defining it on the stream if new.
+ *
+ * If the string is NULL, 0 is returned.
+ * On success, the id of the string is returned. */
+static uint32_t
+string_id (GRecCache * cache, const char *str)
+{
+  GRecSlot *slot;
+  uint32_t hash, i, len, id;
+  char *key;
+
+  if (str == NULL)
+    return 0;
+
+  hash = (uint32_t) fnv1a (0xcbf29ce484222325ULL, str);
+  i = hash & (cache->nslots - 1);
+  for (; cache->slots[i].key != NULL; i = (i + 1) & (cache->nslots - 1)) {
+    slot = &cache->slots[i];
+    if (slot->hash == hash && strcmp (slot->key, str) == 0)
+      return slot->id;
+  }
+
+  key = xstrdup (str);
+  id = push_string (cache, key);
+  cache->slots[i].key = key;
+  cache->slots[i].hash = hash;
+  cache->slots[i].id = id;
+
+  len = strlen (str);
+  put_entry (cache, REC_STRING);
+  put_bytes (cache, &len, sizeof len);
+  put_bytes (cache, str, len);
+
+  /* keep it at most half full */
+  if (cache->nstrings * 2 > cache->nslots)
+    grow_slots (cache);
+
+  return id;
+}
+
+/* Classify a user agent once per distinct agent and set its browser and
+ * operating system on the log item, sparing the panels from doing it on
+ * every line. */
+static void
+classify_agent (GRecCache * cache, GLogItem * glog, uint32_t agent)
+{
+  GRecAgent *ua = &cache->agents[agent];
+  char browser_type[BROWSER_TYPE_LEN] = "";
+  char os_type[OPESYS_TYPE_LEN] = "";
+  char *dup, *browser, *os;
+
+  if (ua->browser == 0) {
+    /* both may write into the agent */
+    dup = xstrdup (glog->agent);
+    browser = verify_browser (dup, browser_type);
+    free (dup);
+    dup = xstrdup (glog->agent);
+    os = verify_os (dup, os_type);
+    free (dup);
+    /* the dictionary may have grown, ua is stale from here */
+    cache->agents[agent].browser = string_id (cache, browser);
+    cache->agents[agent].browser_type = string_id (cache, browser_type);
+    cache->agents[agent].os = string_id (cache, os);
+    cache->agents[agent].os_type = string_id (cache, os_type);
+    free (browser);
+    free (os);
+    ua = &cache->agents[agent];
+  }
+
+  glog->browser = xstrdup (cache->strings[ua->browser]);
+  glog->browser_type = xstrdup (cache->strings[ua->browser_type]);
+  glog->os = xstrdup (cache->strings[ua->os]);
+  glog->os_type = xstrdup (cache->strings[ua->os_type]);
+}
+
+/* Write a parsed log item. Its user agent is classified as well. */
+void
+reccache_put_item (GRecCache * cache, GLogItem * glog)
+{
+  GRecord rec;
+
+  memset (&rec, 0, sizeof rec);
+  rec.host = string_id (cache, glog->host);
+  rec.vhost = string_id (cache, glog->vhost);
+  rec.date = string_id (cache, glog->date);
+  rec.time = string_id (cache, glog->time);
+  rec.req = string_id (cache, glog->req);
+  rec.qstr = string_id (cache, glog->qstr);
+  rec.method = string_id (cache, glog->method);
+  rec.protocol = string_id (cache, glog->protocol);
+  rec.ref = string_id (cache, glog->ref);
+  rec.site = string_id (cache, glog->site[0] ? glog->site : NULL);
+  rec.keyphrase = string_id (cache, glog->keyphrase);
+  rec.agent = string_id (cache, glog->agent);
+  rec.status = string_id (cache, glog->status);
+  rec.extra = string_id (cache, glog->extra);
+  rec.resp_size = glog->resp_size;
+  rec.serve_time = glog->serve_time;
+
+  classify_agent (cache, glog, rec.agent);
+  rec.browser = cache->agents[rec.agent].browser;
+  rec.browser_type = cache->agents[rec.agent].browser_type;
+  rec.os = cache->agents[rec.agent].os;
+  rec.os_type = cache->agents[rec.agent].os_type;
+
+  put_entry (cache, REC_ITEM);
+  put_bytes (cache, &rec, sizeof rec);
+}
+
+/* Write an invalid line, so its reason is accounted for when read. */
+void
+reccache_put_invalid (GRecCache * cache, const char *line, int reason)
+{
+  uint32_t len = line ? strlen (line) : 0, rsn = reason;
+
+  put_entry (cache, REC_INVALID);
+  put_bytes (cache, &rsn, sizeof rsn);
+  put_bytes (cache, &len, sizeof len);
+  put_bytes (cache, line, len);
+}
+
+static int
+get_bytes (GRecCache * cache, void *data, size_t len)
+{
+  return len == 0 || fread (data, len, 1, cache->fp) == 1;
+}
+
+/* Read a length-prefixed string.
+ *
+ * On error, NULL is returned.
+ * On success, the malloc'd string is returned. */
+static char *
+get_string (GRecCache * cache)
+{
+  uint32_t len;
+  char *str;
+
+  if (!get_bytes (cache, &len, sizeof len))
+    return NULL;
+
+  str = xmalloc (len + 1);
+  if (!get_bytes (cache, str, len)) {
+    free (str);
+    return NULL;
+  }
+  str[len] = '\0';
+
+  return str;
+}
+
+/* Get a copy of a dictionary string.
+ *
+ * On error, FATAL is triggered.
+ * If the id is 0, NULL is returned. */
+static char *
+dup_string (GRecCache * cache, uint32_t id)
+{
+  if (id >= cache->nstrings)
+    FATAL ("Corrupted record cache %s, remove it to parse the log.",
+         cache->path);
+  return id ? xstrdup (cache->strings[id]) : NULL;
+}
+
+static void
+set_log_item (GRecCache * cache, GLogItem * glog, const GRecord * rec)
+{
+  glog->host = dup_string (cache, rec->host);
+  glog->vhost = dup_string (cache, rec->vhost);
+  glog->date = dup_string (cache, rec->date);
+  glog->time = dup_string (cache, rec->time);
+  glog->req = dup_string (cache, rec->req);
+  glog->qstr = dup_string (cache, rec->qstr);
+  glog->method = dup_string (cache, rec->method);
+  glog->protocol = dup_string (cache, rec->protocol);
+  glog->ref = dup_string (cache, rec->ref);
+  glog->keyphrase = dup_string (cache, rec->keyphrase);
+  glog->agent = dup_string (cache, rec->agent);
+  glog->browser = dup_string (cache, rec->browser);
+  glog->browser_type = dup_string (cache, rec->browser_type);
+  glog->os = dup_string (cache, rec->os);
+  glog->os_type = dup_string (cache, rec->os_type);
+  glog->status = dup_string (cache, rec->status);
+  glog->extra = dup_string (cache, rec->extra);
+  glog->resp_size = rec->resp_size;
+  glog->serve_time = rec->serve_time;
+
+  if (rec->site && rec->site < cache->nstrings) {
+    strncpy (glog->site, cache->strings[rec->site], REF_SITE_LEN);
+    glog->site[REF_SITE_LEN - 1] = '\0';
+  }
+}
+
+/* Read the next parsed line. A log item is filled, an invalid line
+ * sets its line and reason instead.
+ *
+ * On error, FATAL is triggered.
+ * On success, REC_ITEM, REC_INVALID or, once done, REC_EOF is returned. */
+int
+reccache_get (GRecCache * cache, GLogItem * glog, char **line, int *reason)
+{
+  GRecord rec;
+  uint32_t rsn;
+  unsigned char tag;
+  char *str;
+
+  while (get_bytes (cache, &tag, 1)) {
+    switch (tag) {
+    case REC_STRING:
+      if ((str = get_string (cache)) == NULL)
+        goto corrupted;
+      push_string (cache, str);
+      break;
+    case REC_ITEM:
+      if (!get_bytes (cache, &rec, sizeof rec))
+        goto corrupted;
+      set_log_item (cache, glog, &rec);
+      return REC_ITEM;
+    case REC_INVALID:
+      if (!get_bytes (cache, &rsn, sizeof rsn))
+        goto corrupted;
+      if ((*line = get_string (cache)) == NULL)
+        goto corrupted;
+      *reason = rsn;
+      return REC_INVALID;
+    default:
+      goto corrupted;
+    }
+  }
+
+  if (ferror (cache->fp))
+    goto corrupted;
+
+  return REC_EOF;
+
+corrupted:
+  FATAL ("Corrupted record cache %s, remove it to parse the log.",
+         cache->path);
+}
+
+/* Close a record cache. A cache being written is only marked as usable
+ * if the whole log made it in, otherwise it is removed. */
+void
+reccache_close (GRecCache * cache, int complete)
+{
+  uint32_t i;
+
+  if (cache == NULL)
+    return;
+
+  if (cache->writing) {
+    cache->hdr.complete = complete && !cache->failed;
+    cache->hdr.flags = (conf.bandwidth ? REC_FLAG_BW : 0) |
+      (conf.serve_usecs ? REC_FLAG_USECS : 0);
+    if (fseek (cache->fp, 0, SEEK_SET) != 0 ||
+        fwrite (&cache->hdr, sizeof cache->hdr, 1, cache->fp) != 1)
+      cache->hdr.complete = 0;
+  }
+  if (fclose (cache->fp) != 0)
+    cache->hdr.complete = 0;
+  if (cache->writing && !cache->hdr.complete)
+    unlink (cache->path);
+
+  for (i = 1; i < cache->nstrings; i++)
+    free (cache->strings[i]);
+  free (cache->strings);
+  free (cache->slots);
+  free (cache->agents);
+  free (cache->buf);
+  free (cache->path);
+  free (cache);
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#ifndef RECCACHE_H_INCLUDED
+#define RECCACHE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+#define REC_MAGIC        "GORECCHE"
+#define REC_VERSION      1
+#define REC_BUFFER       (1 << 20)
+#define REC_DICT_INIT    4096
+
+/* Flags set while parsing that replaying has to restore */
+#define REC_FLAG_BW      0x01
+#define REC_FLAG_USECS   0x02
+
+/* Entries of a record cache */
+typedef enum GRecEntry_
+{
+  REC_EOF,
+  REC_STRING,
+  REC_ITEM,
+  REC_INVALID,
+} GRecEntry;
+
+typedef struct GRecHeader_
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t complete;            /* set once the whole log was cached */
+  uint64_t fingerprint;         /* of the options affecting parsing */
+  uint64_t log_size;
+  int64_t log_mtime;
+  uint32_t flags;
+  uint32_t reserved;
+} GRecHeader;
+
+/* A parsed line, each string is an id into the dictionary, 0 is NULL */
+typedef struct GRecord_
+{
+  uint32_t host;
+  uint32_t vhost;
+  uint32_t date;
+  uint32_t time;
+  uint32_t req;
+  uint32_t qstr;
+  uint32_t method;
+  uint32_t protocol;
+  uint32_t ref;
+  uint32_t site;
+  uint32_t keyphrase;
+  uint32_t agent;
+  uint32_t browser;
+  uint32_t browser_type;
+  uint32_t os;
+  uint32_t os_type;
+  uint32_t status;
+  uint32_t extra;
+  uint64_t resp_size;
+  uint64_t serve_time;
+} GRecord;
+
+/* A dictionary slot, while writing */
+typedef struct GRecSlot_
+{
+  const char *key;
+  uint32_t hash;
+  uint32_t id;
+} GRecSlot;
+
+/* The user agent classification of a dictionary id */
+typedef struct GRecAgent_
+{
+  uint32_t browser;
+  uint32_t browser_type;
+  uint32_t os;
+  uint32_t os_type;
+} GRecAgent;
+
+typedef struct GRecCache_
+{
+  FILE *fp;
+  char *buf;                    /* stdio buffer */
+  char *path;
+  int writing;
+  int failed;                   /* a write failed, drop the cache */
+  GRecHeader hdr;
+
+  /* dictionary, strings[id] */
+  char **strings;
+  uint32_t nstrings;
+  uint32_t cap;
+
+  /* string -> id lookups and agent classifications, writing only */
+  GRecSlot *slots;
+  uint32_t nslots;
+  GRecAgent *agents;
+} GRecCache;
+
+GRecCache *reccache_open (const char *path, const char *log);
+int reccache_get (GRecCache * cache, GLogItem * glog, char **line,
+                  int *reason);
+void reccache_close (GRecCache * cache, int complete);
+void reccache_put_invalid (GRecCache * cache, const char *line, int reason);
+void reccache_put_item (GRecCache * cache, GLogItem * glog);
+
+#endif
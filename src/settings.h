@@ -30,6 +30,7 @@
 #define MAX_IGNORE_REF     64
 #define MAX_CUSTOM_COLORS  64
 #define MAX_IGNORE_STATUS  64
+#define MAX_IGNORE_METRICS 64
 #define NO_CONFIG_FILE "No config file used"
 
 typedef enum
@@ -79,19 +80,30 @@ typedef struct GPreConfLog_
 /* All configuration properties */
 typedef struct GConf_
 {
+  char *aggregate_socket;
+  char *custom_panels[MAX_CUSTOM_PANELS];
+  char *daily_reports_dir;
   char *date_format;
   char *debug_log;
+  char *filter;
   char *geoip_database;
+  char *geoip_table;
+  char *geoip_table_csv;
   char *html_report_title;
   char *iconfigfile;
   char *ifile;
   char *ignore_ips[MAX_IGNORE_IPS];
+  char *ignore_metrics[MAX_IGNORE_METRICS];
   char *ignore_referers[MAX_IGNORE_REF];
   char *invalid_requests_log;
   char *log_format;
   char *output_format;
+  char *record_cache;
+  char *snapshot_file;
+  char *ship_to;
   char *sort_panels[TOTAL_MODULES];
   char *time_format;
+  char *vhost_reports_dir;
   const char *colors[MAX_CUSTOM_COLORS];
   const char *ignore_panels[TOTAL_MODULES];
   const char *ignore_status[MAX_IGNORE_STATUS];
@@ -105,12 +117,19 @@ typedef struct GConf_
   int code444_as_404;
   int color_scheme;
   int double_decode;
+  int drop_page_cache;
   int enable_html_resolver;
+  int flush_daily;
   int geo_db;
   int hl_header;
+  int host_children;
+  int host_prefix4;
+  int host_prefix6;
   int ignore_crawlers;
   int ignore_qstr;
+  int invalid_requests_sample;
   int list_agents;
+  int max_cpu;
   int load_conf_dlg;
   int load_global_config;
   int mouse_support;
@@ -122,16 +141,24 @@ typedef struct GConf_
   int output_html;
   int real_os;
   int serve_usecs;
+  int report_interval;
+  int ship_interval;
   int skip_term_resolver;
+  int slowest_keys;
+  int slowest_requests;
+  int threads;
 
   int color_idx;
+  int custom_panel_idx;
   int ignore_ip_idx;
+  int ignore_metric_idx;
   int ignore_panel_idx;
   int ignore_referer_idx;
   int ignore_status_idx;
   int sort_panel_idx;
   int static_file_idx;
 
+  double max_read_rate;
   size_t static_file_max_len;
 
   /* TokyoCabinet */
@@ -0,0 +1,721 @@
+/**
+ * ship.c -- ships aggregate deltas from agents to an aggregator
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * An agent parses its log as usual, and every time it ships it sends
+ * the keys that are new since the last shipment, followed by the
+ * counters of every key touched since then. Its counters are then
+ * reset, so its memory is bounded by the number of keys.
+ *
+ * A message is made of an 8-byte header, the magic "GODL" and the
+ * payload length, followed by the payload:
+ *
+ *   processed, invalid, valid, excluded_ip, visitors (u32 increments)
+ *   resp_size (u64 increment)
+ *   records:
+ *     SHIP_KEY   module (u8), key (u32), keymap, data, root, method and
+ *                protocol (strings)
+ *     SHIP_COUNT module (u8), key (u32), hits, visitors (u32), bw,
+ *                cumts, maxts (u64)
+ *     SHIP_END
+ *
+ * Strings are a u32 length, including the terminating null byte, and
+ * their bytes. An empty length stands for no string. Integers are in
+ * the host's byte order, as agents and aggregator share a host over a
+ * Unix socket.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ship.h"
+
+#ifdef HAVE_LIBTOKYOCABINET
+#include "tcabdb.h"
+#else
+#include "gkhash.h"
+#endif
+
+#include "error.h"
+#include "settings.h"
+#include "util.h"
+#include "xmalloc.h"
+
+/* agent */
+static int ship_fd = -1;
+static int ship_keys[TOTAL_MODULES];
+static uint32_t ship_visitors = 0;
+static GLog ship_last;
+
+/* aggregator */
+static int aggr_fd = -1;
+static int aggr_npeers = 0;
+static uint32_t aggr_merged_visitors = 0;
+static char *aggr_path = NULL;
+static GShipPeer *aggr_peer_list[SHIP_MAX_PEERS];
+
+/* Keys of a module being shipped */
+typedef struct GShipKeys_
+{
+  GShipBuf *buf;
+  GModule module;
+  int max;
+} GShipKeys;
+
+/* Append the given bytes to the buffer, growing it as needed. */
+static void
+buf_put (GShipBuf * b, const void *src, size_t n)
+{
+  size_t cap = b->cap ? b->cap : 4096;
+
+  if (b->len + n > b->cap) {
+    while (cap < b->len + n)
+      cap *= 2;
+    b->data = xrealloc (b->data, cap);
+    b->cap = cap;
+  }
+  memcpy (b->data + b->len, src, n);
+  b->len += n;
+}
+
+static void
+put_u8 (GShipBuf * b, uint8_t v)
+{
+  buf_put (b, &v, sizeof (v));
+}
+
+static void
+put_u32 (GShipBuf * b, uint32_t v)
+{
+  buf_put (b, &v, sizeof (v));
+}
+
+static void
+put_u64 (GShipBuf * b, uint64_t v)
+{
+  buf_put (b, &v, sizeof (v));
+}
+
+static void
+put_str (GShipBuf * b, const char *s)
+{
+  uint32_t n = s ? strlen (s) + 1 : 0;
+
+  put_u32 (b, n);
+  if (n)
+    buf_put (b, s, n);
+}
+
+/* Read the given number of bytes at the buffer's cursor.
+ *
+ * On error, i.e., not enough bytes, 1 is returned.
+ * On success, the bytes are copied and 0 is returned. */
+static int
+get_bytes (GShipBuf * b, void *dst, size_t n)
+{
+  if (b->len - b->pos < n)
+    return 1;
+  memcpy (dst, b->data + b->pos, n);
+  b->pos += n;
+
+  return 0;
+}
+
+static int
+get_u8 (GShipBuf * b, uint8_t * v)
+{
+  return get_bytes (b, v, sizeof (*v));
+}
+
+static int
+get_u32 (GShipBuf * b, uint32_t * v)
+{
+  return get_bytes (b, v, sizeof (*v));
+}
+
+static int
+get_u64 (GShipBuf * b, uint64_t * v)
+{
+  return get_bytes (b, v, sizeof (*v));
+}
+
+/* Point the given string to a null-terminated string at the buffer's
+ * cursor, or to NULL if the string is empty.
+ *
+ * On error, 1 is returned.
+ * On success, 0 is returned. */
+static int
+get_str (GShipBuf * b, const char **s)
+{
+  uint32_t n = 0;
+
+  if (get_u32 (b, &n))
+    return 1;
+
+  *s = NULL;
+  if (n == 0)
+    return 0;
+  if (b->len - b->pos < n || b->data[b->pos + n - 1] != '\0')
+    return 1;
+
+  *s = b->data + b->pos;
+  b->pos += n;
+
+  return 0;
+}
+
+/* Write the whole buffer to the given socket.
+ *
+ * On error, -1 is returned.
+ * On success, 0 is returned. */
+static int
+send_all (int fd, const char *data, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = send (fd, data, len, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    data += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+/* Fill a Unix socket address with the given path.
+ *
+ * On error, 1 is returned.
+ * On success, 0 is returned. */
+static int
+set_sockaddr (struct sockaddr_un *addr, const char *path)
+{
+  memset (addr, 0, sizeof (*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen (path) >= sizeof (addr->sun_path))
+    return 1;
+  strcpy (addr->sun_path, path);
+
+  return 0;
+}
+
+/* Connect the agent to the aggregator listening on the given Unix
+ * socket.
+ *
+ * On error, -1 is returned.
+ * On success, 0 is returned. */
+int
+ship_connect (const char *path)
+{
+  struct sockaddr_un addr;
+
+  if (set_sockaddr (&addr, path))
+    return -1;
+  if ((ship_fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+    return -1;
+  if (connect (ship_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+    close (ship_fd);
+    ship_fd = -1;
+    return -1;
+  }
+
+  memset (ship_keys, 0, sizeof (ship_keys));
+  memset (&ship_last, 0, sizeof (ship_last));
+  ship_visitors = 0;
+
+  return 0;
+}
+
+/* Disconnect the agent from the aggregator. */
+void
+ship_close (void)
+{
+  if (ship_fd != -1)
+    close (ship_fd);
+  ship_fd = -1;
+}
+
+/* Append a key inserted since the last shipment. Root keys travel
+ * along with the data keys that refer to them. */
+static void
+ship_key (const char *key, int nkey, void *user)
+{
+  GShipKeys *keys = user;
+  GModule module = keys->module;
+  char *data = NULL, *root = NULL, *method = NULL, *protocol = NULL;
+
+  if (nkey > keys->max)
+    keys->max = nkey;
+  if (!(data = ht_get_datamap (module, nkey)))
+    return;
+
+  root = ht_get_root (module, nkey);
+  method = ht_get_method (module, nkey);
+  protocol = ht_get_protocol (module, nkey);
+
+  put_u8 (keys->buf, SHIP_KEY);
+  put_u8 (keys->buf, module);
+  put_u32 (keys->buf, nkey);
+  put_str (keys->buf, key);
+  put_str (keys->buf, data);
+  put_str (keys->buf, root);
+  put_str (keys->buf, method);
+  put_str (keys->buf, protocol);
+
+  free (data);
+  free (root);
+  free (method);
+  free (protocol);
+}
+
+/* Append the counters of every key of a module touched since the last
+ * shipment. */
+static void
+ship_counts (GShipBuf * buf, GModule module)
+{
+  GRawData *raw_data;
+  int i, key, visitors;
+
+  if (!(raw_data = parse_raw_data (module)))
+    return;
+
+  for (i = 0; i < raw_data->idx; i++) {
+    key = raw_data->items[i].key;
+    visitors = ht_get_visitors (module, key);
+
+    put_u8 (buf, SHIP_COUNT);
+    put_u8 (buf, module);
+    put_u32 (buf, key);
+    put_u32 (buf, raw_data->items[i].value);
+    put_u32 (buf, visitors > 0 ? visitors : 0);
+    put_u64 (buf, ht_get_bw (module, key));
+    put_u64 (buf, ht_get_cumts (module, key));
+    put_u64 (buf, ht_get_maxts (module, key));
+  }
+  free_raw_data (raw_data);
+}
+
+/* Ship the keys and counter increments since the last shipment to the
+ * aggregator, then reset the counters.
+ *
+ * On error, -1 is returned.
+ * On success, 0 is returned. */
+int
+ship_delta (GLog * logger)
+{
+  GShipBuf buf = { 0 };
+  GShipKeys keys;
+  GModule module;
+  uint32_t visitors = ht_get_size_uniqmap (VISITORS), len;
+  size_t idx = 0;
+  int ret;
+
+  if (ship_fd == -1)
+    return -1;
+
+  buf_put (&buf, SHIP_MAGIC, 4);
+  put_u32 (&buf, 0);
+
+  put_u32 (&buf, logger->processed - ship_last.processed);
+  put_u32 (&buf, logger->invalid - ship_last.invalid);
+  put_u32 (&buf, logger->valid - ship_last.valid);
+  put_u32 (&buf, logger->excluded_ip - ship_last.excluded_ip);
+  put_u32 (&buf, visitors - ship_visitors);
+  put_u64 (&buf, logger->resp_size - ship_last.resp_size);
+
+  FOREACH_MODULE (idx, module_list) {
+    module = module_list[idx];
+
+    keys.buf = &buf;
+    keys.module = module;
+    keys.max = ship_keys[module];
+    ht_foreach_keymap (module, ship_keys[module], ship_key, &keys);
+    ship_keys[module] = keys.max;
+
+    ship_counts (&buf, module);
+  }
+  put_u8 (&buf, SHIP_END);
+
+  len = buf.len - SHIP_HDR_LEN;
+  memcpy (buf.data + 4, &len, sizeof (len));
+  ret = send_all (ship_fd, buf.data, buf.len);
+  free (buf.data);
+
+  if (ret == -1)
+    return -1;
+
+  LOG_DEBUG (("Shipped a delta of %u bytes.\n", len));
+
+  ship_last = *logger;
+  ship_visitors = visitors;
+  ht_reset_counters ();
+
+  return 0;
+}
+
+/* Start listening for agents on the given Unix socket.
+ *
+ * On error, -1 is returned.
+ * On success, 0 is returned. */
+int
+aggr_listen (const char *path)
+{
+  struct sockaddr_un addr;
+
+  if (set_sockaddr (&addr, path))
+    return -1;
+  if ((aggr_fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+    return -1;
+
+  unlink (path);
+  if (bind (aggr_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 ||
+      listen (aggr_fd, SHIP_MAX_PEERS) == -1) {
+    close (aggr_fd);
+    aggr_fd = -1;
+    return -1;
+  }
+  aggr_path = xstrdup (path);
+
+  return 0;
+}
+
+/* Get the number of agents currently connected. */
+int
+aggr_peers (void)
+{
+  return aggr_npeers;
+}
+
+/* Accept a connecting agent. */
+static void
+aggr_accept (void)
+{
+  GShipPeer *peer;
+  int fd;
+
+  if ((fd = accept (aggr_fd, NULL, NULL)) == -1)
+    return;
+  if (aggr_npeers == SHIP_MAX_PEERS) {
+    LOG_DEBUG (("Too many agents, connection refused.\n"));
+    close (fd);
+    return;
+  }
+
+  peer = xcalloc (1, sizeof (GShipPeer));
+  peer->fd = fd;
+  aggr_peer_list[aggr_npeers++] = peer;
+}
+
+/* Disconnect and free the agent at the given index. */
+static void
+aggr_drop (int idx)
+{
+  GShipPeer *peer = aggr_peer_list[idx];
+  int i;
+
+  close (peer->fd);
+  for (i = 0; i < TOTAL_MODULES; i++)
+    free (peer->keys[i]);
+  free (peer->in.data);
+  free (peer);
+
+  aggr_peer_list[idx] = aggr_peer_list[--aggr_npeers];
+}
+
+/* Map one of the agent's int keys, checked by merge_key(), to a local
+ * int key. */
+static void
+peer_set_key (GShipPeer * peer, GModule module, uint32_t nkey, int local)
+{
+  uint32_t n = peer->nkeys[module];
+
+  if (nkey >= n) {
+    n = nkey + 1 > n * 2 ? nkey + 1 : n * 2;
+    peer->keys[module] = xrealloc (peer->keys[module], n * sizeof (int));
+    memset (peer->keys[module] + peer->nkeys[module], 0,
+            (n - peer->nkeys[module]) * sizeof (int));
+    peer->nkeys[module] = n;
+  }
+  peer->keys[module][nkey] = local;
+}
+
+/* Get the local int key of one of the agent's int keys.
+ *
+ * If not mapped, 0 is returned. */
+static int
+peer_get_key (GShipPeer * peer, GModule module, uint32_t nkey)
+{
+  if (nkey >= peer->nkeys[module])
+    return 0;
+  return peer->keys[module][nkey];
+}
+
+/* Merge a new key into the local storage. */
+static int
+merge_key (GShipPeer * peer, GShipBuf * b)
+{
+  const char *key, *data, *root, *method, *protocol;
+  uint32_t nkey;
+  uint8_t module;
+  int local, root_nkey;
+
+  if (get_u8 (b, &module) || get_u32 (b, &nkey) || get_str (b, &key) ||
+      get_str (b, &data) || get_str (b, &root) || get_str (b, &method) ||
+      get_str (b, &protocol))
+    return 1;
+  if (module >= TOTAL_MODULES || key == NULL || data == NULL)
+    return 1;
+  /* agents' keys are int keys, counted from 1. The keys of a message
+   * are new ones, or the roots left out between them, so they cannot
+   * go past those already mapped by more than the message's length */
+  if (nkey == 0 || nkey > INT_MAX ||
+      (uint64_t) nkey > peer->nkeys[module] + (uint64_t) b->len)
+    return 1;
+
+  if ((local = ht_insert_keymap (module, key, str_hash64 (key))) == -1)
+    return 0;
+  ht_insert_datamap (module, local, data);
+
+  if (root) {
+    root_nkey = ht_insert_keymap (module, root, str_hash64 (root));
+    ht_insert_rootmap (module, root_nkey, root);
+    ht_insert_root (module, local, root_nkey);
+  }
+  if (method)
+    ht_insert_method (module, local, method);
+  if (protocol)
+    ht_insert_protocol (module, local, protocol);
+
+  peer_set_key (peer, module, nkey, local);
+
+  return 0;
+}
+
+/* Merge the counter increments of a key into the local storage. */
+static int
+merge_count (GShipPeer * peer, GShipBuf * b)
+{
+  uint64_t bw, cumts, maxts;
+  uint32_t nkey, hits, visitors;
+  uint8_t module;
+  int local;
+
+  if (get_u8 (b, &module) || get_u32 (b, &nkey) || get_u32 (b, &hits) ||
+      get_u32 (b, &visitors) || get_u64 (b, &bw) || get_u64 (b, &cumts) ||
+      get_u64 (b, &maxts))
+    return 1;
+  if (module >= TOTAL_MODULES)
+    return 1;
+
+  /* ignored panel, or unknown key */
+  if ((local = peer_get_key (peer, module, nkey)) <= 0)
+    return 0;
+
+  ht_insert_hits (module, local, hits);
+  if (visitors)
+    ht_insert_visitor (module, local, visitors);
+  ht_insert_bw (module, local, bw);
+  ht_insert_cumts (module, local, cumts);
+  ht_insert_maxts (module, local, maxts);
+
+  /* the aggregator has no log format to tell what agents measure */
+  if (bw)
+    conf.bandwidth = 1;
+  if (cumts)
+    conf.serve_usecs = 1;
+
+  return 0;
+}
+
+/* Count the unique visitors reported by an agent. Agents do not share
+ * their visitors, so they are only added up. */
+static void
+merge_visitors (GShipPeer * peer, uint32_t visitors)
+{
+  peer->visitors += visitors;
+  aggr_merged_visitors += visitors;
+}
+
+/* Get the unique visitors merged from all agents, connected or not.
+ * They are on top of those of the aggregator's own log, if any. */
+uint32_t
+aggr_visitors (void)
+{
+  return aggr_merged_visitors;
+}
+
+/* Merge a whole delta message into the local storage and counters.
+ *
+ * On error, i.e., a malformed message, 1 is returned.
+ * On success, 0 is returned. */
+static int
+merge_delta (GShipPeer * peer, GShipBuf * b, GLog * logger)
+{
+  uint32_t processed, invalid, valid, excluded, visitors;
+  uint64_t resp_size;
+  uint8_t type;
+
+  if (get_u32 (b, &processed) || get_u32 (b, &invalid) ||
+      get_u32 (b, &valid) || get_u32 (b, &excluded) ||
+      get_u32 (b, &visitors) || get_u64 (b, &resp_size))
+    return 1;
+
+  while (1) {
+    if (get_u8 (b, &type))
+      return 1;
+    if (type == SHIP_END)
+      break;
+    if (type == SHIP_KEY && merge_key (peer, b))
+      return 1;
+    if (type == SHIP_COUNT && merge_count (peer, b))
+      return 1;
+    if (type != SHIP_KEY && type != SHIP_COUNT)
+      return 1;
+  }
+
+  logger->processed += processed;
+  logger->invalid += invalid;
+  logger->valid += valid;
+  logger->excluded_ip += excluded;
+  logger->resp_size += resp_size;
+  merge_visitors (peer, visitors);
+
+  return 0;
+}
+
+/* Read from an agent and merge every complete message received.
+ *
+ * On error, or if the agent disconnected, -1 is returned.
+ * On success, the number of merged messages is returned. */
+static int
+aggr_read (GShipPeer * peer, GLog * logger)
+{
+  GShipBuf *in = &peer->in, msg;
+  uint32_t len;
+  ssize_t n;
+  int merged = 0;
+
+  if (in->cap - in->len < SHIP_READ_LEN) {
+    in->cap = in->len + SHIP_READ_LEN;
+    in->data = xrealloc (in->data, in->cap);
+  }
+  if ((n = recv (peer->fd, in->data + in->len, in->cap - in->len, 0)) <= 0)
+    return -1;
+  in->len += n;
+
+  while (in->len - in->pos >= SHIP_HDR_LEN) {
+    if (memcmp (in->data + in->pos, SHIP_MAGIC, 4) != 0)
+      return -1;
+    memcpy (&len, in->data + in->pos + 4, sizeof (len));
+    if (len > SHIP_MAX_MSG)
+      return -1;
+    if (in->len - in->pos - SHIP_HDR_LEN < len)
+      break;
+
+    msg.data = in->data + in->pos + SHIP_HDR_LEN;
+    msg.len = len;
+    msg.cap = len;
+    msg.pos = 0;
+    if (merge_delta (peer, &msg, logger))
+      return -1;
+
+    in->pos += SHIP_HDR_LEN + len;
+    merged++;
+  }
+
+  /* keep the incomplete message, if any */
+  memmove (in->data, in->data + in->pos, in->len - in->pos);
+  in->len -= in->pos;
+  in->pos = 0;
+
+  return merged;
+}
+
+/* Wait up to the given timeout (ms, -1 for no timeout) for agents to
+ * connect or to ship their deltas, and merge them.
+ *
+ * On success, the number of merged messages is returned. */
+int
+aggr_poll (GLog * logger, int timeout)
+{
+  struct pollfd fds[SHIP_MAX_PEERS + 1];
+  int i, n, npeers = aggr_npeers, merged = 0;
+
+  if (aggr_fd == -1)
+    return 0;
+
+  fds[0].fd = aggr_fd;
+  fds[0].events = POLLIN;
+  for (i = 0; i < npeers; i++) {
+    fds[i + 1].fd = aggr_peer_list[i]->fd;
+    fds[i + 1].events = POLLIN;
+  }
+
+  if (poll (fds, npeers + 1, timeout) <= 0)
+    return 0;
+
+  /* drop from the back, so the indexes of the remaining peers hold */
+  for (i = npeers - 1; i >= 0; i--) {
+    if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+      continue;
+    if ((n = aggr_read (aggr_peer_list[i], logger)) == -1)
+      aggr_drop (i);
+    else
+      merged += n;
+  }
+
+  if (fds[0].revents & POLLIN)
+    aggr_accept ();
+
+  return merged;
+}
+
+/* Disconnect all agents and stop listening. */
+void
+aggr_close (void)
+{
+  while (aggr_npeers > 0)
+    aggr_drop (aggr_npeers - 1);
+
+  if (aggr_fd != -1)
+    close (aggr_fd);
+  aggr_fd = -1;
+
+  if (aggr_path != NULL)
+    unlink (aggr_path);
+  free (aggr_path);
+  aggr_path = NULL;
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#ifndef SHIP_H_INCLUDED
+#define SHIP_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "commons.h"
+#include "parser.h"
+
+#define SHIP_MAGIC       "GODL"
+#define SHIP_HDR_LEN     8
+#define SHIP_MAX_MSG     (256 * 1024 * 1024)
+#define SHIP_MAX_PEERS   64
+#define SHIP_READ_LEN    65536
+/* Default seconds between shipped deltas */
+#define SHIP_INTERVAL    5
+
+/* Delta record types */
+typedef enum GShipRecord_
+{
+  SHIP_END,
+  SHIP_KEY,
+  SHIP_COUNT,
+} GShipRecord;
+
+/* A growable message buffer, also read through a cursor */
+typedef struct GShipBuf_
+{
+  char *data;
+  size_t len;
+  size_t cap;
+  size_t pos;
+} GShipBuf;
+
+/* An agent connected to the aggregator */
+typedef struct GShipPeer_
+{
+  int fd;
+  uint32_t visitors;            /* unique visitors merged so far */
+  GShipBuf in;
+
+  /* maps the agent's int keys to local int keys, per module */
+  int *keys[TOTAL_MODULES];
+  uint32_t nkeys[TOTAL_MODULES];
+} GShipPeer;
+
+int aggr_listen (const char *path);
+int aggr_peers (void);
+uint32_t aggr_visitors (void);
+int aggr_poll (GLog * logger, int timeout);
+void aggr_close (void);
+
+int ship_connect (const char *path);
+int ship_delta (GLog * logger);
+void ship_close (void);
+
+#endif
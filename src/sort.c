@@ -49,7 +49,7 @@ const int sort_choices[][SORT_MAX_OPTS] = {
   {SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_DATA, SORT_BY_BW, SORT_BY_AVGTS, SORT_BY_CUMTS, SORT_BY_MAXTS, -1},
   {SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_DATA, SORT_BY_BW, SORT_BY_AVGTS, SORT_BY_CUMTS, SORT_BY_MAXTS, -1},
   {SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_DATA, SORT_BY_BW, SORT_BY_AVGTS, SORT_BY_CUMTS, SORT_BY_MAXTS, -1},
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_DATA, SORT_BY_BW, SORT_BY_AVGTS, SORT_BY_CUMTS, SORT_BY_MAXTS, -1},
 #endif
   {SORT_BY_HITS, SORT_BY_VISITORS, SORT_BY_DATA, SORT_BY_BW, SORT_BY_AVGTS, SORT_BY_CUMTS, SORT_BY_MAXTS, -1},
@@ -85,10 +85,13 @@ GSort module_sort[TOTAL_MODULES] = {
   {REFERRERS           , SORT_BY_HITS , SORT_DESC } ,
   {REFERRING_SITES     , SORT_BY_HITS , SORT_DESC } ,
   {KEYPHRASES          , SORT_BY_HITS , SORT_DESC } ,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION        , SORT_BY_HITS , SORT_DESC } ,
 #endif
   {STATUS_CODES        , SORT_BY_HITS , SORT_DESC } ,
+  {CUSTOM_1            , SORT_BY_HITS , SORT_DESC } ,
+  {CUSTOM_2            , SORT_BY_HITS , SORT_DESC } ,
+  {CUSTOM_3            , SORT_BY_HITS , SORT_DESC } ,
 };
 /* *INDENT-ON* */
 
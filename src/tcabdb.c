@@ -29,7 +29,7 @@
 #include "tcabdb.h"
 #include "tcbtdb.h"
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 #include "geolocation.h"
 #endif
 
@@ -42,11 +42,13 @@
 static GTCStorage *tc_storage;
 
 /* tables for the whole app */
-static TCADB *ht_agent_keys = NULL;
-static TCADB *ht_agent_vals = NULL;
-static TCADB *ht_general_stats = NULL;
-static TCADB *ht_hostnames = NULL;
-static TCADB *ht_unique_keys = NULL;
+static void *ht_agent_keys = NULL;
+static void *ht_agent_vals = NULL;
+static void *ht_general_stats = NULL;
+static void *ht_unique_keys = NULL;
+#ifdef TCB_BTREE
+static void *ht_top_items = NULL;
+#endif
 
 /* Instantiate a new store */
 static GTCStorage *
@@ -56,6 +58,7 @@ new_tcstorage (uint32_t size)
   return storage;
 }
 
+#ifdef TCB_MEMHASH
 /* Open a concrete database */
 static int
 tc_adb_open (TCADB * adb, const char *params)
@@ -68,118 +71,135 @@ tc_adb_open (TCADB * adb, const char *params)
 
 /* Close the database handle */
 static int
-tc_db_close (TCADB * adb, char *dbname)
+tc_db_close (TCADB * adb)
 {
   if (adb == NULL)
     return 1;
 
   /* close the database */
   if (!tcadbclose (adb))
-    FATAL ("Unable to close DB: %s", dbname);
+    FATAL ("Unable to close DB");
 
   /* delete the object */
   tcadbdel (adb);
 
-#ifdef TCB_BTREE
-  /* remove database file */
-  if (!conf.keep_db_files && !tcremovelink (dbname))
-    LOG_DEBUG (("Unable to remove DB: %s\n", dbname));
-#endif
-  free (dbname);
-
   return 0;
 }
 
-/* Setup a database given the file path and open it up */
+/* Setup an on-memory hash database and open it up */
 static TCADB *
-tc_adb_create (char *path)
+tc_adb_create (void)
 {
-  char params[DB_PARAMS] = "";
   TCADB *adb = tcadbnew ();
 
+  if (tc_adb_open (adb, "*"))
+    FATAL ("Unable to open an abstract database");
+
+  return adb;
+}
+#endif
+
+/* Create the store of a table given a module, or TC_GLOBAL_TABLE, and
+ * a metric. The on-disk tables share a single database. */
+static void *
+new_table (GO_UNUSED int module, GO_UNUSED int metric)
+{
 #ifdef TCB_MEMHASH
-  xstrncpy (params, path, DB_PARAMS);
+  return tc_adb_create ();
 #endif
 #ifdef TCB_BTREE
-  tc_db_get_params (params, path);
+  return tc_bdb_table (module, metric);
 #endif
+}
 
-  if (tc_adb_open (adb, params)) {
-    free (path);
-    LOG_DEBUG (("params: %s", params));
-    FATAL ("Unable to open an abstract database: %s", params);
-  }
-
-  free (path);
-
-  return adb;
+/* Close the store of a table */
+static void
+close_table (void *hash)
+{
+#ifdef TCB_MEMHASH
+  tc_db_close (hash);
+#endif
+#ifdef TCB_BTREE
+  tc_bdb_close_table (hash);
+#endif
 }
 
-/* Get the file path for the given a database name */
-static char *
-get_dbname (const char *dbname, int module)
+/* Store a record, if the key exists its value is replaced.
+ *
+ * On error, 1 is returned.
+ * On success, 0 is returned. */
+static int
+tc_put (void *hash, const void *key, int ksize, const void *value, int vsize)
 {
-  char *path = NULL;
 #ifdef TCB_MEMHASH
-  (void) dbname;
-  (void) module;
-  path = alloc_string ("*");
+  return !tcadbput (hash, key, ksize, value, vsize);
+#endif
+#ifdef TCB_BTREE
+  return tc_bdb_put (hash, key, ksize, value, vsize);
 #endif
+}
 
+/* Get the malloc'd value of a record.
+ *
+ * If not found, NULL is returned. */
+static void *
+tc_get (void *hash, const void *key, int ksize, int *vsize)
+{
+#ifdef TCB_MEMHASH
+  return tcadbget (hash, key, ksize, vsize);
+#endif
 #ifdef TCB_BTREE
-  char *db = NULL;
-  path = tc_db_set_path (dbname, module);
-
-  if (module >= 0) {
-    db = xmalloc (snprintf (NULL, 0, "%s", path) + 1);
-    sprintf (db, "%s", path);
-    free (path);
-    return db;
-  }
+  return tc_bdb_get (hash, key, ksize, vsize);
 #endif
+}
 
-  return path;
+/* Get the malloc'd value of a record given a string key.
+ *
+ * If not found, NULL is returned. */
+static void *
+tc_get2 (void *hash, const char *key)
+{
+  int sp = 0;
+  return tc_get (hash, key, strlen (key), &sp);
 }
 
-/* Initialize map & metric hashes */
-static void
-init_tables (GModule module)
+/* Add an int to the value of a record.
+ *
+ * On error, INT_MIN is returned.
+ * On success, the new value is returned. */
+static int
+tc_addint (void *hash, const void *key, int ksize, int inc)
 {
-  GTCStorageMetric mtrc;
-  int n = 0, i;
-
-  /* *INDENT-OFF* */
-  GTCStorageMetric metrics[] = {
-    {MTRC_KEYMAP    , DB_KEYMAP    , NULL} ,
-    {MTRC_ROOTMAP   , DB_ROOTMAP   , NULL} ,
-    {MTRC_DATAMAP   , DB_DATAMAP   , NULL} ,
-    {MTRC_UNIQMAP   , DB_UNIQMAP   , NULL} ,
-    {MTRC_ROOT      , DB_ROOT      , NULL} ,
-    {MTRC_HITS      , DB_HITS      , NULL} ,
-    {MTRC_VISITORS  , DB_VISITORS  , NULL} ,
-    {MTRC_BW        , DB_BW        , NULL} ,
-    {MTRC_CUMTS     , DB_CUMTS     , NULL} ,
-    {MTRC_MAXTS     , DB_MAXTS     , NULL} ,
-    {MTRC_METHODS   , DB_METHODS   , NULL} ,
-    {MTRC_PROTOCOLS , DB_PROTOCOLS , NULL} ,
-    {MTRC_AGENTS    , DB_AGENTS    , NULL} ,
-  };
-  /* *INDENT-ON* */
-
-  n = ARRAY_SIZE (metrics);
-  for (i = 0; i < n; i++) {
-    mtrc = metrics[i];
 #ifdef TCB_MEMHASH
-    mtrc.store = tc_adb_create (get_dbname (mtrc.dbname, module));
+  return tcadbaddint (hash, key, ksize, inc);
 #endif
 #ifdef TCB_BTREE
-    /* allow for duplicate keys */
-    if (mtrc.metric == MTRC_AGENTS)
-      mtrc.store = tc_bdb_create (DB_AGENTS, module);
-    else
-      mtrc.store = tc_adb_create (get_dbname (mtrc.dbname, module));
+  return tc_bdb_addint (hash, key, ksize, inc);
+#endif
+}
+
+/* Get the number of records of a table */
+static uint32_t
+ht_get_size (void *hash)
+{
+#ifdef TCB_MEMHASH
+  return tcadbrnum (hash);
+#endif
+#ifdef TCB_BTREE
+  return ((GTCTable *) hash)->rnum;
 #endif
-    tc_storage[module].metrics[i] = mtrc;
+}
+
+/* Initialize map & metric hashes. Their stores are created on first
+ * use, so metrics never inserted take nothing. */
+static void
+init_tables (GModule module)
+{
+  int i;
+
+  for (i = 0; i < GSMTRC_TOTAL; i++) {
+    tc_storage[module].metrics[i].metric = i;
+    tc_storage[module].metrics[i].store = NULL;
   }
 }
 
@@ -191,11 +211,13 @@ init_storage (void)
   size_t idx = 0;
 
   /* Hashes used across the whole app (not per module) */
-  ht_agent_keys = tc_adb_create (get_dbname (DB_AGENT_KEYS, -1));
-  ht_agent_vals = tc_adb_create (get_dbname (DB_AGENT_VALS, -1));
-  ht_general_stats = tc_adb_create (get_dbname (DB_GEN_STATS, -1));
-  ht_hostnames = tc_adb_create (get_dbname (DB_HOSTNAMES, -1));
-  ht_unique_keys = tc_adb_create (get_dbname (DB_UNIQUE_KEYS, -1));
+  ht_agent_keys = new_table (TC_GLOBAL_TABLE, TC_AGENT_KEYS);
+  ht_agent_vals = new_table (TC_GLOBAL_TABLE, TC_AGENT_VALS);
+  ht_general_stats = new_table (TC_GLOBAL_TABLE, TC_GEN_STATS);
+  ht_unique_keys = new_table (TC_GLOBAL_TABLE, TC_UNIQUE_KEYS);
+#ifdef TCB_BTREE
+  ht_top_items = new_table (TC_GLOBAL_TABLE, TC_TOP_ITEMS);
+#endif
 
   tc_storage = new_tcstorage (TOTAL_MODULES);
 
@@ -212,19 +234,11 @@ static void
 free_metrics (GModule module)
 {
   int i;
-  GTCStorageMetric mtrc;
 
   for (i = 0; i < GSMTRC_TOTAL; i++) {
-    mtrc = tc_storage[module].metrics[i];
-#ifdef TCB_MEMHASH
-    tc_db_close (mtrc.store, get_dbname (mtrc.dbname, module));
-#endif
-#ifdef TCB_BTREE
-    if (mtrc.metric == MTRC_AGENTS)
-      tc_bdb_close (mtrc.store, get_dbname (mtrc.dbname, module));
-    else
-      tc_db_close (mtrc.store, get_dbname (mtrc.dbname, module));
-#endif
+    if (tc_storage[module].metrics[i].store != NULL)
+      close_table (tc_storage[module].metrics[i].store);
+    tc_storage[module].metrics[i].store = NULL;
   }
 }
 
@@ -234,43 +248,40 @@ free_storage (void)
 {
   size_t idx = 0;
 
-  tc_db_close (ht_agent_keys, get_dbname (DB_AGENT_KEYS, -1));
-  tc_db_close (ht_agent_vals, get_dbname (DB_AGENT_VALS, -1));
-  tc_db_close (ht_general_stats, get_dbname (DB_GEN_STATS, -1));
-  tc_db_close (ht_hostnames, get_dbname (DB_HOSTNAMES, -1));
-  tc_db_close (ht_unique_keys, get_dbname (DB_UNIQUE_KEYS, -1));
+  close_table (ht_agent_keys);
+  close_table (ht_agent_vals);
+  close_table (ht_general_stats);
+  close_table (ht_unique_keys);
+#ifdef TCB_BTREE
+  close_table (ht_top_items);
+#endif
 
   FOREACH_MODULE (idx, module_list) {
     free_metrics (module_list[idx]);
   }
+#ifdef TCB_BTREE
+  tc_bdb_close ();
+#endif
 }
 
-static uint32_t
-ht_get_size (TCADB * adb)
-{
-  return tcadbrnum (adb);
-}
-
-/* Given a module and a metric, get the hash table
+/* Given a module and a metric, get the hash table. It is created on
+ * first use.
  *
  * On error, or if table is not found, NULL is returned.
  * On success the hash structure pointer is returned. */
 static void *
 get_hash (GModule module, GSMetric metric)
 {
-  void *hash = NULL;
-  int i;
-  GTCStorageMetric mtrc;
+  GTCStorageMetric *mtrc;
 
-  for (i = 0; i < GSMTRC_TOTAL; i++) {
-    mtrc = tc_storage[module].metrics[i];
-    if (mtrc.metric != metric)
-      continue;
-    hash = mtrc.store;
-    break;
-  }
+  if (metric >= GSMTRC_TOTAL)
+    return NULL;
 
-  return hash;
+  mtrc = &tc_storage[module].metrics[metric];
+  if (mtrc->store == NULL)
+    mtrc->store = new_table (module, metric);
+
+  return mtrc->store;
 }
 
 /* Insert a string key and the corresponding int value.
@@ -285,8 +296,8 @@ ins_si32 (void *hash, const char *key, int value)
     return -1;
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, key, strlen (key), &value, sizeof (int)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, key, strlen (key), &value, sizeof (int)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -303,26 +314,8 @@ ins_is32 (void *hash, int key, const char *value)
     return -1;
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, &key, sizeof (int), value, strlen (value)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
-
-  return 0;
-}
-
-/* Insert a string key and the corresponding string value.
- * Note: If the key exists, the value is not replaced.
- *
- * On error, or if key exists, -1 is returned.
- * On success 0 is returned */
-static int
-ins_ss32 (void *hash, const char *key, const char *value)
-{
-  if (!hash)
-    return -1;
-
-  /* if key exists in the database, it is overwritten */
-  if (!tcadbput2 (hash, key, value))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, &key, sizeof (int), value, strlen (value)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -339,8 +332,8 @@ ins_ii32 (void *hash, int key, int value)
     return -1;
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, &key, sizeof (int), &value, sizeof (int)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, &key, sizeof (int), &value, sizeof (int)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -357,8 +350,8 @@ ins_iu64 (void *hash, int key, uint64_t value)
     return -1;
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, &key, sizeof (int), &value, sizeof (uint64_t)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, &key, sizeof (int), &value, sizeof (uint64_t)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -375,8 +368,8 @@ inc_ii32 (void *hash, int key, int inc)
     return -1;
 
   /* if key exists in the database, it is incremented */
-  if (tcadbaddint (hash, &key, sizeof (int), inc) == INT_MIN)
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_addint (hash, &key, sizeof (int), inc) == INT_MIN)
+    LOG_DEBUG (("Unable to tc_addint\n"));
 
   return 0;
 }
@@ -396,14 +389,14 @@ inc_iu64 (void *hash, int key, uint64_t inc)
   if (!hash)
     return -1;
 
-  if ((ptr = tcadbget (hash, &key, sizeof (int), &sp)) != NULL) {
+  if ((ptr = tc_get (hash, &key, sizeof (int), &sp)) != NULL) {
     value = (*(uint64_t *) ptr) + inc;
     free (ptr);
   }
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, &key, sizeof (int), &value, sizeof (uint64_t)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, &key, sizeof (int), &value, sizeof (uint64_t)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -421,14 +414,14 @@ inc_si32 (void *hash, const char *key, int inc)
   if (!hash)
     return -1;
 
-  if ((ptr = tcadbget2 (hash, key)) != NULL) {
+  if ((ptr = tc_get2 (hash, key)) != NULL) {
     value = (*(int *) ptr) + inc;
     free (ptr);
   }
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, key, strlen (key), &value, sizeof (int)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, key, strlen (key), &value, sizeof (int)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -446,14 +439,14 @@ inc_su64 (void *hash, const char *key, uint64_t inc)
   if (!hash)
     return -1;
 
-  if ((ptr = tcadbget2 (hash, key)) != NULL) {
+  if ((ptr = tc_get2 (hash, key)) != NULL) {
     value = (*(uint64_t *) ptr) + inc;
     free (ptr);
   }
 
   /* if key exists in the database, it is overwritten */
-  if (!tcadbput (hash, key, strlen (key), &value, sizeof (uint64_t)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, key, strlen (key), &value, sizeof (uint64_t)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 
   return 0;
 }
@@ -506,7 +499,7 @@ ins_igsl (void *hash, int key, int value)
     return -1;
 
   /* key found, check if key exists within the list */
-  if ((list = tcadbget (hash, &key, sizeof (int), &sp)) != NULL) {
+  if ((list = tc_get (hash, &key, sizeof (int), &sp)) != NULL) {
     if ((match = list_find (list, find_int_key_in_list, &value)))
       goto out;
     list = list_insert_prepend (list, int2ptr (value));
@@ -514,8 +507,8 @@ ins_igsl (void *hash, int key, int value)
     list = list_create (int2ptr (value));
   }
 
-  if (!tcadbput (hash, &key, sizeof (int), list, sizeof (GSLList)))
-    LOG_DEBUG (("Unable to tcadbput\n"));
+  if (tc_put (hash, &key, sizeof (int), list, sizeof (GSLList)))
+    LOG_DEBUG (("Unable to tc_put\n"));
 out:
   free (list);
 
@@ -538,7 +531,7 @@ get_si32 (void *hash, const char *key)
     return -1;
 
   /* key found, return current value */
-  if ((ptr = tcadbget2 (hash, key)) != NULL) {
+  if ((ptr = tc_get2 (hash, key)) != NULL) {
     ret = (*(int *) ptr);
     free (ptr);
     return ret;
@@ -560,7 +553,7 @@ get_sui32 (void *hash, const char *key)
     return 0;
 
   /* key found, return current value */
-  if ((ptr = tcadbget2 (hash, key)) != NULL) {
+  if ((ptr = tc_get2 (hash, key)) != NULL) {
     ret = (*(uint32_t *) ptr);
     free (ptr);
     return ret;
@@ -582,7 +575,7 @@ get_su64 (void *hash, const char *key)
     return 0;
 
   /* key found, return current value */
-  if ((ptr = tcadbget2 (hash, key)) != NULL) {
+  if ((ptr = tc_get2 (hash, key)) != NULL) {
     ret = (*(uint64_t *) ptr);
     free (ptr);
     return ret;
@@ -604,25 +597,7 @@ get_is32 (void *hash, int key)
   if (!hash)
     return NULL;
 
-  if ((value = tcadbget (hash, &key, sizeof (int), &sp)) != NULL)
-    return value;
-
-  return NULL;
-}
-
-/* Get the string value of a given string key.
- *
- * On error, NULL is returned.
- * On success the string value for the given key is returned */
-static char *
-get_ss32 (void *hash, const char *key)
-{
-  char *value = NULL;
-
-  if (!hash)
-    return NULL;
-
-  if ((value = tcadbget2 (hash, key)) != NULL)
+  if ((value = tc_get (hash, &key, sizeof (int), &sp)) != NULL)
     return value;
 
   return NULL;
@@ -643,7 +618,7 @@ get_ii32 (void *hash, int key)
     return -1;
 
   /* key found, return current value */
-  if ((ptr = tcadbget (hash, &key, sizeof (int), &sp)) != NULL) {
+  if ((ptr = tc_get (hash, &key, sizeof (int), &sp)) != NULL) {
     ret = (*(int *) ptr);
     free (ptr);
     return ret;
@@ -667,7 +642,7 @@ get_iu64 (void *hash, int key)
     return 0;
 
   /* key found, return current value */
-  if ((ptr = tcadbget (hash, &key, sizeof (int), &sp)) != NULL) {
+  if ((ptr = tc_get (hash, &key, sizeof (int), &sp)) != NULL) {
     ret = (*(uint64_t *) ptr);
     free (ptr);
     return ret;
@@ -690,12 +665,13 @@ get_igsl (void *hash, int key)
     return NULL;
 
   /* key found, return current value */
-  if ((list = tcadbget (hash, &key, sizeof (int), &sp)) != NULL)
+  if ((list = tc_get (hash, &key, sizeof (int), &sp)) != NULL)
     return list;
 
   return NULL;
 }
 
+#ifdef TCB_BTREE
 /* Get the TCLIST value of a given int key.
  *
  * On error, or if key is not found, NULL is returned.
@@ -709,11 +685,12 @@ get_itcli (void *hash, int key)
     return NULL;
 
   /* key found, return current value */
-  if ((list = tcbdbget4 (hash, &key, sizeof (int))) != NULL)
+  if ((list = tc_bdb_getdup (hash, &key, sizeof (int))) != NULL)
     return list;
 
   return NULL;
 }
+#endif
 
 /* Insert a unique visitor key string (IP/DATE/UA), mapped to an auto
  * incremented value.
@@ -722,7 +699,7 @@ get_itcli (void *hash, int key)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_unique_key (const char *key)
+ht_insert_unique_key (const char *key, GO_UNUSED uint64_t hkey)
 {
   int value = -1;
   void *hash = ht_unique_keys;
@@ -742,7 +719,7 @@ ht_insert_unique_key (const char *key)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_agent_key (const char *key)
+ht_insert_agent_key (const char *key, GO_UNUSED uint64_t hkey)
 {
   int value = -1;
   void *hash = ht_agent_keys;
@@ -777,7 +754,7 @@ ht_insert_agent_value (int key, const char *value)
  * On error, -1 is returned.
  * On success the value of the key inserted is returned */
 int
-ht_insert_keymap (GModule module, const char *key)
+ht_insert_keymap (GModule module, const char *key, GO_UNUSED uint64_t hkey)
 {
   int value = -1;
   void *hash = get_hash (module, MTRC_KEYMAP);
@@ -821,24 +798,29 @@ ht_insert_rootmap (GModule module, int key, const char *value)
   return ins_is32 (hash, key, value);
 }
 
-/* Insert a uniqmap string key.
+/* Insert a data int key and visitor int key pair, i.e., test and set.
+ * Pairs are stored as binary keys with no value.
  *
- * If the given key exists, 0 is returned.
+ * If the visitor was seen for the given key, 0 is returned.
  * On error, -1 is returned.
- * On success the value of the key inserted is returned */
+ * On success, i.e., a new visitor for the key, 1 is returned */
 int
-ht_insert_uniqmap (GModule module, const char *key)
+ht_insert_uniqmap (GModule module, int key, int value)
 {
-  int value = -1;
-  void *hash = get_hash (module, MTRC_UNIQMAP);
+  void *hash = get_hash (module, MTRC_UNIQMAP), *val = NULL;
+  int pair[2] = { key, value }, sp = 0;
 
   if (!hash)
     return -1;
 
-  if ((value = get_si32 (hash, key)) != -1)
+  if ((val = tc_get (hash, pair, sizeof (pair), &sp)) != NULL) {
+    free (val);
     return 0;
+  }
 
-  return ins_si32_ai (hash, key);
+  if (tc_put (hash, pair, sizeof (pair), "", 0))
+    return -1;
+  return 1;
 }
 
 /* Insert a data int key mapped to the corresponding int root key.
@@ -981,21 +963,6 @@ ht_insert_agent (GModule module, int key, int value)
   return ins_igsl (hash, key, value);
 }
 
-/* Insert an IP hostname mapped to the corresponding hostname.
- *
- * On error, or if key exists, -1 is returned.
- * On success 0 is returned */
-int
-ht_insert_hostname (const char *ip, const char *host)
-{
-  void *hash = ht_hostnames;
-
-  if (!hash)
-    return -1;
-
-  return ins_ss32 (hash, ip, host);
-}
-
 /* Increases a general stats counter int from a string key.
  *
  * On error, -1 is returned.
@@ -1040,6 +1007,15 @@ ht_get_size_datamap (GModule module)
   return ht_get_size (hash);
 }
 
+/* Changes are not tracked by the on-disk storage.
+ *
+ * 0 is always returned. */
+uint64_t
+ht_get_changes (GO_UNUSED GModule module)
+{
+  return 0;
+}
+
 /* Get the number of elements in a uniqmap.
  *
  * On error, 0 is returned.
@@ -1085,21 +1061,6 @@ ht_get_keymap (GModule module, const char *key)
   return get_si32 (hash, key);
 }
 
-/* Get the int value from MTRC_UNIQMAP given a string key.
- *
- * On error, -1 is returned.
- * On success the int value for the given key is returned */
-int
-ht_get_uniqmap (GModule module, const char *key)
-{
-  void *hash = get_hash (module, MTRC_UNIQMAP);
-
-  if (!hash)
-    return -1;
-
-  return get_si32 (hash, key);
-}
-
 /* Get the uint32_t value from ht_general_stats given a string key.
  *
  * On error, 0 is returned.
@@ -1238,21 +1199,6 @@ ht_get_protocol (GModule module, int key)
   return get_is32 (hash, key);
 }
 
-/* Get the string value from MTRC_PROTOCOLS given an int key.
- *
- * On error, NULL is returned.
- * On success the string value for the given key is returned */
-char *
-ht_get_hostname (const char *host)
-{
-  void *hash = ht_hostnames;
-
-  if (!hash)
-    return NULL;
-
-  return get_ss32 (hash, host);
-}
-
 /* Get the string value from ht_agent_vals (user agent) given an int key.
  *
  * On error, NULL is returned.
@@ -1283,6 +1229,7 @@ ht_get_host_agent_list (GModule module, int key)
   return NULL;
 }
 
+#ifdef TCB_BTREE
 /* Get the list value from MTRC_AGENTS given an int key.
  *
  * On error, or if key is not found, NULL is returned.
@@ -1297,6 +1244,7 @@ ht_get_host_agent_tclist (GModule module, int key)
     return list;
   return NULL;
 }
+#endif
 
 /* Insert the values from a TCLIST into a GSLList.
  *
@@ -1319,32 +1267,41 @@ tclist_to_gsllist (TCLIST * tclist)
   return list;
 }
 
-/* Calls the given function for each of the key/value pairs */
+/* Calls the given function for each of the key/value pairs. Neither
+ * the key nor the value is owned by the function. */
 static void
-tc_db_foreach (void *db, void (*fp) (TCADB * m, void *k, int s, void *u),
-               void *user_data)
+tc_db_foreach (void *db, void (*fp) (void *k, int ks, void *v, int vs,
+                                     void *u), void *user_data)
 {
+#ifdef TCB_MEMHASH
   TCADB *adb = db;
-  int ksize = 0;
-  void *key;
+  int ksize = 0, vsize = 0;
+  void *key, *value;
 
   tcadbiterinit (adb);
   while ((key = tcadbiternext (adb, &ksize)) != NULL) {
-    (*fp) (adb, key, ksize, user_data);
+    if ((value = tcadbget (adb, key, ksize, &vsize)) != NULL) {
+      (*fp) (key, ksize, value, vsize, user_data);
+      free (value);
+    }
     free (key);
   }
+#endif
+#ifdef TCB_BTREE
+  tc_bdb_foreach (db, fp, user_data);
+#endif
 }
 
-/* Free the key/value pair */
+/* Free the list of values, the head node being a copy owned by the
+ * iteration */
 static void
-free_agent_values (TCADB * adb, void *key, int ksize, GO_UNUSED void *user_data)
+free_agent_values (GO_UNUSED void *key, GO_UNUSED int ksize, void *value,
+                   GO_UNUSED int vsize, GO_UNUSED void *user_data)
 {
-  void *list;
-  int sp = 0;
+  GSLList *list = value;
 
-  list = tcadbget (adb, key, ksize, &sp);
-  if (list)
-    list_remove_nodes (list);
+  free (list->data);
+  list_remove_nodes (list->next);
 }
 
 /* Iterate over the each key/value pair under MTRC_AGENTS and free the and the
@@ -1371,17 +1328,128 @@ set_raw_data (void *key, void *value, GRawData * raw_data)
 
 /* Get the value stored in MTRC_HITS */
 static void
-data_iter_generic (TCADB * adb, void *key, int ksize, void *user_data)
+data_iter_generic (void *key, GO_UNUSED int ksize, void *value,
+                   GO_UNUSED int vsize, void *user_data)
 {
   GRawData *raw_data = user_data;
-  void *value;
-  int sp = 0;
 
-  value = tcadbget (adb, key, ksize, &sp);
-  if (value) {
-    set_raw_data (key, value, raw_data);
-    free (value);
-  }
+  /* the number of records may be off, e.g., a store left by a run that
+   * did not exit cleanly */
+  if (raw_data->idx >= raw_data->size)
+    return;
+  set_raw_data (key, value, raw_data);
+}
+
+/* Child items are not supported by the on-disk storage.
+ *
+ * -1 is always returned. */
+int
+ht_insert_child (GO_UNUSED GModule module, GO_UNUSED int key,
+                 GO_UNUSED const char *value, GO_UNUSED int max)
+{
+  return -1;
+}
+
+/* Child items are not supported by the on-disk storage.
+ *
+ * NULL is always returned. */
+GSLList *
+ht_get_child_list (GO_UNUSED GModule module, GO_UNUSED int key)
+{
+  return NULL;
+}
+
+/* Slowest requests are not supported by the on-disk storage.
+ *
+ * -1 is always returned. */
+int
+ht_insert_slowest (GO_UNUSED GModule module, GO_UNUSED int key,
+                   GO_UNUSED const GSlowItem * item, GO_UNUSED int max,
+                   GO_UNUSED int keys)
+{
+  return -1;
+}
+
+/* Slowest requests are not supported by the on-disk storage.
+ *
+ * NULL is always returned. */
+GSlowHeap *
+ht_get_slowest (GO_UNUSED GModule module, GO_UNUSED int key)
+{
+  return NULL;
+}
+
+/* Shipping deltas is not supported by the on-disk storage. */
+void
+ht_foreach_keymap (GO_UNUSED GModule module, GO_UNUSED int from,
+                   GO_UNUSED void (*fn) (const char *key, int nkey,
+                                         void *user), GO_UNUSED void *user)
+{
+}
+
+/* Shipping deltas is not supported by the on-disk storage. */
+void
+ht_reset_counters (void)
+{
+}
+
+/* Metric tables are created on first use, ignored metrics are simply
+ * not inserted and take nothing. */
+void
+ht_ignore_metric (GO_UNUSED GModule module, GO_UNUSED GSMetric metric)
+{
+}
+
+/* Storage partitions are not supported by the on-disk storage, all
+ * records are kept in a single set of per module tables.
+ *
+ * -1 is always returned. */
+int
+ht_switch_partition (GO_UNUSED const char *key, GO_UNUSED uint64_t hash)
+{
+  return -1;
+}
+
+/* Storage partitions are not supported by the on-disk storage.
+ *
+ * -1 is always returned. */
+int
+ht_set_partition (GO_UNUSED int idx)
+{
+  return -1;
+}
+
+/* Storage partitions are not supported by the on-disk storage. */
+void
+ht_free_partition (GO_UNUSED int idx)
+{
+}
+
+/* Storage partitions are not supported by the on-disk storage.
+ *
+ * 0 is always returned. */
+int
+ht_get_partition_len (void)
+{
+  return 0;
+}
+
+/* Storage partitions are not supported by the on-disk storage.
+ *
+ * NULL is always returned. */
+const char *
+ht_get_partition_key (GO_UNUSED int idx)
+{
+  return NULL;
+}
+
+/* Storage partitions are not supported by the on-disk storage.
+ *
+ * NULL is always returned. */
+GLog *
+ht_get_partition_log (GO_UNUSED int idx)
+{
+  return NULL;
 }
 
 /* Store the key/value pairs from a hash table into raw_data and sorts the the
@@ -1412,3 +1480,70 @@ parse_raw_data (GModule module)
 
   return raw_data;
 }
+
+#ifdef TCB_BTREE
+/* Insert the top items of a module for a sort field, tagged with the
+ * generation of the data they were taken from.
+ *
+ * On error, -1 is returned.
+ * On success 0 is returned */
+int
+ht_insert_top_items (GModule module, int field, const GRawDataItem * items,
+                     int len, uint32_t size, uint32_t gen)
+{
+  GTCTopItems *top;
+  int key[2] = { module, field }, ret = 0;
+  size_t sz = sizeof (GTCTopItems) + len * sizeof (GRawDataItem);
+
+  if (!ht_top_items)
+    return -1;
+
+  top = xmalloc (sz);
+  top->gen = gen;
+  top->size = size;
+  top->len = len;
+  memcpy (top->items, items, len * sizeof (GRawDataItem));
+
+  if (tc_put (ht_top_items, key, sizeof (key), top, sz)) {
+    LOG_DEBUG (("Unable to tc_put\n"));
+    ret = -1;
+  }
+  free (top);
+
+  return ret;
+}
+
+/* Get the top items of a module for a sort field, as raw data holding
+ * those only, yet sized as the whole module.
+ *
+ * If not found, or not of the given generation, NULL is returned.
+ * On success the GRawData is returned */
+GRawData *
+ht_get_top_items (GModule module, int field, uint32_t gen)
+{
+  GRawData *raw_data;
+  GTCTopItems *top;
+  int key[2] = { module, field }, sp = 0;
+
+  if (!ht_top_items)
+    return NULL;
+
+  if ((top = tc_get (ht_top_items, key, sizeof (key), &sp)) == NULL)
+    return NULL;
+  if (sp < (int) sizeof (GTCTopItems) || top->gen != gen ||
+      (size_t) sp != sizeof (GTCTopItems) + top->len * sizeof (GRawDataItem)) {
+    free (top);
+    return NULL;
+  }
+
+  raw_data = new_grawdata ();
+  raw_data->module = module;
+  raw_data->size = top->size;
+  raw_data->idx = top->len;
+  raw_data->items = new_grawdata_item (top->len);
+  memcpy (raw_data->items, top->items, top->len * sizeof (GRawDataItem));
+  free (top);
+
+  return raw_data;
+}
+#endif
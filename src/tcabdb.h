@@ -31,8 +31,6 @@
 #include "gstorage.h"
 #include "parser.h"
 
-#define DB_PARAMS 256
-
 /* Metrics Storage */
 
 /* Maps keys (string) to numeric values (integer).
@@ -71,14 +69,12 @@
  */
 /*khash_t(is32) MTRC_DATAMAP */
 
-/* Maps a string key made from the integer key of the
- * IP/date/UA and the integer key from the data field of
- * each module to numeric autoincremented values. e.g., "14"
- * => 1 -> unique visitor key (concatenated) with 4 -> data
- * key.
+/* Keeps the pairs of the integer key from the data field of each
+ * module and the integer key of the IP/date/UA seen for it, as
+ * binary keys with no value.
  *
- * "14" -> 1
- * "15" -> 2
+ * {4, 1} -> ""
+ * {4, 2} -> ""
  */
 /*khash_t(si32) MTRC_UNIQMAP */
 
@@ -137,11 +133,11 @@
  */
 /*khash_t(igsl) MTRC_AGENTS */
 
-/* Enumerated Storage Metrics */
+/* Enumerated Storage Metrics. A store is created on first use, an
+ * on-memory database or a table of the on-disk store. */
 typedef struct GTCStorageMetric_
 {
   GSMetric metric;
-  const char *dbname;
   void *store;
 } GTCStorageMetric;
 
@@ -156,14 +152,14 @@ void init_storage (void);
 void free_storage (void);
 void free_agent_list (void);
 
-int ht_insert_unique_key (const char *key);
-int ht_insert_agent_key (const char *key);
+int ht_insert_unique_key (const char *key, uint64_t hash);
+int ht_insert_agent_key (const char *key, uint64_t hash);
 int ht_insert_agent_value (int key, const char *value);
 
-int ht_insert_keymap (GModule module, const char *key);
+int ht_insert_keymap (GModule module, const char *key, uint64_t hash);
 int ht_insert_datamap (GModule module, int key, const char *value);
 int ht_insert_rootmap (GModule module, int key, const char *value);
-int ht_insert_uniqmap (GModule module, const char *key);
+int ht_insert_uniqmap (GModule module, int key, int value);
 int ht_insert_root (GModule module, int key, int value);
 int ht_insert_hits (GModule module, int key, int inc);
 int ht_insert_visitor (GModule module, int key, int inc);
@@ -173,21 +169,22 @@ int ht_insert_maxts (GModule module, int key, uint64_t value);
 int ht_insert_method (GModule module, int key, const char *value);
 int ht_insert_protocol (GModule module, int key, const char *value);
 int ht_insert_agent (GModule module, int key, int value);
-int ht_insert_hostname (const char *ip, const char *host);
+int ht_insert_child (GModule module, int key, const char *value, int max);
+int ht_insert_slowest (GModule module, int key, const GSlowItem * item,
+                       int max, int keys);
 int ht_insert_genstats (const char *key, int inc);
 int ht_insert_genstats_bw (const char *key, uint64_t inc);
 
 uint32_t ht_get_size_datamap (GModule module);
+uint64_t ht_get_changes (GModule module);
 uint32_t ht_get_size_uniqmap (GModule module);
 
 char *ht_get_host_agent_val (int key);
 char *ht_get_datamap (GModule module, int key);
-char *ht_get_hostname (const char *host);
 char *ht_get_method (GModule module, int key);
 char *ht_get_protocol (GModule module, int key);
 char *ht_get_root (GModule module, int key);
 int ht_get_keymap (GModule module, const char *key);
-int ht_get_uniqmap (GModule module, const char *key);
 int ht_get_visitors (GModule module, int key);
 uint32_t ht_get_genstats (const char *key);
 uint64_t ht_get_genstats_bw (const char *key);
@@ -196,11 +193,35 @@ uint64_t ht_get_cumts (GModule module, int key);
 uint64_t ht_get_maxts (GModule module, int key);
 
 GSLList *tclist_to_gsllist (TCLIST * tclist);
+GSLList *ht_get_child_list (GModule module, int key);
+GSlowHeap *ht_get_slowest (GModule module, int key);
 GSLList *ht_get_host_agent_list (GModule module, int key);
+#ifdef TCB_BTREE
 TCLIST *ht_get_host_agent_tclist (GModule module, int key);
+#endif
+
+void ht_foreach_keymap (GModule module, int from,
+                        void (*fn) (const char *key, int nkey, void *user),
+                        void *user);
+void ht_reset_counters (void);
+void ht_ignore_metric (GModule module, GSMetric metric);
+
+GLog *ht_get_partition_log (int idx);
+const char *ht_get_partition_key (int idx);
+int ht_get_partition_len (void);
+int ht_switch_partition (const char *key, uint64_t hash);
+int ht_set_partition (int idx);
+void ht_free_partition (int idx);
 
 GRawData *parse_raw_data (GModule module);
 
+#ifdef TCB_BTREE
+int ht_insert_top_items (GModule module, int field,
+                         const GRawDataItem * items, int len, uint32_t size,
+                         uint32_t gen);
+GRawData *ht_get_top_items (GModule module, int field, uint32_t gen);
+#endif
+
 /* *INDENT-ON* */
 
 #endif
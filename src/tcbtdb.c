@@ -20,16 +20,18 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <tcutil.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "tcbtdb.h"
 #include "tcabdb.h"
 
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
 #include "geolocation.h"
 #endif
 
@@ -37,122 +39,68 @@
 #include "xmalloc.h"
 
 #ifdef TCB_BTREE
-char *
-tc_db_set_path (const char *dbname, int module)
+/* The store shared by all tables, opened on first use */
+static TCBDB *tc_store = NULL;
+static char *tc_store_path = NULL;
+/* the number of records of each table, read from an existing store */
+static GTCTable *tc_sizes = NULL;
+
+/* Get the file path of the store. */
+static char *
+tc_db_set_path (const char *dbname)
 {
+  const char *dir = conf.db_path != NULL ? conf.db_path : TC_DBPATH;
   char *path;
-  int cx;
-
-  if (conf.db_path != NULL) {
-    cx = snprintf (NULL, 0, "%s%dm%s", conf.db_path, module, dbname) + 1;
-    path = xmalloc (cx);
-    sprintf (path, "%s%dm%s", conf.db_path, module, dbname);
-  } else {
-    cx = snprintf (NULL, 0, "%s%dm%s", TC_DBPATH, module, dbname) + 1;
-    path = xmalloc (cx);
-    sprintf (path, "%s%dm%s", TC_DBPATH, module, dbname);
-  }
-
-  return path;
-}
 
-static int
-set_dbparam (char *params, int len, const char *fmt, ...)
-{
-  int n;
-  va_list args;
-
-  va_start (args, fmt);
-  n = vsnprintf (params + len, DB_PARAMS - len, fmt, args);
-  va_end (args);
-
-  if (n < 0) {
-    n = 0;
-    LOG_DEBUG (("Output error is encountered on set_dbparam\n"));
-  } else if (n >= DB_PARAMS - len) {
-    LOG_DEBUG (("Output truncated on set_dbparam\n"));
-    n = DB_PARAMS - len;
-  }
+  path = xmalloc (snprintf (NULL, 0, "%s%s", dir, dbname) + 1);
+  sprintf (path, "%s%s", dir, dbname);
 
-  return n;
+  return path;
 }
 
-/* set database parameters */
-void
-tc_db_get_params (char *params, const char *path)
+/* Ensure data kept by an older version, a file per table and module,
+ * is not silently ignored when loading from disk.
+ *
+ * On error, FATAL is triggered. */
+static void
+tc_bdb_check_layout (void)
 {
-  int len = 0;
-  long xmmap = conf.xmmap;
-  uint32_t lcnum, ncnum, lmemb, nmemb, bnum;
-
-  /* copy path name to buffer */
-  len += set_dbparam (params, len, "%s", path);
-
-  /* caching parameters of a B+ tree database object */
-  lcnum = conf.cache_lcnum > 0 ? conf.cache_lcnum : TC_LCNUM;
-  len += set_dbparam (params, len, "#%s=%d", "lcnum", lcnum);
-
-  ncnum = conf.cache_ncnum > 0 ? conf.cache_ncnum : TC_NCNUM;
-  len += set_dbparam (params, len, "#%s=%d", "ncnum", ncnum);
-
-  /* set the size of the extra mapped memory */
-  if (xmmap > 0)
-    len += set_dbparam (params, len, "#%s=%ld", "xmsiz", xmmap);
-
-  lmemb = conf.tune_lmemb > 0 ? conf.tune_lmemb : TC_LMEMB;
-  len += set_dbparam (params, len, "#%s=%d", "lmemb", lmemb);
-
-  nmemb = conf.tune_nmemb > 0 ? conf.tune_nmemb : TC_NMEMB;
-  len += set_dbparam (params, len, "#%s=%d", "nmemb", nmemb);
-
-  bnum = conf.tune_bnum > 0 ? conf.tune_bnum : TC_BNUM;
-  len += set_dbparam (params, len, "#%s=%d", "bnum", bnum);
+  char *old = NULL;
 
-  /* compression */
-  len += set_dbparam (params, len, "#%s=%c", "opts", 'l');
-
-  if (conf.compression == TC_BZ2) {
-    len += set_dbparam (params, len, "%c", 'b');
-  } else if (conf.compression == TC_ZLIB) {
-    len += set_dbparam (params, len, "%c", 'd');
-  }
-
-  /* open flags. create a new database if not exist, otherwise read it */
-  len += set_dbparam (params, len, "#%s=%s", "mode", "wc");
-  /* if not loading from disk, truncate regardless if a db file exists */
-  if (!conf.load_from_disk)
-    len += set_dbparam (params, len, "%c", 't');
+  if (access (tc_store_path, F_OK) == 0)
+    return;
 
-  LOG_DEBUG (("%s\n", path));
-  LOG_DEBUG (("params: %s\n", params));
+  old = tc_db_set_path (DB_OLD_STORE);
+  if (access (old, F_OK) == 0)
+    FATAL ("%s was kept by an older version, it cannot be loaded. Parse "
+           "the logs again with --keep-db-files.", old);
+  free (old);
 }
 
-/* Open the database handle */
-TCBDB *
-tc_bdb_create (const char *dbname, int module)
+/* Open the store. All tables share its cache, sized by the caching
+ * options, and its file.
+ *
+ * On error, FATAL is triggered. */
+static void
+tc_bdb_open (void)
 {
   TCBDB *bdb;
-  char *path = NULL;
   int ecode;
   uint32_t lcnum, ncnum, lmemb, nmemb, bnum, flags;
 
-  path = tc_db_set_path (dbname, module);
+  tc_store_path = tc_db_set_path (DB_STORE);
   bdb = tcbdbnew ();
 
   lcnum = conf.cache_lcnum > 0 ? conf.cache_lcnum : TC_LCNUM;
   ncnum = conf.cache_ncnum > 0 ? conf.cache_ncnum : TC_NCNUM;
 
   /* set the caching parameters of a B+ tree database object */
-  if (!tcbdbsetcache (bdb, lcnum, ncnum)) {
-    free (path);
+  if (!tcbdbsetcache (bdb, lcnum, ncnum))
     FATAL ("Unable to set TCB cache");
-  }
 
   /* set the size of the extra mapped memory */
-  if (conf.xmmap > 0 && !tcbdbsetxmsiz (bdb, conf.xmmap)) {
-    free (path);
+  if (conf.xmmap > 0 && !tcbdbsetxmsiz (bdb, conf.xmmap))
     FATAL ("Unable to set TCB xmmap.");
-  }
 
   lmemb = conf.tune_lmemb > 0 ? conf.tune_lmemb : TC_LMEMB;
   nmemb = conf.tune_nmemb > 0 ? conf.tune_nmemb : TC_NMEMB;
@@ -173,43 +121,216 @@ tc_bdb_create (const char *dbname, int module)
   flags = BDBOWRITER | BDBOCREAT;
   if (!conf.load_from_disk)
     flags |= BDBOTRUNC;
+  else
+    tc_bdb_check_layout ();
 
+  LOG_DEBUG (("%s\n", tc_store_path));
   /* attempt to open the database */
-  if (!tcbdbopen (bdb, path, flags)) {
-    free (path);
+  if (!tcbdbopen (bdb, tc_store_path, flags)) {
     ecode = tcbdbecode (bdb);
-
     FATAL ("%s", tcbdberrmsg (ecode));
   }
-  free (path);
+  tc_store = bdb;
 
-  return bdb;
+  /* the sizes table is a table of its own */
+  tc_sizes = xcalloc (1, sizeof (GTCTable));
+  tc_sizes->prefix[0] = TC_GLOBAL_TABLE;
+  tc_sizes->prefix[1] = TC_TABLE_SIZES;
 }
 
-/* Close the database handle */
-int
-tc_bdb_close (void *db, char *dbname)
+/* Make the key of a record of the given table, i.e., its prefix
+ * followed by the given key. The buffer is used if large enough.
+ *
+ * On success, the composite key is returned. */
+static char *
+tc_bdb_key (GTCTable * tbl, const void *key, int ksize, char *buf, int len)
+{
+  char *ckey = buf;
+
+  if (ksize + 2 > len)
+    ckey = xmalloc (ksize + 2);
+  memcpy (ckey, tbl->prefix, 2);
+  memcpy (ckey + 2, key, ksize);
+
+  return ckey;
+}
+
+/* Free a composite key, unless it is the given buffer. */
+static void
+tc_bdb_free_key (char *ckey, char *buf)
+{
+  if (ckey != buf)
+    free (ckey);
+}
+
+/* Get a table of the store given a module, or TC_GLOBAL_TABLE, and a
+ * metric. The store is opened on first use.
+ *
+ * On success, the new table is returned. */
+GTCTable *
+tc_bdb_table (int module, int metric)
+{
+  GTCTable *tbl = xcalloc (1, sizeof (GTCTable));
+  void *ptr;
+  int sp = 0;
+
+  if (tc_store == NULL)
+    tc_bdb_open ();
+
+  tbl->prefix[0] = module;
+  tbl->prefix[1] = metric;
+
+  /* records of a previous run */
+  if (conf.load_from_disk &&
+      (ptr = tc_bdb_get (tc_sizes, tbl->prefix, 2, &sp)) != NULL) {
+    tbl->rnum = (*(uint32_t *) ptr);
+    free (ptr);
+  }
+
+  return tbl;
+}
+
+/* Free a table, keeping its number of records along its records. */
+void
+tc_bdb_close_table (GTCTable * tbl)
+{
+  if (tbl == NULL)
+    return;
+
+  if (conf.keep_db_files)
+    tc_bdb_put (tc_sizes, tbl->prefix, 2, &tbl->rnum, sizeof (uint32_t));
+  free (tbl);
+}
+
+/* Close the store, once all of its tables are closed.
+ *
+ * On error, FATAL is triggered. */
+void
+tc_bdb_close (void)
 {
-  TCBDB *bdb = db;
   int ecode;
 
-  if (bdb == NULL)
-    return 1;
+  if (tc_store == NULL)
+    return;
 
   /* close the database */
-  if (!tcbdbclose (bdb)) {
-    ecode = tcbdbecode (bdb);
+  if (!tcbdbclose (tc_store)) {
+    ecode = tcbdbecode (tc_store);
     FATAL ("%s", tcbdberrmsg (ecode));
   }
   /* delete the object */
-  tcbdbdel (bdb);
+  tcbdbdel (tc_store);
+  tc_store = NULL;
 
   /* remove database file */
-  if (!conf.keep_db_files && !tcremovelink (dbname))
-    LOG_DEBUG (("Unable to remove DB: %s\n", dbname));
-  free (dbname);
+  if (!conf.keep_db_files && !tcremovelink (tc_store_path))
+    LOG_DEBUG (("Unable to remove DB: %s\n", tc_store_path));
+  free (tc_store_path);
+  free (tc_sizes);
+  tc_store_path = NULL;
+  tc_sizes = NULL;
+}
 
-  return 0;
+/* Store a record in a table. If the key exists, its value is replaced.
+ *
+ * On error, 1 is returned.
+ * On success, 0 is returned. */
+int
+tc_bdb_put (GTCTable * tbl, const void *key, int ksize, const void *value,
+            int vsize)
+{
+  char buf[TC_KEY_BUF], *ckey;
+  uint64_t rnum = tcbdbrnum (tc_store);
+  int ret = 0;
+
+  ckey = tc_bdb_key (tbl, key, ksize, buf, sizeof (buf));
+  if (!tcbdbput (tc_store, ckey, ksize + 2, value, vsize))
+    ret = 1;
+  /* the store only grows if the key is new */
+  else if (tcbdbrnum (tc_store) != rnum)
+    tbl->rnum++;
+  tc_bdb_free_key (ckey, buf);
+
+  return ret;
+}
+
+/* Get the value of a record of a table.
+ *
+ * If not found, NULL is returned.
+ * On success, the malloc'd value is returned. */
+void *
+tc_bdb_get (GTCTable * tbl, const void *key, int ksize, int *vsize)
+{
+  char buf[TC_KEY_BUF], *ckey;
+  void *value;
+
+  ckey = tc_bdb_key (tbl, key, ksize, buf, sizeof (buf));
+  value = tcbdbget (tc_store, ckey, ksize + 2, vsize);
+  tc_bdb_free_key (ckey, buf);
+
+  return value;
+}
+
+/* Add an int to the value of a record of a table.
+ *
+ * On error, INT_MIN is returned.
+ * On success, the new value is returned. */
+int
+tc_bdb_addint (GTCTable * tbl, const void *key, int ksize, int inc)
+{
+  char buf[TC_KEY_BUF], *ckey;
+  uint64_t rnum = tcbdbrnum (tc_store);
+  int value;
+
+  ckey = tc_bdb_key (tbl, key, ksize, buf, sizeof (buf));
+  value = tcbdbaddint (tc_store, ckey, ksize + 2, inc);
+  if (value != INT_MIN && tcbdbrnum (tc_store) != rnum)
+    tbl->rnum++;
+  tc_bdb_free_key (ckey, buf);
+
+  return value;
+}
+
+/* Get all values of a key of a table allowing duplicates.
+ *
+ * If not found, NULL is returned.
+ * On success, the list of values is returned. */
+TCLIST *
+tc_bdb_getdup (GTCTable * tbl, const void *key, int ksize)
+{
+  char buf[TC_KEY_BUF], *ckey;
+  TCLIST *list;
+
+  ckey = tc_bdb_key (tbl, key, ksize, buf, sizeof (buf));
+  list = tcbdbget4 (tc_store, ckey, ksize + 2);
+  tc_bdb_free_key (ckey, buf);
+
+  return list;
+}
+
+/* Calls the given function for each record of a table, walking the
+ * range of its prefix only. */
+void
+tc_bdb_foreach (GTCTable * tbl,
+                void (*fp) (void *k, int ks, void *v, int vs, void *u),
+                void *user_data)
+{
+  BDBCUR *cur = tcbdbcurnew (tc_store);
+  const char *key, *value;
+  int ksize = 0, vsize = 0;
+
+  if (tcbdbcurjump (cur, tbl->prefix, 2)) {
+    while ((key = tcbdbcurkey3 (cur, &ksize)) != NULL) {
+      if (ksize < 2 || memcmp (key, tbl->prefix, 2) != 0)
+        break;
+      if ((value = tcbdbcurval3 (cur, &vsize)) != NULL)
+        (*fp) ((void *) (key + 2), ksize - 2, (void *) value, vsize,
+               user_data);
+      if (!tcbdbcurnext (cur))
+        break;
+    }
+  }
+  tcbdbcurdel (cur);
 }
 
 static int
@@ -242,22 +363,26 @@ is_value_in_tclist (TCLIST * tclist, void *value)
 int
 ins_igsl (void *hash, int key, int value)
 {
+  char buf[TC_KEY_BUF], *ckey;
   TCLIST *list;
-  int in_list = 0;
+  int in_list = 0, ret = -1;
 
   if (!hash)
     return -1;
 
   /* key found, check if key exists within the list */
-  if ((list = tcbdbget4 (hash, &key, sizeof (int))) != NULL) {
+  if ((list = tc_bdb_getdup (hash, &key, sizeof (int))) != NULL) {
     if (is_value_in_tclist (list, &value))
       in_list = 1;
     tclistdel (list);
   }
   /* if not on the list, add it */
-  if (!in_list && tcbdbputdup (hash, &key, sizeof (int), &value, sizeof (int)))
-    return 0;
+  ckey = tc_bdb_key (hash, &key, sizeof (int), buf, sizeof (buf));
+  if (!in_list &&
+      tcbdbputdup (tc_store, ckey, sizeof (int) + 2, &value, sizeof (int)))
+    ret = 0;
+  tc_bdb_free_key (ckey, buf);
 
-  return -1;
+  return ret;
 }
 #endif
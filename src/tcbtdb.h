@@ -32,42 +32,67 @@
 #include "parser.h"
 
 #define TC_MMAP  0
-#define TC_LCNUM 1024
-#define TC_NCNUM 512
+#define TC_LCNUM 4096
+#define TC_NCNUM 1024
 #define TC_LMEMB 128
 #define TC_NMEMB 256
-#define TC_BNUM  32749
+#define TC_BNUM  131071
 #define TC_DBPATH "/tmp/"
 #define TC_ZLIB 1
 #define TC_BZ2  2
 
-/* B+ Tree - on-disk databases */
-#define DB_AGENT_KEYS  "db_agent_keys.tcb"
-#define DB_AGENT_VALS  "db_agent_vals.tcb"
-#define DB_GEN_STATS   "db_gen_stats.tcb"
-#define DB_HOSTNAMES   "db_hostnames.tcb"
-#define DB_UNIQUE_KEYS "db_unique_keys.tcb"
+/* B+ Tree - on-disk database, a single file for all tables */
+#define DB_STORE "db_store.tcb"
+/* general stats of the older layout, a file per table and module */
+#define DB_OLD_STORE "-1mdb_gen_stats.tcb"
 
-#define DB_KEYMAP    "db_keymap.tcb"
-#define DB_DATAMAP   "db_datamap.tcb"
-#define DB_ROOTMAP   "db_rootmap.tcb"
-#define DB_UNIQMAP   "db_uniqmap.tcb"
-#define DB_VISITORS  "db_visitors.tcb"
-#define DB_ROOT      "db_root.tcb"
-#define DB_HITS      "db_hits.tcb"
-#define DB_BW        "db_bw.tcb"
-#define DB_CUMTS     "db_cumts.tcb"
-#define DB_MAXTS     "db_maxts.tcb"
-#define DB_METHODS   "db_methods.tcb"
-#define DB_PROTOCOLS "db_protocols.tcb"
-#define DB_AGENTS    "db_agents.tcb"
+/* Key prefix of the tables for the whole app, module slots are below */
+#define TC_GLOBAL_TABLE 0xFF
+
+/* Tables for the whole app */
+#define TC_AGENT_KEYS  0
+#define TC_AGENT_VALS  1
+#define TC_GEN_STATS   2
+#define TC_UNIQUE_KEYS 3
+/* number of records of each table, kept across runs */
+#define TC_TABLE_SIZES 4
+/* top items of each module and sort field, kept across runs */
+#define TC_TOP_ITEMS   5
+
+/* composite keys up to this size are made on the stack */
+#define TC_KEY_BUF 256
+
+/* A table of the store. Its records are prefixed by the module and the
+ * metric, so records of a table are next to each other in the tree.
+ *
+ * 3|5|<key> -> hits (metric 5) of a key of module 3 */
+typedef struct GTCTable_
+{
+  unsigned char prefix[2];
+  uint32_t rnum;
+} GTCTable;
+
+/* The top items of a module for a sort field. The generation is the
+ * number of requests stored when they were taken, so they are out of
+ * date once new data is stored. */
+typedef struct GTCTopItems_
+{
+  uint32_t gen;
+  uint32_t size;                /* total number of items of the module */
+  uint32_t len;
+  GRawDataItem items[];
+} GTCTopItems;
 
 /* *INDENT-OFF* */
-TCBDB *tc_bdb_create (const char *dbname, int module);
+GTCTable *tc_bdb_table (int module, int metric);
+void tc_bdb_close_table (GTCTable * tbl);
+void tc_bdb_close (void);
 
-char *tc_db_set_path (const char *dbname, int module);
-int tc_bdb_close (void *db, char *dbname);
-void tc_db_get_params (char *params, const char *path);
+int tc_bdb_put (GTCTable * tbl, const void *key, int ksize, const void *value, int vsize);
+void *tc_bdb_get (GTCTable * tbl, const void *key, int ksize, int *vsize);
+int tc_bdb_addint (GTCTable * tbl, const void *key, int ksize, int inc);
+TCLIST *tc_bdb_getdup (GTCTable * tbl, const void *key, int ksize);
+void tc_bdb_foreach (GTCTable * tbl, void (*fp) (void *k, int ks, void *v, int vs, void *u), void *user_data);
 
 #ifdef TCB_BTREE
 int ins_igsl (void *hash, int key, int value);
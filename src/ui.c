@@ -55,9 +55,11 @@
 #endif
 
 #include "color.h"
+#include "custom.h"
 #include "error.h"
 #include "gmenu.h"
 #include "goaccess.h"
+#include "ship.h"
 #include "util.h"
 #include "xmalloc.h"
 
@@ -75,10 +77,13 @@ static GOutput outputting[] = {
   {REFERRERS       , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
   {REFERRING_SITES , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
   {KEYPHRASES      , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
   {GEO_LOCATION    , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
 #endif
   {STATUS_CODES    , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
+  {CUSTOM_1        , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
+  {CUSTOM_2        , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
+  {CUSTOM_3        , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 1 , 0 , 0} ,
 };
 /* *INDENT-ON* */
 
@@ -245,12 +250,18 @@ module_to_label (GModule module)
     REFER_LABEL,
     SITES_LABEL,
     KEYPH_LABEL,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     GEOLO_LABEL,
 #endif
     CODES_LABEL,
+    CUSTM_LABEL,
+    CUSTM_LABEL,
+    CUSTM_LABEL,
   };
 
+  if (IS_CUSTOM_MODULE (module) && custom_panel_name (module))
+    return custom_panel_name (module);
+
   return modules[module];
 }
 
@@ -270,10 +281,13 @@ module_to_id (GModule module)
     REFER_ID,
     SITES_ID,
     KEYPH_ID,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     GEOLO_ID,
 #endif
     CODES_ID,
+    CUSTM1_ID,
+    CUSTM2_ID,
+    CUSTM3_ID,
   };
 
   return modules[module];
@@ -295,12 +309,18 @@ module_to_head (GModule module)
     REFER_HEAD,
     SITES_HEAD,
     KEYPH_HEAD,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     GEOLO_HEAD,
 #endif
     CODES_HEAD,
+    CUSTM_HEAD,
+    CUSTM_HEAD,
+    CUSTM_HEAD,
   };
 
+  if (IS_CUSTOM_MODULE (module) && custom_panel_name (module))
+    return custom_panel_name (module);
+
   return modules[module];
 }
 
@@ -320,10 +340,13 @@ module_to_desc (GModule module)
     REFER_DESC,
     SITES_DESC,
     KEYPH_DESC,
-#ifdef HAVE_LIBGEOIP
+#ifdef HAVE_GEOLOCATION
     GEOLO_DESC,
 #endif
     CODES_DESC,
+    CUSTM_DESC,
+    CUSTM_DESC,
+    CUSTM_DESC,
   };
 
   return modules[module];
@@ -420,7 +443,7 @@ get_str_static_reqs (void)
 static char *
 get_str_visitors (void)
 {
-  return int2str (ht_get_size_uniqmap (VISITORS), 0);
+  return int2str (ht_get_size_uniqmap (VISITORS) + aggr_visitors (), 0);
 }
 
 static char *
@@ -139,6 +139,17 @@
 #define CODES_ID    "status_codes"
 #define CODES_LABEL "Status Codes"
 
+/* the head and label of a user-defined panel default to its name */
+#define CUSTM_HEAD  "Custom Panel"
+#define CUSTM_DESC  "Top extracted keys sorted by hits [, avgts, cumts, maxts]"
+#define CUSTM_LABEL "Custom"
+#define CUSTM1_ID   "custom_1"
+#define CUSTM2_ID   "custom_2"
+#define CUSTM3_ID   "custom_3"
+
+/* Panel still being built */
+#define LOADING_LBL "Loading..."
+
 #define GENER_ID   "general"
 
 /* Overall Statistics CSV/JSON Keys */
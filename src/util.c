@@ -269,6 +269,57 @@ ip_in_range (const char *ip)
   return 0;
 }
 
+/* Zero all but the first `bits` bits of the given address. */
+static void
+mask_addr (unsigned char *addr, int len, int bits)
+{
+  int i;
+
+  for (i = 0; i < len; i++, bits -= 8) {
+    if (bits <= 0)
+      addr[i] = 0;
+    else if (bits < 8)
+      addr[i] &= (unsigned char) (0xff << (8 - bits));
+  }
+}
+
+/* Mask the given IP address down to its network prefix, e.g.,
+ * 192.168.1.23 and 24 bits => 192.168.1.0/24. A prefix length of 0
+ * for an address family leaves its addresses as they are.
+ *
+ * On error, or if not aggregated, NULL is returned.
+ * On success, the newly allocated prefix is returned. */
+char *
+ip_to_prefix (const char *ip, int bits4, int bits6)
+{
+  char buf[INET6_ADDRSTRLEN] = "", *prefix = NULL;
+  struct in6_addr addr6;
+  struct in_addr addr4;
+  int bits = 0;
+
+  if (ip == NULL || *ip == '\0')
+    return NULL;
+
+  if (bits4 > 0 && 1 == inet_pton (AF_INET, ip, &addr4)) {
+    mask_addr ((unsigned char *) &addr4, sizeof (addr4), bits4);
+    if (inet_ntop (AF_INET, &addr4, buf, sizeof (buf)) == NULL)
+      return NULL;
+    bits = bits4;
+  } else if (bits6 > 0 && 1 == inet_pton (AF_INET6, ip, &addr6)) {
+    mask_addr ((unsigned char *) &addr6, sizeof (addr6), bits6);
+    if (inet_ntop (AF_INET6, &addr6, buf, sizeof (buf)) == NULL)
+      return NULL;
+    bits = bits6;
+  } else {
+    return NULL;
+  }
+
+  prefix = xmalloc (snprintf (NULL, 0, "%s/%d", buf, bits) + 1);
+  sprintf (prefix, "%s/%d", buf, bits);
+
+  return prefix;
+}
+
 
 char *
 get_home (void)
@@ -613,6 +664,104 @@ deblank (char *str)
   return out;
 }
 
+/* Per-run secret key for str_hash64(). Keys such as requests, referrers
+ * and user agents are attacker-controlled, hence a seeded hash. */
+static uint64_t hash_seed[2] = {
+  0x736f6d6570736575ULL, 0x646f72616e646f6dULL
+};
+
+#define ROTL64(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND(v0, v1, v2, v3) do {                  \
+  v0 += v1; v1 = ROTL64 (v1, 13); v1 ^= v0;            \
+  v0 = ROTL64 (v0, 32);                                \
+  v2 += v3; v3 = ROTL64 (v3, 16); v3 ^= v2;            \
+  v0 += v3; v3 = ROTL64 (v3, 21); v3 ^= v0;            \
+  v2 += v1; v1 = ROTL64 (v1, 17); v1 ^= v2;            \
+  v2 = ROTL64 (v2, 32);                                \
+} while (0)
+
+/* Seed the string hash function with a random key for this run.
+ *
+ * If /dev/urandom is not available, the key is derived from the current
+ * time and process id. */
+void
+seed_str_hash (void)
+{
+  uint64_t seed[2] = { 0, 0 };
+  FILE *fp;
+  int ok = 0;
+
+  if ((fp = fopen ("/dev/urandom", "rb")) != NULL) {
+    ok = fread (seed, sizeof (seed), 1, fp) == 1;
+    fclose (fp);
+  }
+
+  if (!ok) {
+    seed[0] = ((uint64_t) time (NULL) << 32) ^ (uint64_t) getpid ();
+    seed[1] = (uint64_t) clock () * 0x9e3779b97f4a7c15ULL;
+  }
+
+  hash_seed[0] ^= seed[0];
+  hash_seed[1] ^= seed[1];
+}
+
+/* Compute a seeded 64-bit hash of the given string (SipHash-1-3).
+ *
+ * The hash is computed once per extracted field and then carried along
+ * with the key so every table it is stored in can reuse it. */
+uint64_t
+str_hash64 (const char *str)
+{
+  const unsigned char *data = (const unsigned char *) str;
+  size_t len = strlen (str), i;
+  uint64_t v0 = 0x736f6d6570736575ULL ^ hash_seed[0];
+  uint64_t v1 = 0x646f72616e646f6dULL ^ hash_seed[1];
+  uint64_t v2 = 0x6c7967656e657261ULL ^ hash_seed[0];
+  uint64_t v3 = 0x7465646279746573ULL ^ hash_seed[1];
+  uint64_t b = ((uint64_t) len) << 56, m = 0;
+
+  for (i = 0; i + 8 <= len; i += 8) {
+    memcpy (&m, data + i, sizeof (m));
+    v3 ^= m;
+    SIPROUND (v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  switch (len & 7) {
+  case 7:
+    b |= ((uint64_t) data[i + 6]) << 48;
+    /* fall through */
+  case 6:
+    b |= ((uint64_t) data[i + 5]) << 40;
+    /* fall through */
+  case 5:
+    b |= ((uint64_t) data[i + 4]) << 32;
+    /* fall through */
+  case 4:
+    b |= ((uint64_t) data[i + 3]) << 24;
+    /* fall through */
+  case 3:
+    b |= ((uint64_t) data[i + 2]) << 16;
+    /* fall through */
+  case 2:
+    b |= ((uint64_t) data[i + 1]) << 8;
+    /* fall through */
+  case 1:
+    b |= ((uint64_t) data[i]);
+  }
+
+  v3 ^= b;
+  SIPROUND (v0, v1, v2, v3);
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIPROUND (v0, v1, v2, v3);
+  SIPROUND (v0, v1, v2, v3);
+  SIPROUND (v0, v1, v2, v3);
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
 char *
 strtoupper (char *str)
 {
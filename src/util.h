@@ -52,6 +52,7 @@ char *get_home (void);
 char *get_visitors_date (const char *odate, const char *from, const char *to);
 char *int2str (int d, int width);
 char *ints_to_str (int a, int b);
+char *ip_to_prefix (const char *ip, int bits4, int bits6);
 char *left_pad_str (const char *s, int indent);
 char *ltrim (char *s);
 char *replace_str (const char *str, const char *old, const char *new);
@@ -75,6 +76,8 @@ int str_to_time (const char *str, const char *fmt, struct tm *tm);
 int wc_match(char *wc, char *str);
 off_t file_size (const char *filename);
 uint32_t ip_to_binary (const char *ip);
+uint64_t str_hash64 (const char *str);
+void seed_str_hash (void);
 void strip_newlines (char *str);
 void xstrncpy (char *dest, const char *source, const size_t dest_size);
 
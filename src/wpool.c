@@ -0,0 +1,428 @@
+/**
+ * wpool.c -- a work-stealing pool of worker threads
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+/*
+ * A fixed set of workers, each with its own deque of tasks. Tasks
+ * submitted from outside the pool are spread round-robin over the
+ * deques, tasks submitted by a worker go to its own. An idle worker
+ * steals from the others. The thread waiting for a group of tasks runs
+ * queued tasks meanwhile, thus `threads` includes it and the pool only
+ * spawns threads - 1 workers, though at least one so that tasks can run
+ * in the background.
+ *
+ * "_GNU_SOURCE" is required for sched_getaffinity(2).
+ */
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "wpool.h"
+
+#include "error.h"
+#include "xmalloc.h"
+
+static GWPool pool = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .work = PTHREAD_COND_INITIALIZER,
+};
+
+/* The worker running on the current thread, if any */
+static __thread GWWorker *self = NULL;
+
+/* Read a CPU quota and its period. On cgroup v2 both are in cpu.max,
+ * i.e., "max 100000" or "50000 100000", on v1 each has its own file.
+ *
+ * If there is no quota, 0 is returned.
+ * On success, the number of CPUs the quota amounts to is returned. */
+static int
+read_cpu_quota (const char *quota_file, const char *period_file)
+{
+  long long quota = 0, period = 0;
+  FILE *fp;
+
+  if ((fp = fopen (quota_file, "r")) == NULL)
+    return 0;
+  if (fscanf (fp, "%lld", &quota) != 1)
+    quota = 0;
+  if (period_file == NULL && fscanf (fp, "%lld", &period) != 1)
+    period = 0;
+  fclose (fp);
+
+  if (period_file && (fp = fopen (period_file, "r")) != NULL) {
+    if (fscanf (fp, "%lld", &period) != 1)
+      period = 0;
+    fclose (fp);
+  }
+
+  if (quota <= 0 || period <= 0)
+    return 0;
+  return (int) ((quota + period - 1) / period);
+}
+
+/* Get the CPU quota of the cgroup of the process, e.g., within a
+ * container. The cgroup v2 path is taken from /proc/self/cgroup.
+ *
+ * If there is no quota, 0 is returned.
+ * On success, the number of CPUs the quota amounts to is returned. */
+static int
+cgroup_cpus (void)
+{
+  char line[PATH_MAX], path[PATH_MAX + 32];
+  FILE *fp;
+  int cpus = 0;
+
+  if ((fp = fopen ("/proc/self/cgroup", "r")) != NULL) {
+    while (fgets (line, sizeof (line), fp) != NULL) {
+      if (strncmp (line, "0::", 3) != 0)
+        continue;
+      line[strcspn (line, "\n")] = '\0';
+      snprintf (path, sizeof (path), "/sys/fs/cgroup%s/cpu.max", line + 3);
+      cpus = read_cpu_quota (path, NULL);
+      break;
+    }
+    fclose (fp);
+  }
+
+  if (cpus == 0)
+    cpus = read_cpu_quota ("/sys/fs/cgroup/cpu.max", NULL);
+  if (cpus == 0)
+    cpus = read_cpu_quota ("/sys/fs/cgroup/cpu/cpu.cfs_quota_us",
+                           "/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+
+  return cpus;
+}
+
+/* Get the number of CPUs the process can use, i.e., the online CPUs,
+ * narrowed by its affinity mask and its cgroup CPU quota.
+ *
+ * On success, a number between 1 and WPOOL_MAX_THREADS is returned. */
+int
+wpool_cpus (void)
+{
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  int quota = 0;
+#ifdef CPU_COUNT
+  cpu_set_t set;
+
+  if (sched_getaffinity (0, sizeof (set), &set) == 0 && CPU_COUNT (&set) > 0)
+    cpus = CPU_COUNT (&set);
+#endif
+
+  if ((quota = cgroup_cpus ()) > 0 && quota < cpus)
+    cpus = quota;
+
+  if (cpus < 1)
+    return 1;
+  if (cpus > WPOOL_MAX_THREADS)
+    return WPOOL_MAX_THREADS;
+  return (int) cpus;
+}
+
+/* Get the number of threads running tasks, the waiting one included.
+ *
+ * If the pool is not running, 1 is returned. */
+int
+wpool_threads (void)
+{
+  return pool.nworkers == 0 ? 1 : pool.threads;
+}
+
+/* Append a task to the tail of a deque, growing it if full. */
+static void
+deque_push (GWDeque * dq, const GWTask * task)
+{
+  GWTask *tasks = NULL;
+  int i;
+
+  pthread_mutex_lock (&dq->mutex);
+  if (dq->len == dq->cap) {
+    tasks = xcalloc (dq->cap * 2, sizeof (GWTask));
+    for (i = 0; i < dq->len; i++)
+      tasks[i] = dq->tasks[(dq->head + i) % dq->cap];
+    free (dq->tasks);
+    dq->tasks = tasks;
+    dq->cap *= 2;
+    dq->head = 0;
+  }
+  dq->tasks[(dq->head + dq->len) % dq->cap] = *task;
+  dq->len++;
+  pthread_mutex_unlock (&dq->mutex);
+}
+
+/* Take a task off a deque, the oldest one if owned, else the newest.
+ *
+ * If empty, 0 is returned.
+ * On success, 1 is returned. */
+static int
+deque_take (GWDeque * dq, GWTask * task, int owner)
+{
+  pthread_mutex_lock (&dq->mutex);
+  if (dq->len == 0) {
+    pthread_mutex_unlock (&dq->mutex);
+    return 0;
+  }
+
+  if (owner) {
+    *task = dq->tasks[dq->head];
+    dq->head = (dq->head + 1) % dq->cap;
+  } else {
+    *task = dq->tasks[(dq->head + dq->len - 1) % dq->cap];
+  }
+  dq->len--;
+  pthread_mutex_unlock (&dq->mutex);
+
+  return 1;
+}
+
+/* Take a task from the deque of the current worker, or steal one from
+ * the others, starting past the current worker.
+ *
+ * If none is queued, 0 is returned.
+ * On success, 1 is returned. */
+static int
+take_task (GWTask * task)
+{
+  int i, start = self ? self->idx + 1 : 0;
+  GWWorker *worker;
+
+  if (self && deque_take (&self->deque, task, 1))
+    goto found;
+
+  for (i = 0; i < pool.nworkers; i++) {
+    worker = &pool.workers[(start + i) % pool.nworkers];
+    if (worker != self && deque_take (&worker->deque, task, 0))
+      goto found;
+  }
+
+  return 0;
+
+found:
+  __atomic_sub_fetch (&pool.queued, 1, __ATOMIC_ACQ_REL);
+  return 1;
+}
+
+/* Run a task and, if it was the last of its group, wake the waiter. */
+static void
+run_task (GWTask * task)
+{
+  GWGroup *grp = task->grp;
+
+  task->fn (task->arg);
+  if (grp == NULL || __atomic_sub_fetch (&grp->pending, 1, __ATOMIC_ACQ_REL))
+    return;
+
+  pthread_mutex_lock (&pool.mutex);
+  pthread_cond_broadcast (&pool.work);
+  pthread_mutex_unlock (&pool.mutex);
+}
+
+/* A worker runs tasks until the pool stops, sleeping while there are
+ * none. It flags itself as running before checking whether to stop, so
+ * wpool_free() can tell which ones may still be busy. */
+static void *
+worker_thread (void *arg)
+{
+  GWTask task;
+
+  self = arg;
+  while (1) {
+    __atomic_store_n (&self->running, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&pool.stop, __ATOMIC_SEQ_CST))
+      break;
+
+    if (take_task (&task)) {
+      run_task (&task);
+      continue;
+    }
+    __atomic_store_n (&self->running, 0, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock (&pool.mutex);
+    while (__atomic_load_n (&pool.queued, __ATOMIC_ACQUIRE) <= 0 &&
+           !pool.stop)
+      pthread_cond_wait (&pool.work, &pool.mutex);
+    pthread_mutex_unlock (&pool.mutex);
+  }
+  __atomic_store_n (&self->running, 0, __ATOMIC_SEQ_CST);
+
+  return NULL;
+}
+
+/* A forked child only has the thread that forked, the workers are
+ * gone and a lock may have been held by one of them. Tasks then run
+ * where they are submitted. */
+static void
+atfork_child (void)
+{
+  pthread_mutex_init (&pool.mutex, NULL);
+  pthread_cond_init (&pool.work, NULL);
+  pool.nworkers = 0;
+  pool.queued = 0;
+  self = NULL;
+}
+
+/* Start the pool, with the given number of threads, the thread waiting
+ * for tasks included, or as many as CPUs if 0.
+ *
+ * On error, tasks run where they are submitted. */
+void
+wpool_init (int threads)
+{
+  GWWorker *worker;
+  int i, n;
+
+  if (pool.nworkers > 0)
+    return;
+
+  if (threads <= 0)
+    threads = wpool_cpus ();
+  if (threads > WPOOL_MAX_THREADS)
+    threads = WPOOL_MAX_THREADS;
+  n = threads > 1 ? threads - 1 : 1;
+
+  pool.threads = threads;
+  pool.workers = xcalloc (n, sizeof (GWWorker));
+  for (i = 0; i < n; i++) {
+    worker = &pool.workers[i];
+    worker->idx = i;
+    worker->deque.cap = WPOOL_DEQUE_INIT;
+    worker->deque.tasks = xcalloc (WPOOL_DEQUE_INIT, sizeof (GWTask));
+    pthread_mutex_init (&worker->deque.mutex, NULL);
+  }
+
+  /* deques are in place before any worker may steal from them */
+  pool.nworkers = n;
+  for (i = 0; i < n; i++) {
+    if (pthread_create (&pool.workers[i].thread, NULL, worker_thread,
+                        &pool.workers[i]) != 0)
+      break;
+  }
+
+  /* no thread at all, tasks run where submitted */
+  if (i == 0) {
+    LOG_DEBUG (("Unable to start the worker threads.\n"));
+    pool.nworkers = 0;
+    return;
+  }
+  if (i < n) {
+    LOG_DEBUG (("Only %d of %d worker threads started.\n", i, n));
+    pool.nworkers = i;
+  }
+
+  pthread_atfork (NULL, NULL, atfork_child);
+  LOG_DEBUG (("Started %d worker threads.\n", pool.nworkers));
+}
+
+/* Submit a task, it is accounted to the given group, if any. Without
+ * workers, it runs right away. */
+void
+wpool_submit (GWGroup * grp, GWTaskFn fn, void *arg)
+{
+  GWTask task = {.fn = fn,.arg = arg,.grp = grp };
+  GWWorker *worker = self;
+
+  if (pool.nworkers == 0) {
+    fn (arg);
+    return;
+  }
+
+  if (grp)
+    __atomic_add_fetch (&grp->pending, 1, __ATOMIC_ACQ_REL);
+  if (worker == NULL)
+    worker = &pool.workers[__atomic_fetch_add (&pool.next, 1, __ATOMIC_RELAXED)
+                           % pool.nworkers];
+  deque_push (&worker->deque, &task);
+
+  pthread_mutex_lock (&pool.mutex);
+  __atomic_add_fetch (&pool.queued, 1, __ATOMIC_ACQ_REL);
+  pthread_cond_broadcast (&pool.work);
+  pthread_mutex_unlock (&pool.mutex);
+}
+
+/* Wait for all tasks of a group to complete, running queued tasks, of
+ * any group, meanwhile. With a single thread, the caller only waits,
+ * so tasks run one at a time, though a worker waiting for tasks it
+ * submitted has to run them. */
+void
+wpool_wait (GWGroup * grp)
+{
+  GWTask task;
+  int help = self != NULL || pool.threads > 1;
+
+  while (__atomic_load_n (&grp->pending, __ATOMIC_ACQUIRE) > 0) {
+    if (help && take_task (&task)) {
+      run_task (&task);
+      continue;
+    }
+
+    pthread_mutex_lock (&pool.mutex);
+    while (__atomic_load_n (&grp->pending, __ATOMIC_ACQUIRE) > 0 &&
+           (!help || __atomic_load_n (&pool.queued, __ATOMIC_ACQUIRE) <= 0))
+      pthread_cond_wait (&pool.work, &pool.mutex);
+    pthread_mutex_unlock (&pool.mutex);
+  }
+}
+
+/* Stop the workers. Those in the middle of a task, e.g., a blocking
+ * DNS lookup, are left to finish it on their own rather than delaying
+ * the exit, in which case the pool is not freed. */
+void
+wpool_free (void)
+{
+  GWWorker *worker;
+  int i, busy = 0;
+
+  if (pool.nworkers == 0)
+    return;
+
+  pthread_mutex_lock (&pool.mutex);
+  __atomic_store_n (&pool.stop, 1, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast (&pool.work);
+  pthread_mutex_unlock (&pool.mutex);
+
+  for (i = 0; i < pool.nworkers; i++) {
+    worker = &pool.workers[i];
+    if (__atomic_load_n (&worker->running, __ATOMIC_SEQ_CST)) {
+      pthread_detach (worker->thread);
+      busy = 1;
+    } else {
+      pthread_join (worker->thread, NULL);
+    }
+  }
+
+  if (!busy) {
+    for (i = 0; i < pool.nworkers; i++) {
+      pthread_mutex_destroy (&pool.workers[i].deque.mutex);
+      free (pool.workers[i].deque.tasks);
+    }
+    free (pool.workers);
+    pool.workers = NULL;
+  }
+  pool.nworkers = 0;
+}
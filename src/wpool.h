@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2009-2014 by Gerardo Orellana <goaccess@prosoftcorp.com>
+ * GoAccess - An Ncurses apache weblog analyzer & interactive viewer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A copy of the GNU General Public License is attached to this
+ * source distribution for its full text.
+ *
+ * Visit http://goaccess.prosoftcorp.com for new releases.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifndef WPOOL_H_INCLUDED
+#define WPOOL_H_INCLUDED
+
+#include <pthread.h>
+
+#define WPOOL_MAX_THREADS 64
+#define WPOOL_DEQUE_INIT  64
+
+typedef void (*GWTaskFn) (void *arg);
+
+/* Tasks waited for together. Its counter is only touched atomically. */
+typedef struct GWGroup_
+{
+  int pending;
+} GWGroup;
+
+typedef struct GWTask_
+{
+  GWTaskFn fn;
+  void *arg;
+  GWGroup *grp;
+} GWTask;
+
+/* The tasks of a worker, a growable ring buffer. The owner runs them
+ * from the head, in the order they were submitted, while idle workers
+ * steal from the tail. */
+typedef struct GWDeque_
+{
+  pthread_mutex_t mutex;
+  GWTask *tasks;
+  int cap;
+  int head;
+  int len;
+} GWDeque;
+
+typedef struct GWWorker_
+{
+  pthread_t thread;
+  GWDeque deque;
+  int idx;
+  int running;                  /* in the middle of a task */
+} GWWorker;
+
+typedef struct GWPool_
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t work;          /* a task was queued or a group done */
+  GWWorker *workers;
+  int nworkers;
+  int threads;                  /* configured, the caller included */
+  int queued;
+  int next;                     /* round-robin of external submissions */
+  int stop;
+} GWPool;
+
+int wpool_cpus (void);
+int wpool_threads (void);
+void wpool_free (void);
+void wpool_init (int threads);
+void wpool_submit (GWGroup * grp, GWTaskFn fn, void *arg);
+void wpool_wait (GWGroup * grp);
+
+#endif